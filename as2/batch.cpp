@@ -0,0 +1,119 @@
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <../tiny_obj_loader.h>
+#include <../obj_reader.h>
+
+#include <blend.h>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+
+// Blend many weight vectors offline, without a window
+// Usage: batch <weights> <output> [base.obj target.obj ...]
+// weights is a text file of weight vectors, one weight per target each, separated by any
+// white space, so a .weights file is a file of one vector. The objs default to the faces of data/
+// output is binary, little endian:
+//   char[4] "BLND", uint32 version 1, uint32 vertices, uint32 targets, uint32 vectors,
+//   then the positions x y z of every vertex as float32, for every vector in order
+
+// Positions of an obj file, empty if it cannot be read
+std::vector<float> load_positions(const std::string &path);
+
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cout << "Usage: batch <weights> <output> [base.obj target.obj ...]" << std::endl;
+        return -1;
+    }
+    std::vector<std::string> paths;
+    for (int i = 3; i < argc; i++)
+        paths.push_back(argv[i]);
+    if (paths.empty()) {
+        paths.push_back("../data/faces/base.obj");
+        for (int i = 0; i < 35; i++)
+            paths.push_back("../data/faces/" + std::to_string(i) + ".obj");
+    }
+
+    // Only the deltas of the targets are kept
+    DeltaMatrix deltas;
+    deltas.setBase(load_positions(paths[0]));
+    if (deltas.coordinateCount() == 0) {
+        std::cout << "Failed to read " << paths[0] << std::endl;
+        return -1;
+    }
+    for (size_t j = 1; j < paths.size(); j++)
+        deltas.addTarget(load_positions(paths[j]));
+    BatchBlender blender(deltas);
+    size_t targets = blender.targetCount(), coordinates = blender.coordinateCount();
+    if (targets == 0) {
+        std::cout << "No blendshape targets given, only the base " << paths[0] << std::endl;
+        return -1;
+    }
+
+    std::ifstream fin(argv[1]);
+    if (!fin) {
+        std::cout << "Failed to open " << argv[1] << std::endl;
+        return -1;
+    }
+    std::ofstream fout(argv[2], std::ios::binary);
+    if (!fout) {
+        std::cout << "Failed to create " << argv[2] << std::endl;
+        return -1;
+    }
+    // The number of vectors is written once they are all read
+    uint32_t header[4] = {1, static_cast<uint32_t>(coordinates / 3), static_cast<uint32_t>(targets), 0};
+    fout.write("BLND", 4);
+    fout.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    // Weight vectors are read, blended and written a chunk at a time, so any number fits in memory
+    const size_t chunk = 8 * BatchBlender::rowBlock;
+    std::vector<float> weights(chunk * targets), positions(chunk * coordinates);
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (fin) {
+        size_t values = 0;
+        while (values < weights.size() && fin >> weights[values])
+            values++;
+        if (values % targets != 0) {
+            std::cout << "The last weight vector has " << values % targets << " of " << targets << " weights" << std::endl;
+            return -1;
+        }
+        size_t count = values / targets;
+        if (count == 0)
+            break;
+        blender.blend(weights.data(), count, positions.data());
+        fout.write(reinterpret_cast<const char*>(positions.data()), count * coordinates * sizeof(float));
+        total += count;
+    }
+    if (!fin.eof()) {
+        std::cout << "Failed to read " << argv[1] << " after " << total << " weight vectors" << std::endl;
+        return -1;
+    }
+
+    header[3] = static_cast<uint32_t>(total);
+    fout.seekp(4);
+    fout.write(reinterpret_cast<const char*>(header), sizeof(header));
+    if (!fout) {
+        std::cout << "Failed to write " << argv[2] << std::endl;
+        return -1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << total << " weight vectors of " << targets << " targets, " << coordinates / 3 << " vertices, in "
+              << seconds << " s" << std::endl;
+    return 0;
+}
+
+
+std::vector<float> load_positions(const std::string &path) {
+    ObjData obj;
+    std::string error;
+    if (!ObjReader::read(path, obj, error)) {
+        std::cout << "Failed to load " << path << ": " << error << std::endl;
+        return {};
+    }
+    return std::move(obj.positions);
+}
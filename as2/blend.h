@@ -0,0 +1,360 @@
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BLEND_HAS_AVX2 1
+#endif
+
+
+// Target minus base of the vertices every target moves, computed once when the targets are loaded
+// Targets usually move a small part of the face, so each keeps only the vertices it moves,
+// stored as a compressed sparse row matrix with one row per target:
+//   the vertices of target t are vertices[rowStart[t]] to vertices[rowStart[t + 1] - 1],
+//   in increasing order, and their deltas x y z are at 3 times the same positions in values
+class DeltaMatrix {
+    public:
+        // Positions of the base, x y z per vertex
+        std::vector<float> base;
+        std::vector<size_t> rowStart = {0};
+        std::vector<uint32_t> vertices;
+        std::vector<float> values;
+
+        // Start again from the positions of a base, with no targets
+        void setBase(const std::vector<float> &basePositions) {
+            base = basePositions;
+            rowStart.assign(1, 0);
+            vertices.clear();
+            values.clear();
+        }
+
+        // Add the next target from its positions, only the vertices it moves are kept
+        // A target whose size differs from the base is left out and moves nothing
+        void addTarget(const std::vector<float> &positions) {
+            if (positions.size() != base.size()) {
+                std::cout << "Blendshape target " << targetCount() << " has " << positions.size() / 3
+                          << " vertices, the base has " << base.size() / 3 << ", it is left out" << std::endl;
+            }
+            else {
+                appendDelta(base, positions, vertices, values);
+            }
+            rowStart.push_back(vertices.size());
+        }
+
+        // Append the vertices positions moves from base and their deltas x y z, in increasing order
+        static void appendDelta(const std::vector<float> &base, const std::vector<float> &positions,
+                                std::vector<uint32_t> &vertices, std::vector<float> &values) {
+            for (size_t v = 0; v < base.size() / 3; v++) {
+                float d[3] = {positions[3 * v] - base[3 * v], positions[3 * v + 1] - base[3 * v + 1], positions[3 * v + 2] - base[3 * v + 2]};
+                if (d[0] == 0 && d[1] == 0 && d[2] == 0)
+                    continue;
+                vertices.push_back(static_cast<uint32_t>(v));
+                values.insert(values.end(), d, d + 3);
+            }
+        }
+
+        size_t targetCount() const { return rowStart.size() - 1; }
+        size_t coordinateCount() const { return base.size(); }
+        size_t vertexCount() const { return base.size() / 3; }
+        // Moved vertices over all targets
+        size_t nonZeroCount() const { return vertices.size(); }
+
+        // out = base + sum of weights[t] * delta of target t, out has coordinateCount() floats
+        // Targets with a weight of zero are skipped, so the cost follows the vertices that move
+        // Vertices are split between threads when there is enough to do, each writes its own range of out
+        void blend(const float *weights, float *out) const {
+            std::copy(base.begin(), base.end(), out);
+
+            std::vector<uint32_t> active;
+            size_t work = 0;
+            for (size_t t = 0; t < targetCount(); t++) {
+                if (weights[t] != 0 && rowStart[t + 1] > rowStart[t]) {
+                    active.push_back(static_cast<uint32_t>(t));
+                    work += rowStart[t + 1] - rowStart[t];
+                }
+            }
+
+            size_t threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+            threadCount = std::min(threadCount, std::max<size_t>(1, work / minWorkPerThread));
+            if (threadCount == 1) {
+                blendRange(weights, active, out, 0, vertexCount());
+                return;
+            }
+            std::vector<std::thread> threads;
+            for (size_t k = 0; k < threadCount; k++)
+                threads.emplace_back([&, k]() {
+                    blendRange(weights, active, out, vertexCount() * k / threadCount, vertexCount() * (k + 1) / threadCount);
+                });
+            for (auto &thread : threads)
+                thread.join();
+        }
+
+    private:
+        // Moved vertices a thread should get at least, to pay for starting it
+        static const size_t minWorkPerThread = 1 << 16;
+
+        // Add the active targets to the vertices from first to end - 1 of out
+        void blendRange(const float *weights, const std::vector<uint32_t> &active, float *out, size_t first, size_t end) const {
+            for (uint32_t t : active) {
+                const uint32_t *row = vertices.data();
+                // The part of the row in range, rows are sorted by vertex
+                size_t i = std::lower_bound(row + rowStart[t], row + rowStart[t + 1], uint32_t(first)) - row;
+                size_t stop = std::lower_bound(row + i, row + rowStart[t + 1], uint32_t(end)) - row;
+                float w = weights[t];
+                for (; i < stop; i++) {
+                    float *o = out + 3 * size_t(row[i]);
+                    const float *d = &values[3 * i];
+                    o[0] += w * d[0];
+                    o[1] += w * d[1];
+                    o[2] += w * d[2];
+                }
+            }
+        }
+};
+
+
+// Vertices first to end - 1
+struct VertexRange {
+    uint32_t first;
+    uint32_t end;
+};
+
+
+// Blended positions kept from one set of weights to the next, for animation where few
+// weights change between frames. Only the targets whose weight changed are added again,
+// by the change of their weight. Every rebaseInterval updates the positions are blended
+// from the base again, so the rounding of the small changes cannot add up
+class IncrementalBlender {
+    public:
+        // Full blends are done this often at the least
+        int rebaseInterval = 256;
+
+        IncrementalBlender(const DeltaMatrix &deltas) : deltas(deltas) {}
+
+        // Positions x y z per vertex for the weights of the last update
+        const std::vector<float> &positions() const { return current; }
+
+        // Move to new weights, one per target, missing ones are 0
+        // dirty receives the sorted ranges of vertices whose positions changed
+        void update(const std::vector<float> &newWeights, std::vector<VertexRange> &dirty) {
+            dirty.clear();
+            size_t targets = deltas.targetCount();
+            auto weightOf = [&](size_t t) { return t < newWeights.size() ? newWeights[t] : 0.0f; };
+
+            // The first update, and every rebaseInterval-th, starts from the base
+            // The weights are checked too, as the positions of an empty base always match
+            if (weights.size() != targets || current.size() != deltas.coordinateCount() || ++updates >= rebaseInterval) {
+                current.resize(deltas.coordinateCount());
+                weights.resize(targets);
+                for (size_t t = 0; t < targets; t++)
+                    weights[t] = weightOf(t);
+                deltas.blend(weights.data(), current.data());
+                updates = 0;
+                if (deltas.vertexCount() > 0)
+                    dirty.push_back({0, static_cast<uint32_t>(deltas.vertexCount())});
+                return;
+            }
+
+            // Vertices moved by the changed targets, each listed once
+            if (marks.size() != deltas.vertexCount())
+                marks.assign(deltas.vertexCount(), 0);
+            touched.clear();
+            for (size_t t = 0; t < targets; t++) {
+                float change = weightOf(t) - weights[t];
+                if (change == 0)
+                    continue;
+                for (size_t i = deltas.rowStart[t]; i < deltas.rowStart[t + 1]; i++) {
+                    uint32_t v = deltas.vertices[i];
+                    const float *d = &deltas.values[3 * i];
+                    float *o = &current[3 * size_t(v)];
+                    o[0] += change * d[0];
+                    o[1] += change * d[1];
+                    o[2] += change * d[2];
+                    if (!marks[v]) {
+                        marks[v] = 1;
+                        touched.push_back(v);
+                    }
+                }
+                weights[t] = weightOf(t);
+            }
+
+            // Sorted runs of consecutive vertices, from the marks when so many are touched
+            // that reading them all is cheaper than sorting
+            auto add = [&](uint32_t v) {
+                marks[v] = 0;
+                if (!dirty.empty() && dirty.back().end == v)
+                    dirty.back().end++;
+                else
+                    dirty.push_back({v, v + 1});
+            };
+            if (touched.size() * 16 > marks.size()) {
+                for (uint32_t v = 0; v < marks.size(); v++)
+                    if (marks[v])
+                        add(v);
+            }
+            else {
+                std::sort(touched.begin(), touched.end());
+                for (uint32_t v : touched)
+                    add(v);
+            }
+        }
+
+    private:
+        const DeltaMatrix &deltas;
+        std::vector<float> current;
+        // Weights current was blended with
+        std::vector<float> weights;
+        int updates = 0;
+        // Vertices changed by this update, and a mark for each so it is listed once
+        std::vector<uint32_t> touched;
+        std::vector<uint8_t> marks;
+};
+
+
+// Blends many weight vectors at once, for offline jobs rather than animation
+// With the weight vectors as the rows of W (count x K) and the deltas of a target as a row
+// of D (K x 3V), the positions are the rows of base + W D, a dense matrix product
+// The deltas are copied out of the sparse matrix into column panels 16 coordinates wide,
+// each small enough to stay in L1 while it is multiplied with a block of weight vectors
+class BatchBlender {
+    public:
+        // Weight vectors per block, the part of W kept in L2 while the panels go past
+        static constexpr size_t rowBlock = 192;
+
+        BatchBlender(const DeltaMatrix &deltas) : targets(deltas.targetCount()), columns(deltas.coordinateCount()) {
+            size_t panelCount = (columns + panelWidth - 1) / panelWidth;
+            panels.assign(panelCount * targets * panelWidth, 0.0f);
+            base.assign(panelCount * panelWidth, 0.0f);
+            std::copy(deltas.base.begin(), deltas.base.end(), base.begin());
+            for (size_t t = 0; t < targets; t++) {
+                for (size_t i = deltas.rowStart[t]; i < deltas.rowStart[t + 1]; i++) {
+                    for (size_t k = 0; k < 3; k++) {
+                        size_t column = 3 * size_t(deltas.vertices[i]) + k;
+                        panels[((column / panelWidth) * targets + t) * panelWidth + column % panelWidth] = deltas.values[3 * i + k];
+                    }
+                }
+            }
+        }
+
+        size_t targetCount() const { return targets; }
+        size_t coordinateCount() const { return columns; }
+
+        // Blend count weight vectors of targetCount() weights each, one after the other
+        // out receives coordinateCount() positions per weight vector, in the same order
+        // Blocks of weight vectors are split between threads
+        void blend(const float *weights, size_t count, float *out) const {
+            size_t blocks = (count + rowBlock - 1) / rowBlock;
+            size_t threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+            threadCount = std::min(threadCount, blocks);
+            auto work = [&](size_t first, size_t end) {
+                for (size_t b = first; b < end; b++) {
+                    size_t row = b * rowBlock;
+                    blendBlock(weights + row * targets, std::min(rowBlock, count - row), out + row * columns);
+                }
+            };
+            if (threadCount <= 1) {
+                work(0, blocks);
+                return;
+            }
+            std::vector<std::thread> threads;
+            for (size_t k = 0; k < threadCount; k++)
+                threads.emplace_back(work, blocks * k / threadCount, blocks * (k + 1) / threadCount);
+            for (auto &thread : threads)
+                thread.join();
+        }
+
+    private:
+        // Coordinates per panel, and weight vectors per call of the kernel
+        static constexpr size_t panelWidth = 16;
+        static constexpr size_t kernelRows = 6;
+
+        size_t targets, columns;
+        // Panel p holds the deltas of coordinates 16p to 16p + 15, target by target, padded with zeros
+        std::vector<float> panels;
+        // Base positions, padded to whole panels
+        std::vector<float> base;
+
+        void blendBlock(const float *weights, size_t rows, float *out) const {
+            // The weights of every kernelRows weight vectors, target by target, padded with zeros
+            size_t groups = (rows + kernelRows - 1) / kernelRows;
+            std::vector<float> packed(groups * targets * kernelRows, 0.0f);
+            for (size_t r = 0; r < rows; r++)
+                for (size_t t = 0; t < targets; t++)
+                    packed[((r / kernelRows) * targets + t) * kernelRows + r % kernelRows] = weights[r * targets + t];
+
+            float acc[kernelRows * panelWidth];
+            size_t panelCount = base.size() / panelWidth;
+            for (size_t p = 0; p < panelCount; p++) {
+                const float *panel = &panels[p * targets * panelWidth];
+                size_t first = p * panelWidth, width = std::min(panelWidth, columns - first);
+                for (size_t g = 0; g < groups; g++) {
+                    kernel(&packed[g * targets * kernelRows], panel, targets, acc);
+                    for (size_t r = g * kernelRows; r < std::min(rows, (g + 1) * kernelRows); r++) {
+                        const float *a = &acc[(r % kernelRows) * panelWidth];
+                        float *o = out + r * columns + first;
+                        for (size_t c = 0; c < width; c++)
+                            o[c] = base[first + c] + a[c];
+                    }
+                }
+            }
+        }
+
+        // acc (kernelRows x panelWidth) = a (targets x kernelRows)^T b (targets x panelWidth)
+        static void kernel(const float *a, const float *b, size_t k, float *acc) {
+#ifdef BLEND_HAS_AVX2
+            static const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+            if (avx2) {
+                kernelAvx2(a, b, k, acc);
+                return;
+            }
+#endif
+            std::fill(acc, acc + kernelRows * panelWidth, 0.0f);
+            for (size_t t = 0; t < k; t++)
+                for (size_t r = 0; r < kernelRows; r++)
+                    for (size_t c = 0; c < panelWidth; c++)
+                        acc[r * panelWidth + c] += a[t * kernelRows + r] * b[t * panelWidth + c];
+        }
+
+#ifdef BLEND_HAS_AVX2
+        // Compiled for AVX2 on its own, so the rest of the program runs on any x86 CPU
+        // The 6 x 16 block lives in 12 registers while the targets go past, written out
+        // row by row so the compiler does not keep it in memory
+        __attribute__((target("avx2,fma")))
+        static void kernelAvx2(const float *a, const float *b, size_t k, float *acc) {
+            __m256 c00 = _mm256_setzero_ps(), c01 = c00, c10 = c00, c11 = c00, c20 = c00, c21 = c00;
+            __m256 c30 = c00, c31 = c00, c40 = c00, c41 = c00, c50 = c00, c51 = c00;
+            for (size_t t = 0; t < k; t++, a += kernelRows, b += panelWidth) {
+                __m256 b0 = _mm256_loadu_ps(b), b1 = _mm256_loadu_ps(b + 8), w;
+                w = _mm256_broadcast_ss(a);
+                c00 = _mm256_fmadd_ps(w, b0, c00);
+                c01 = _mm256_fmadd_ps(w, b1, c01);
+                w = _mm256_broadcast_ss(a + 1);
+                c10 = _mm256_fmadd_ps(w, b0, c10);
+                c11 = _mm256_fmadd_ps(w, b1, c11);
+                w = _mm256_broadcast_ss(a + 2);
+                c20 = _mm256_fmadd_ps(w, b0, c20);
+                c21 = _mm256_fmadd_ps(w, b1, c21);
+                w = _mm256_broadcast_ss(a + 3);
+                c30 = _mm256_fmadd_ps(w, b0, c30);
+                c31 = _mm256_fmadd_ps(w, b1, c31);
+                w = _mm256_broadcast_ss(a + 4);
+                c40 = _mm256_fmadd_ps(w, b0, c40);
+                c41 = _mm256_fmadd_ps(w, b1, c41);
+                w = _mm256_broadcast_ss(a + 5);
+                c50 = _mm256_fmadd_ps(w, b0, c50);
+                c51 = _mm256_fmadd_ps(w, b1, c51);
+            }
+            __m256 rows[2 * kernelRows] = {c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51};
+            for (size_t i = 0; i < 2 * kernelRows; i++)
+                _mm256_storeu_ps(acc + 8 * i, rows[i]);
+        }
+#endif
+};
+#endif
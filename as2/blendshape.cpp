@@ -60,20 +60,24 @@ int main(void) {
     // Wireframe mode
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-    // Load model
+    // Load model, from the rig pack when rigpack has written one for these objs, else from the objs
     std::vector<std::string> paths;
     paths.push_back("../data/faces/base.obj");
     for (int i = 0; i < 35; i++) {
         std::string path = "../data/faces/" + std::to_string(i) + ".obj";
         paths.push_back(path);
     }
-    Model src(paths);
+    std::unique_ptr<Model> src(new Model("../data/faces/rig.pack", paths));
+    if (!src->topology) {
+        // Only the targets 11.weights uses are read
+        src.reset(new Model(paths, size_t(256) << 20));
+    }
 
     // Load weights
     std::vector<float> weights = get_weights("../data/weights/11.weights");
 
     // Blended mesh
-    Mesh mesh = src.blendObjs(weights);
+    Mesh mesh = src->blendObjs(weights);
 
     // Transformation matrices
     glm::mat4 model = glm::mat4(1.0f);
@@ -66,7 +66,7 @@ int main(void) {
     paths.push_back("../data/cube.obj");
     Model src_model(paths);
     // Load mesh
-    Mesh mesh = src_model.processObj(0);
+    Mesh mesh = src_model.processObj();
 
     // Transformation matrices
     glm::mat4 model = glm::mat4(1.0f);
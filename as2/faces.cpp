@@ -65,7 +65,7 @@ int main(void) {
     std::vector<std::string> paths;
     paths.push_back("../data/faces/base.obj");
     Model src_model(paths);
-    Mesh mesh = src_model.processObj(0);
+    Mesh mesh = src_model.processObj();
 
     // Transformation matrices
     glm::mat4 model = glm::mat4(1.0f);
@@ -3,47 +3,21 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
-#include <glm/gtx/hash.hpp>
-
+#include <../mesh_store.h>
 #include <shader.h>
 
 #include <vector>
-
-
-// Struct for vertices
-struct Vertex {
-    // Position
-    glm::vec3 Position;
-    // Normal
-    glm::vec3 Normal;
-
-    // Overload the equality operator
-    bool operator==(const Vertex& other) const {
-        return Position == other.Position && Normal == other.Normal;
-    }
-};
-
-// Hash function for vertices, to be used with unordered_map
-namespace std {
-    template<> struct hash<Vertex> {
-        size_t operator()(Vertex const& vertex) const noexcept {
-            return hash<glm::vec3>()(vertex.Position) ^
-                   (hash<glm::vec3>()(vertex.Normal) << 1);
-        }
-    };
-}
+#include <memory>
 
 
 class Mesh {
     public:
-        // Mesh data
-        std::vector<Vertex>   vertices;
-        std::vector<uint32_t> indices;
+        // Mesh data, shared rather than copied, the buffers are filled from it directly
+        std::shared_ptr<const MeshStore> store;
 
         // Constructor
-        Mesh (std::vector<Vertex> vertices, std::vector<uint32_t> indices) {
-            this->vertices = vertices;
-            this->indices = indices;
+        Mesh (std::shared_ptr<const MeshStore> store) {
+            this->store = store;
 
             // Set up the vertex buffers and attribute pointers
             setupMesh();
@@ -52,7 +26,7 @@ class Mesh {
         // Render the mesh
         void Draw() {
             glBindVertexArray(VAO);
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+            glDrawElements(GL_TRIANGLES, store->indices.size(), GL_UNSIGNED_INT, 0);
             glBindVertexArray(0);
         }
 
@@ -68,21 +42,24 @@ class Mesh {
             glGenBuffers(1, &EBO);
 
             // Binding
+            // The streams of the store follow each other in one buffer
+            // VBO = [Position[0].x, Position[0].y, ..., Normal[0].x, ...]
+            Span<const float> positions(store->positions), normals(store->normals);
             glBindVertexArray(VAO);
             glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            // The memory layout of structs are sequential
-            // Vertex v = [Position[0], Position[1], Position[2], Normal[0], Normal[1]...]
-            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+            glBufferData(GL_ARRAY_BUFFER, positions.bytes() + normals.bytes(), nullptr, GL_STATIC_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, positions.bytes(), positions.data());
+            glBufferSubData(GL_ARRAY_BUFFER, positions.bytes(), normals.bytes(), normals.data());
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), &indices[0], GL_STATIC_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, store->indices.size() * sizeof(uint32_t), store->indices.data(), GL_STATIC_DRAW);
 
             // Set the vertex attribute pointers
             // Vertex positions
-            glEnableVertexAttribArray(0);	
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) 0);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*) 0);
             // Vertex normals
-            glEnableVertexAttribArray(1);	
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, Normal));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*) positions.bytes());
 
             // Unbind the VAO
             glBindVertexArray(0);
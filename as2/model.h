@@ -5,153 +5,191 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <../tiny_obj_loader.h>
+#include <../obj_reader.h>
 
 #include <mesh.h>
+#include <blend.h>
+#include <rig.h>
+#include <targets.h>
 #include <shader.h>
 
 #include <string>
 #include <iostream>
 #include <vector>
 #include <unordered_map>
-
-// Struct for data from obj files
-struct Obj {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-};
-
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 class Model {
     public:
-        std::vector<Obj> objs;
+        // The base, the targets are only kept in deltas
+        std::vector<ObjData> objs;
+        // Deltas of the targets from the base objs[0], only the vertices each moves
+        DeltaMatrix deltas;
+        // Positions blended for the last weights given to animateObjs
+        IncrementalBlender blender{deltas};
+        // Mesh of the base, welded once. Blends only move positions, so they copy its
+        // indices and normals and scatter their positions through its sources
+        std::shared_ptr<const MeshStore> topology;
+        // "path: message" for every file that could not be read, in the order of the paths
+        std::vector<std::string> errors;
+        // Targets read when a weight first uses them, instead of deltas, for a Model made with a budget
+        std::unique_ptr<TargetCache> targets;
 
         // Constructor, expects a vector of paths to obj files
+        // The first is the base, the others are the blendshape targets, of which only the
+        // positions are read into deltas
+        // The files are read in parallel, but the targets are added in the order of the paths
         Model(std::vector<std::string> paths) {
-            for (int i = 0; i < paths.size(); i++)
-                objs.push_back(loadObjs(paths[i].c_str()));
+            if (paths.empty())
+                return;
+
+            // Each file goes to its own slot, whichever thread reads it
+            std::vector<ObjData> loaded(paths.size());
+            std::vector<std::string> messages(paths.size());
+            std::vector<char> failed(paths.size(), 0);
+            std::atomic<size_t> next(0);
+            auto worker = [&]() {
+                for (size_t j = next++; j < paths.size(); j = next++) {
+                    failed[j] = !ObjReader::read(paths[j], loaded[j], messages[j]);
+                    // Only the positions of a target are needed
+                    if (j > 0) {
+                        std::vector<float> positions = std::move(loaded[j].positions);
+                        loaded[j] = ObjData();
+                        loaded[j].positions = std::move(positions);
+                    }
+                }
+            };
+            size_t threadCount = std::min<size_t>(paths.size(), std::max(1u, std::thread::hardware_concurrency()));
+            std::vector<std::thread> threads;
+            for (size_t k = 1; k < threadCount; k++)
+                threads.emplace_back(worker);
+            worker();
+            for (auto &thread : threads)
+                thread.join();
+
+            for (size_t j = 0; j < paths.size(); j++) {
+                if (failed[j]) {
+                    errors.push_back(paths[j] + ": " + messages[j]);
+                    std::cout << "Failed to load " << errors.back() << std::endl;
+                }
+            }
+            objs.push_back(std::move(loaded[0]));
+            deltas.setBase(objs[0].positions);
+            for (size_t j = 1; j < paths.size(); j++) {
+                deltas.addTarget(loaded[j].positions);
+                loaded[j] = ObjData();
+            }
         }
 
-        // Process the mesh corresponding to the nth obj
-        Mesh processObj(int n) {
-            return loadMesh(n);
+        // Constructor that reads only the base, the targets are read by targets the first time a
+        // weight uses them, and dropped when their deltas take more than targetBudget bytes
+        Model(std::vector<std::string> paths, size_t targetBudget) {
+            if (paths.empty())
+                return;
+            objs.emplace_back();
+            std::string error;
+            if (!ObjReader::read(paths[0], objs[0], error)) {
+                errors.push_back(paths[0] + ": " + error);
+                std::cout << "Failed to load " << errors.back() << std::endl;
+            }
+            deltas.setBase(objs[0].positions);
+            targets.reset(new TargetCache(objs[0].positions, std::vector<std::string>(paths.begin() + 1, paths.end()), targetBudget));
+        }
+
+        // Constructor from a rig pack written by rigpack from the objs at paths, the deltas and
+        // the welded base are read as they are, with nothing to parse or weld. objs stays empty
+        // topology stays null if there is no pack, quietly, or if it is invalid or older than
+        // the objs, and the objs should be read instead
+        Model(const std::string &rigPath, const std::vector<std::string> &paths) {
+            auto store = std::make_shared<MeshStore>();
+            std::string error;
+            if (!RigPack::read(rigPath, paths, deltas, *store, error)) {
+                if (RigPack::exists(rigPath)) {
+                    errors.push_back(rigPath + ": " + error);
+                    std::cout << "Not using " << errors.back() << ", run rigpack again" << std::endl;
+                }
+                return;
+            }
+            topology = store;
+        }
+
+        // Process the mesh of the base, the first obj
+        // Only the deltas of the targets are kept, a target is drawn by blending it with a weight of 1
+        Mesh processObj() {
+            return loadMesh();
         }
 
         // Blendshape with given weights
         Mesh blendObjs(std::vector<float> weights) {
             return blendMesh(weights);
         }
+
+        // Blendshape positions for animation, x y z per obj position
+        // Only the targets whose weights changed since the last call are applied again
+        // dirty receives the ranges of positions that moved, to update just those
+        // With targets read on demand every position is blended again
+        const std::vector<float> &animateObjs(const std::vector<float> &weights, std::vector<VertexRange> &dirty) {
+            if (targets) {
+                animated.resize(targets->coordinateCount());
+                targets->blend(weights, animated.data());
+                dirty.assign(1, {0, static_cast<uint32_t>(animated.size() / 3)});
+                return animated;
+            }
+            blender.update(weights, dirty);
+            return blender.positions();
+        }
+
+        // Start reading the targets of weights still to come, for a Model with targets read on demand
+        void prefetchObjs(const std::vector<float> &weights) {
+            if (targets)
+                targets->prefetch(weights);
+        }
         
     
     private:
-        // Load a mesh with tinyobjloader, and return the necessary info to further process it
-        Obj loadObjs(const char *path) {
-            // To initialize using tinyobjloader
-            tinyobj::attrib_t attrib;
-            std::vector<tinyobj::shape_t> shapes;
-            std::vector<tinyobj::material_t> materials;
-            std::string warn, err;
-            bool bTriangulate = true;
-
-            // Load the objs
-            bool bSuc = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path, nullptr, bTriangulate);
-            if(!bSuc) {
-                std::cout << "tinyobj error: " << err.c_str() << std::endl;
-            }
+        // Positions animateObjs blends into when targets are read on demand
+        std::vector<float> animated;
 
-            // Put data in an Obj struct
-            Obj obj;
-            obj.attrib = attrib;
-            obj.shapes = shapes;
-            return obj;
-        }        
-        
-        // Load the mesh corresponding to the nth obj
-        Mesh loadMesh(int n) {
-            // Load positions
-            std::vector<float> positions;
-            for (float coord : objs[n].attrib.vertices) {
-                positions.push_back(coord);
-            }
-            // Load normals
-            std::vector<float> normals;
-            for (float coord : objs[n].attrib.normals) {
-                normals.push_back(coord);
-            }
-            return processMesh(positions, normals, objs[n].shapes);
+        // Load the mesh of the base
+        Mesh loadMesh() {
+            return Mesh(baseTopology());
         }
 
-        // Blendshape operation with given weights
-        Mesh blendMesh(std::vector<float> weights) {
-            Obj base = objs[0];
+        // The welded base, built on first use
+        std::shared_ptr<const MeshStore> baseTopology() {
+            if (!topology)
+                topology = processMesh(objs[0]);
+            return topology;
+        }
 
+        // Blendshape operation with given weights, one per target
+        Mesh blendMesh(std::vector<float> weights) {
             // New positions [v0.x, v0.y, v0.z, v1.x, v1.y, v1.z...]
-            std::vector<float> new_positions;
-            // For each vertex position in the base obj file
-            uint32_t i, j;
-            for (i = 0; i < base.attrib.vertices.size(); i++) {
-                // The coordinate of the vertex in the base
-                float base_coord = base.attrib.vertices[i];
-                // Initialize the new coordinate to the cooridnate of the base
-                float new_coord = base_coord;
-
-                // For each obj file
-                for (j = 1; j < objs.size(); j++) {
-                    // The coordinate of the vertex to add
-                    float add_coord = objs[j].attrib.vertices[i];
-                    new_coord += weights[j-1] * (add_coord - base_coord);
-                }
-                new_positions.push_back(new_coord);
+            // base + sum of weights[j] * (target j - base), over the precomputed deltas
+            // Targets with a weight of zero cost nothing
+            std::vector<float> new_positions(deltas.coordinateCount());
+            if (targets) {
+                targets->blend(weights, new_positions.data());
             }
-
-            // Use the normals of the base
-            std::vector<float> normals;
-            for (float coord : base.attrib.normals) {
-                normals.push_back(coord);
+            else {
+                weights.resize(deltas.targetCount(), 0.0f);
+                deltas.blend(weights.data(), new_positions.data());
             }
 
-            return processMesh(new_positions, normals, base.shapes);
+            // Use the topology and normals of the base, no welding needed
+            auto store = std::make_shared<MeshStore>(*baseTopology());
+            store->scatterPositions(new_positions.data());
+            return Mesh(store);
         }
 
-        // Process mesh data
-        Mesh processMesh(std::vector<float> positions, std::vector<float> normals, std::vector<tinyobj::shape_t> shapes) {
-            // Data
-            std::vector<Vertex> vertices;
-            std::vector<uint32_t> indices;
-            // Keep track of unique vertices and respective indices
-            // If a vertex already exists, we do not add it to the list of vertices again
-            std::unordered_map<Vertex, uint32_t> uniqueVertices;
-
-            // For each index
-            for (auto shape : shapes) {
-                for (auto index : shape.mesh.indices) {
-                    Vertex vertex;
-                    glm::vec3 position, normal;
-
-                    // Get vertex position
-                    position.x = positions[index.vertex_index * 3];
-                    position.y = positions[index.vertex_index * 3 + 1];
-                    position.z = positions[index.vertex_index * 3 + 2];
-                    // Get vertex normals
-                    normal.x = normals[index.normal_index * 3];
-                    normal.y = normals[index.normal_index * 3 + 1];
-                    normal.z = normals[index.normal_index * 3 + 2];
-                    // Set vertex
-                    vertex.Position = position;
-                    vertex.Normal = normal;
-
-                    // Add the vertex to the vertices list if not already present
-                    if (uniqueVertices.count(vertex) == 0) {
-                        // Set the index of the new vertex
-                        uniqueVertices[vertex] = static_cast<uint32_t> (vertices.size());
-                        vertices.push_back(vertex);
-                    }
-
-                    // Add the index to the indices list
-                    indices.push_back(uniqueVertices[vertex]);
-                }
-            }
-
-            return Mesh(vertices, indices);
+        // Process mesh data into a store the mesh draws from
+        // A vertex is added once for every different pair of position and normal
+        std::shared_ptr<const MeshStore> processMesh(const ObjData &obj) {
+            return std::make_shared<MeshStore>(MeshStore::fromCorners(obj.positions.data(), obj.normals.empty() ? nullptr : obj.normals.data(),
+                                                                      nullptr, nullptr, obj.corners.data(), obj.corners.size()));
         }
 };
 #endif
@@ -0,0 +1,252 @@
+#ifndef RIG_H
+#define RIG_H
+
+#include <../mesh_store.h>
+#include <blend.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// A blendshape rig in one binary file, the deltas and the welded base as they are in memory,
+// so loading is a read of each array rather than parsing 36 obj files
+// Little endian:
+//   char[4] "RIGP", uint32 version 2, then uint32 counts: obj positions, targets, moved vertices
+//   over all targets, welded vertices, indices, 1 if there are normals, obj files it was
+//   made from, and a uint32 0, then a uint64 offset from the start of the file for each array:
+//     base      float32 x y z per obj position
+//     rowStart  uint64 per target and one more, as in DeltaMatrix
+//     vertices  uint32 per moved vertex
+//     values    float32 x y z per moved vertex
+//     normals   float32 x y z per welded vertex, absent without normals
+//     indices   uint32, three per triangle
+//     sources   uint32, the obj position of each welded vertex
+//     objs      uint64 size in bytes and uint64 modification time in ns of every obj file,
+//               the base first, so a pack older than its objs is not used
+// Every array starts at a multiple of 64 bytes, so in the mapped file it is aligned for
+// vector loads and starts a cache line
+// The deltas are stored sparse, as DeltaMatrix keeps them, the welded positions are not
+// stored as they are the base through sources
+class RigPack {
+    public:
+        static const uint32_t version = 2;
+
+        // Write deltas and the welded base topology made from the objs at objPaths to path
+        // Returns false with a message in error if it fails
+        static bool write(const std::string &path, const DeltaMatrix &deltas, const MeshStore &topology,
+                          const std::vector<std::string> &objPaths, std::string &error) {
+            std::vector<uint64_t> objs;
+            for (const std::string &objPath : objPaths) {
+                uint64_t size, time;
+                if (!fileStamp(objPath, size, time)) {
+                    error = "cannot read " + objPath;
+                    return false;
+                }
+                objs.push_back(size);
+                objs.push_back(time);
+            }
+
+            Header header = {};
+            memcpy(header.magic, "RIGP", 4);
+            header.version = version;
+            header.positions = static_cast<uint32_t>(deltas.vertexCount());
+            header.targets = static_cast<uint32_t>(deltas.targetCount());
+            header.nonZeros = static_cast<uint32_t>(deltas.nonZeroCount());
+            header.vertices = static_cast<uint32_t>(topology.vertexCount());
+            header.indices = static_cast<uint32_t>(topology.indices.size());
+            header.hasNormals = topology.normals.empty() ? 0 : 1;
+            header.objCount = static_cast<uint32_t>(objPaths.size());
+
+            std::vector<uint64_t> rowStart(deltas.rowStart.begin(), deltas.rowStart.end());
+            const void *arrays[arrayCount] = {deltas.base.data(), rowStart.data(), deltas.vertices.data(), deltas.values.data(),
+                                              topology.normals.data(), topology.indices.data(), topology.sources.data(), objs.data()};
+            uint64_t sizes[arrayCount];
+            arraySizes(header, sizes);
+            uint64_t offset = align(sizeof(Header));
+            for (int a = 0; a < arrayCount; a++) {
+                header.offsets[a] = offset;
+                offset = align(offset + sizes[a]);
+            }
+
+            std::ofstream fout(path, std::ios::binary);
+            if (!fout) {
+                error = "cannot create";
+                return false;
+            }
+            fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            uint64_t written = sizeof(header);
+            const char zeros[alignment] = {};
+            for (int a = 0; a < arrayCount; a++) {
+                fout.write(zeros, header.offsets[a] - written);
+                fout.write(static_cast<const char*>(arrays[a]), sizes[a]);
+                written = header.offsets[a] + sizes[a];
+            }
+            if (!fout) {
+                error = "cannot write";
+                return false;
+            }
+            return true;
+        }
+
+        // Whether there is a file at path, a missing pack is no error, the objs are read instead
+        static bool exists(const std::string &path) {
+            struct stat st;
+            return stat(path.c_str(), &st) == 0;
+        }
+
+        // Read a pack into deltas and topology, the welded positions are those of the base
+        // objPaths are the objs the pack should have been made from, in order
+        // Returns false with a message in error if the file is missing, not a valid pack, or made
+        // from other objs or from objs that have changed since
+        static bool read(const std::string &path, const std::vector<std::string> &objPaths,
+                         DeltaMatrix &deltas, MeshStore &topology, std::string &error) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                error = "cannot open";
+                return false;
+            }
+            struct stat st;
+            size_t size = fstat(fd, &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+            if (size < sizeof(Header)) {
+                close(fd);
+                error = "not a rig pack";
+                return false;
+            }
+            void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (data == MAP_FAILED) {
+                error = "cannot map";
+                return false;
+            }
+            bool valid = copyArrays(static_cast<const char*>(data), size, objPaths, deltas, topology, error);
+            munmap(data, size);
+            return valid;
+        }
+
+    private:
+        static const int arrayCount = 8;
+        static const size_t alignment = 64;
+
+        struct Header {
+            char magic[4];
+            uint32_t version;
+            uint32_t positions;
+            uint32_t targets;
+            uint32_t nonZeros;
+            uint32_t vertices;
+            uint32_t indices;
+            uint32_t hasNormals;
+            uint32_t objCount;
+            uint32_t unused;
+            uint64_t offsets[arrayCount];
+        };
+
+        static uint64_t align(uint64_t offset) {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        // Bytes of every array for the counts of a header
+        static void arraySizes(const Header &header, uint64_t sizes[arrayCount]) {
+            sizes[0] = uint64_t(header.positions) * 3 * sizeof(float);
+            sizes[1] = (uint64_t(header.targets) + 1) * sizeof(uint64_t);
+            sizes[2] = uint64_t(header.nonZeros) * sizeof(uint32_t);
+            sizes[3] = uint64_t(header.nonZeros) * 3 * sizeof(float);
+            sizes[4] = header.hasNormals ? uint64_t(header.vertices) * 3 * sizeof(float) : 0;
+            sizes[5] = uint64_t(header.indices) * sizeof(uint32_t);
+            sizes[6] = uint64_t(header.vertices) * sizeof(uint32_t);
+            sizes[7] = uint64_t(header.objCount) * 2 * sizeof(uint64_t);
+        }
+
+        // Size and modification time of a file
+        static bool fileStamp(const std::string &path, uint64_t &size, uint64_t &time) {
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0)
+                return false;
+            size = static_cast<uint64_t>(st.st_size);
+            time = uint64_t(st.st_mtim.tv_sec) * 1000000000ull + uint64_t(st.st_mtim.tv_nsec);
+            return true;
+        }
+
+        // Check the header and the indices, then copy every array out of the mapped file
+        static bool copyArrays(const char *data, size_t size, const std::vector<std::string> &objPaths,
+                               DeltaMatrix &deltas, MeshStore &topology, std::string &error) {
+            Header header;
+            memcpy(&header, data, sizeof(header));
+            if (memcmp(header.magic, "RIGP", 4) != 0 || header.version != version) {
+                error = "not a rig pack of version " + std::to_string(version);
+                return false;
+            }
+            uint64_t sizes[arrayCount];
+            arraySizes(header, sizes);
+            for (int a = 0; a < arrayCount; a++) {
+                if (header.offsets[a] % alignment != 0 || header.offsets[a] > size || sizes[a] > size - header.offsets[a]) {
+                    error = "truncated";
+                    return false;
+                }
+            }
+            auto array = [&](int a) { return data + header.offsets[a]; };
+
+            // Made from the same objs, unchanged since
+            const uint64_t *objs = reinterpret_cast<const uint64_t*>(array(7));
+            if (header.objCount != objPaths.size()) {
+                error = "made from " + std::to_string(header.objCount) + " objs, not " + std::to_string(objPaths.size());
+                return false;
+            }
+            for (size_t j = 0; j < objPaths.size(); j++) {
+                uint64_t size, time;
+                if (!fileStamp(objPaths[j], size, time) || size != objs[2 * j] || time != objs[2 * j + 1]) {
+                    error = "out of date with " + objPaths[j];
+                    return false;
+                }
+            }
+            const uint64_t *rowStart = reinterpret_cast<const uint64_t*>(array(1));
+            const uint32_t *vertices = reinterpret_cast<const uint32_t*>(array(2));
+            const uint32_t *indices = reinterpret_cast<const uint32_t*>(array(5));
+            const uint32_t *sources = reinterpret_cast<const uint32_t*>(array(6));
+
+            // Indices out of range would be read or written past the arrays when blending or drawing,
+            // the vertices of a target are strictly increasing as the blenders expect, and the
+            // indices are whole triangles
+            bool inRange = rowStart[0] == 0 && rowStart[header.targets] == header.nonZeros && header.indices % 3 == 0;
+            for (uint32_t t = 0; inRange && t < header.targets; t++)
+                inRange = rowStart[t] <= rowStart[t + 1];
+            for (uint32_t t = 0; inRange && t < header.targets; t++) {
+                for (uint64_t i = rowStart[t]; inRange && i < rowStart[t + 1]; i++)
+                    inRange = vertices[i] < header.positions && (i == rowStart[t] || vertices[i - 1] < vertices[i]);
+            }
+            for (uint32_t i = 0; inRange && i < header.indices; i++)
+                inRange = indices[i] < header.vertices;
+            for (uint32_t v = 0; inRange && v < header.vertices; v++)
+                inRange = sources[v] < header.positions;
+            if (!inRange) {
+                error = "indices out of range or order";
+                return false;
+            }
+
+            const float *base = reinterpret_cast<const float*>(array(0));
+            const float *values = reinterpret_cast<const float*>(array(3));
+            const float *normals = reinterpret_cast<const float*>(array(4));
+            deltas.base.assign(base, base + 3 * size_t(header.positions));
+            deltas.rowStart.assign(rowStart, rowStart + header.targets + 1);
+            deltas.vertices.assign(vertices, vertices + header.nonZeros);
+            deltas.values.assign(values, values + 3 * size_t(header.nonZeros));
+
+            topology = MeshStore();
+            topology.indices.assign(indices, indices + header.indices);
+            topology.sources.assign(sources, sources + header.vertices);
+            if (header.hasNormals)
+                topology.normals.assign(normals, normals + 3 * size_t(header.vertices));
+            topology.positions.resize(3 * size_t(header.vertices));
+            topology.scatterPositions(deltas.base.data());
+            return true;
+        }
+};
+#endif
@@ -0,0 +1,59 @@
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <../tiny_obj_loader.h>
+#include <../obj_reader.h>
+
+#include <blend.h>
+#include <rig.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// Compile a blendshape rig into one pack that blendshape loads without parsing
+// Usage: rigpack <output> [base.obj target.obj ...]
+// The objs default to the faces of data/, the format is described in rig.h
+
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cout << "Usage: rigpack <output> [base.obj target.obj ...]" << std::endl;
+        return -1;
+    }
+    std::vector<std::string> paths;
+    for (int i = 2; i < argc; i++)
+        paths.push_back(argv[i]);
+    if (paths.empty()) {
+        paths.push_back("../data/faces/base.obj");
+        for (int i = 0; i < 35; i++)
+            paths.push_back("../data/faces/" + std::to_string(i) + ".obj");
+    }
+
+    ObjData base;
+    std::string error;
+    if (!ObjReader::read(paths[0], base, error)) {
+        std::cout << "Failed to load " << paths[0] << ": " << error << std::endl;
+        return -1;
+    }
+    DeltaMatrix deltas;
+    deltas.setBase(base.positions);
+    for (size_t j = 1; j < paths.size(); j++) {
+        ObjData target;
+        if (!ObjReader::read(paths[j], target, error)) {
+            std::cout << "Failed to load " << paths[j] << ": " << error << std::endl;
+            return -1;
+        }
+        deltas.addTarget(target.positions);
+    }
+
+    // Welded as Model welds the base, by position and normal
+    MeshStore topology = MeshStore::fromCorners(base.positions.data(), base.normals.empty() ? nullptr : base.normals.data(),
+                                                nullptr, nullptr, base.corners.data(), base.corners.size());
+    if (!RigPack::write(argv[1], deltas, topology, paths, error)) {
+        std::cout << "Failed to write " << argv[1] << ": " << error << std::endl;
+        return -1;
+    }
+    std::cout << deltas.targetCount() << " targets moving " << deltas.nonZeroCount() << " of " << deltas.vertexCount() * deltas.targetCount()
+              << " vertices, " << topology.vertexCount() << " welded vertices, " << topology.triangleCount() << " triangles" << std::endl;
+    return 0;
+}
@@ -0,0 +1,212 @@
+#ifndef TARGETS_H
+#define TARGETS_H
+
+#include <../obj_reader.h>
+#include <blend.h>
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
+#include <cstdint>
+
+
+// Blendshape targets read from their obj files the first time a weight uses them, rather
+// than all at the start, so startup and memory follow the targets an animation uses
+// Each target is kept as its own sparse row of deltas, as in DeltaMatrix. Rows are dropped
+// least recently used first once they take more than the budget, and read again when needed.
+// A blend holds the rows it uses until it is done, so the budget should fit the targets of
+// one set of weights, or rows are read again every blend
+// prefetch reads targets on a thread of its own, so the weights of frames still to come
+// can be loaded while the current one is drawn
+class TargetCache {
+    public:
+        // base has x y z per vertex, paths one obj file per target
+        TargetCache(const std::vector<float> &base, const std::vector<std::string> &paths, size_t budgetBytes)
+            : base(base), paths(paths), budgetBytes(budgetBytes), targets(paths.size()) {}
+
+        ~TargetCache() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            queued.notify_all();
+            if (loader.joinable())
+                loader.join();
+        }
+
+        size_t targetCount() const { return paths.size(); }
+        size_t coordinateCount() const { return base.size(); }
+
+        // Bytes of the rows held now, and how many targets were read so far, counting those read again
+        size_t residentBytes() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return totalBytes;
+        }
+        size_t readCount() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return reads;
+        }
+
+        // Start reading the targets weights uses, missing weights are 0
+        // Returns at once, blend waits for a target still being read
+        void prefetch(const std::vector<float> &weights) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t t = 0; t < std::min(weights.size(), targets.size()); t++) {
+                if (weights[t] != 0 && !targets[t].row && targets[t].state == Absent) {
+                    targets[t].state = Queued;
+                    queue.push_back(t);
+                }
+            }
+            if (!queue.empty() && !loader.joinable())
+                loader = std::thread([this]() { loadQueued(); });
+            queued.notify_one();
+        }
+
+        // out = base + sum of weights[t] * delta of target t, out has coordinateCount() floats
+        // Targets with a weight of zero are not read, the others are read first if they are not held
+        void blend(const std::vector<float> &weights, float *out) {
+            std::copy(base.begin(), base.end(), out);
+            std::vector<std::pair<float, std::shared_ptr<const Row>>> used;
+            for (size_t t = 0; t < std::min(weights.size(), targets.size()); t++) {
+                if (weights[t] != 0)
+                    used.push_back({weights[t], acquire(t)});
+            }
+            for (const auto &u : used) {
+                float w = u.first;
+                const Row &row = *u.second;
+                for (size_t i = 0; i < row.vertices.size(); i++) {
+                    float *o = out + 3 * size_t(row.vertices[i]);
+                    const float *d = &row.values[3 * i];
+                    o[0] += w * d[0];
+                    o[1] += w * d[1];
+                    o[2] += w * d[2];
+                }
+            }
+        }
+
+    private:
+        // The vertices a target moves and their deltas x y z
+        struct Row {
+            std::vector<uint32_t> vertices;
+            std::vector<float> values;
+            size_t bytes() const { return vertices.size() * sizeof(uint32_t) + values.size() * sizeof(float); }
+        };
+        enum State { Absent, Queued, Loading };
+        struct Target {
+            std::shared_ptr<const Row> row;
+            State state = Absent;
+            // Blend or prefetch that last used the row, the smallest is dropped first
+            uint64_t lastUse = 0;
+            // Targets that cannot be read move nothing and are not read again
+            bool failed = false;
+        };
+
+        const std::vector<float> base;
+        const std::vector<std::string> paths;
+        const size_t budgetBytes;
+
+        std::mutex mutex;
+        // Signalled when a target has been read, and when the queue gets work or the cache is destroyed
+        std::condition_variable loaded, queued;
+        std::vector<Target> targets;
+        std::deque<size_t> queue;
+        std::thread loader;
+        bool stopping = false;
+        size_t totalBytes = 0;
+        size_t reads = 0;
+        uint64_t clock = 0;
+
+        // The row of target t, read here unless it is held or the loader has it
+        std::shared_ptr<const Row> acquire(size_t t) {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                Target &target = targets[t];
+                if (target.row) {
+                    target.lastUse = ++clock;
+                    return target.row;
+                }
+                if (target.state == Loading) {
+                    loaded.wait(lock);
+                    continue;
+                }
+                // Absent, or queued and not started, in which case the loader skips it
+                target.state = Loading;
+                lock.unlock();
+                std::shared_ptr<const Row> row = read(t);
+                lock.lock();
+                insert(t, row);
+                loaded.notify_all();
+            }
+        }
+
+        // Runs on the loader thread until the cache is destroyed
+        void loadQueued() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                queued.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (stopping)
+                    return;
+                size_t t = queue.front();
+                queue.pop_front();
+                if (targets[t].state != Queued)
+                    continue;
+                targets[t].state = Loading;
+                lock.unlock();
+                std::shared_ptr<const Row> row = read(t);
+                lock.lock();
+                insert(t, row);
+                loaded.notify_all();
+            }
+        }
+
+        // Read the obj of target t into a row, without the lock
+        std::shared_ptr<const Row> read(size_t t) {
+            auto row = std::make_shared<Row>();
+            ObjData obj;
+            std::string error;
+            if (!ObjReader::read(paths[t], obj, error)) {
+                std::cout << "Failed to load " << paths[t] << ": " << error << std::endl;
+                return nullptr;
+            }
+            if (obj.positions.size() != base.size()) {
+                std::cout << "Blendshape target " << t << " has " << obj.positions.size() / 3
+                          << " vertices, the base has " << base.size() / 3 << ", it is left out" << std::endl;
+                return nullptr;
+            }
+            DeltaMatrix::appendDelta(base, obj.positions, row->vertices, row->values);
+            return row;
+        }
+
+        // Hold the row read for target t, null if it could not be read, then drop the least
+        // recently used rows other than it until the budget is met
+        void insert(size_t t, std::shared_ptr<const Row> row) {
+            Target &target = targets[t];
+            reads++;
+            target.state = Absent;
+            target.lastUse = ++clock;
+            if (!row) {
+                target.failed = true;
+                target.row = std::make_shared<const Row>();
+                return;
+            }
+            target.row = row;
+            totalBytes += row->bytes();
+            while (totalBytes > budgetBytes) {
+                size_t oldest = targets.size();
+                for (size_t u = 0; u < targets.size(); u++) {
+                    if (u != t && targets[u].row && !targets[u].failed && (oldest == targets.size() || targets[u].lastUse < targets[oldest].lastUse))
+                        oldest = u;
+                }
+                if (oldest == targets.size())
+                    break;
+                totalBytes -= targets[oldest].row->bytes();
+                targets[oldest].row.reset();
+            }
+        }
+};
+#endif
@@ -4,54 +4,25 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
-#include <glm/gtx/hash.hpp>
 #include <../../stb_image.h>
-
+#include <../../mesh_store.h>
 #include <shader.h>
 
 #include <vector>
-
-
-// Struct for vertices
-struct Vertex {
-    // Position
-    glm::vec3 Position;
-    // Normal
-    glm::vec3 Normal;
-    // Texture
-    glm::vec2 TexCoord;
-
-    // Overload the equality operator
-    bool operator==(const Vertex& other) const {
-        return (Position == other.Position && Normal == other.Normal) && TexCoord == other.TexCoord;
-    }
-};
-
-
-// Hash function for vertices, to be used with unordered_map
-namespace std {
-    template<> struct hash<Vertex> {
-        size_t operator()(Vertex const& vertex) const noexcept {
-            return ((hash<glm::vec3>()(vertex.Position) ^
-                   (hash<glm::vec3>()(vertex.Normal) << 1)) >> 1) ^
-                   (hash<glm::vec2>()(vertex.TexCoord) << 1);
-        }
-    };
-}
+#include <memory>
 
 
 class Mesh {
     public:
-        // Mesh data
-        std::vector<Vertex> vertices;
-        std::vector<uint32_t> indices;
+        // Mesh data, shared rather than copied, the buffers are filled from it directly
+        // as4's TriangleMesh can trace the same store
+        std::shared_ptr<const MeshStore> store;
         const char *texPath;
         unsigned int texture;
 
         // Constructor
-        Mesh (std::vector<Vertex> vertices, std::vector<uint32_t> indices, const char *texPath) {
-            this->vertices = vertices;
-            this->indices = indices;
+        Mesh (std::shared_ptr<const MeshStore> store, const char *texPath) {
+            this->store = store;
             this->texPath = texPath;
 
             setupMesh();
@@ -64,7 +35,7 @@ class Mesh {
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_2D, this->texture);
             glBindVertexArray(VAO);
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+            glDrawElements(GL_TRIANGLES, store->indices.size(), GL_UNSIGNED_INT, 0);
             glBindVertexArray(0);
         }
         
@@ -81,24 +52,42 @@ class Mesh {
             glGenBuffers(1, &EBO);
 
             // Binding
+            // The streams of the store follow each other in one buffer
+            // VBO = [Position[0].x, Position[0].y, ..., Normal[0].x, ..., TexCoord[0].x, ..., Baked[0].r, ...]
+            Span<const float> streams[4] = {store->positions, store->normals, store->texcoords, store->colors};
+            size_t offsets[4], bytes = 0;
+            for (int k = 0; k < 4; k++) {
+                offsets[k] = bytes;
+                bytes += streams[k].bytes();
+            }
             glBindVertexArray(VAO);
             glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            // The memory layout of structs are sequential
-            // Vertex v = [Position[0], Position[1], Position[2], Normal[0], Normal[1]...]
-            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+            glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+            for (int k = 0; k < 4; k++)
+                glBufferSubData(GL_ARRAY_BUFFER, offsets[k], streams[k].bytes(), streams[k].data());
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), &indices[0], GL_STATIC_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, store->indices.size() * sizeof(uint32_t), store->indices.data(), GL_STATIC_DRAW);
 
             // Set the vertex attribute pointers
             // Vertex positions
-            glEnableVertexAttribArray(0);	
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) 0);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*) offsets[0]);
             // Vertex normals
-            glEnableVertexAttribArray(1);	
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, Normal));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*) offsets[1]);
             // Vertex texcoords
-            glEnableVertexAttribArray(2);	
-            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, TexCoord));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*) offsets[2]);
+            // Vertex baked lighting, rgb is the light scaling the ambient term and a the ambient occlusion
+            // Without a bake it is the constant 1 of an unlit, unoccluded vertex
+            if (streams[3].empty()) {
+                glDisableVertexAttribArray(3);
+                glVertexAttrib4f(3, 1.0f, 1.0f, 1.0f, 1.0f);
+            }
+            else {
+                glEnableVertexAttribArray(3);
+                glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*) offsets[3]);
+            }
 
             // Unbind the VAO
             glBindVertexArray(0);
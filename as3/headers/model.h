@@ -5,14 +5,18 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <../../tiny_obj_loader.h>
+#include <../../obj_reader.h>
 
 #include <mesh.h>
 #include <shader.h>
 
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <vector>
 #include <unordered_map>
+#include <memory>
 
 
 class Model {
@@ -20,10 +24,13 @@ class Model {
         std::vector<Mesh> meshes;
 
         // Constructor, expects a vector of paths to obj files, and a vector of paths to texture files
-        Model(std::vector<std::string> objPaths, std::vector<std::string> texPaths) {
+        // Optionally a vector of paths to lighting baked by as4's ray_bake, one per obj file,
+        // bakes that have not been written are skipped and the mesh is drawn unlit by them
+        Model(std::vector<std::string> objPaths, std::vector<std::string> texPaths, std::vector<std::string> bakePaths = {}) {
             for (int i = 0; i < objPaths.size(); i++) {
                 assert(objPaths.size() == texPaths.size());
-                meshes.push_back(loadMesh(objPaths[i].c_str(), texPaths[i].c_str()));
+                assert(bakePaths.empty() || objPaths.size() == bakePaths.size());
+                meshes.push_back(loadMesh(objPaths[i].c_str(), texPaths[i].c_str(), bakePaths.empty() ? "" : bakePaths[i]));
             }
         }
 
@@ -35,65 +42,60 @@ class Model {
         
     
     private:
-        // Load an obj file with tinyobjloader, and load a texture from an image
-        Mesh loadMesh(const char *objPath, const char *texPath) {
-            // To initialize using tinyobjloader
-            tinyobj::attrib_t attrib;
-            std::vector<tinyobj::shape_t> shapes;
-            std::vector<tinyobj::material_t> materials;
-            std::string warn, err;
-            bool bTriangulate = true;
+        // Read baked lighting, one vec4 per position of the obj file
+        // Returns an empty vector if the file is missing or does not match
+        // Bakes are optional, ray_bake writes them, so a missing one is not reported
+        std::vector<glm::vec4> loadBake(const std::string &bakePath, size_t positionCount) {
+            std::vector<glm::vec4> baked;
+            std::ifstream fin(bakePath);
+            if (!fin)
+                return baked;
 
-            // Load the objs
-            bool bSuc = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, objPath, nullptr, bTriangulate);
-            if(!bSuc) {
-                std::cout << "tinyobj error: " << err.c_str() << std::endl;
+            std::string line, tag;
+            size_t count = 0;
+            // Skip the comment, then "bake <count>"
+            while (std::getline(fin, line) && line.rfind("#", 0) == 0) {}
+            std::istringstream header(line);
+            header >> tag >> count;
+            if (tag != "bake" || count != positionCount) {
+                std::cout << bakePath << " does not match its obj file" << std::endl;
+                return baked;
             }
-            
-
-            // Data
-            std::vector<Vertex> vertices;
-            std::vector<uint32_t> indices;
-            // Keep track of unique vertices and respective indices
-            // If a vertex already exists, we do not add it to the list of vertices again
-            std::unordered_map<Vertex, uint32_t> uniqueVertices;
-
-            // For each index
-            for (auto shape : shapes) {
-                for (auto index : shape.mesh.indices) {
-                    Vertex vertex;
-                    glm::vec3 position, normal;
-                    glm::vec2 textcoord;
-
-                    // Get vertex position
-                    position.x = attrib.vertices[index.vertex_index * 3];
-                    position.y = attrib.vertices[index.vertex_index * 3 + 1];
-                    position.z = attrib.vertices[index.vertex_index * 3 + 2];
-                    // Get vertex normals
-                    normal.x = attrib.normals[index.normal_index * 3];
-                    normal.y = attrib.normals[index.normal_index * 3 + 1];
-                    normal.z = attrib.normals[index.normal_index * 3 + 2];
-                    // Get vertex texcoords
-                    textcoord.x = attrib.texcoords[index.texcoord_index * 2];
-                    textcoord.y = attrib.texcoords[index.texcoord_index * 2 + 1];
-                    // Set vertex
-                    vertex.Position = position;
-                    vertex.Normal = normal;
-                    vertex.TexCoord = textcoord;
 
-                    // Add the vertex to the vertices list if not already present
-                    if (uniqueVertices.count(vertex) == 0) {
-                        // Set the index of the new vertex
-                        uniqueVertices[vertex] = static_cast<uint32_t> (vertices.size());
-                        vertices.push_back(vertex);
-                    }
+            baked.resize(count);
+            for (size_t i = 0; i < count; i++) {
+                // Stored as occlusion r g b
+                float occlusion, r, g, b;
+                fin >> occlusion >> r >> g >> b;
+                baked[i] = glm::vec4(r, g, b, occlusion);
+            }
+            if (!fin) {
+                std::cout << bakePath << " is truncated" << std::endl;
+                baked.clear();
+            }
+            return baked;
+        }
 
-                    // Add the index to the indices list
-                    indices.push_back(uniqueVertices[vertex]);
-                }
+        // Load an obj file, and load a texture from an image
+        Mesh loadMesh(const char *objPath, const char *texPath, const std::string &bakePath) {
+            ObjData obj;
+            std::string error;
+            if (!ObjReader::read(objPath, obj, error)) {
+                std::cout << "Failed to load " << objPath << ": " << error << std::endl;
             }
+            
+            // Baked lighting is stored per position, in the order of the "v" lines
+            std::vector<glm::vec4> baked;
+            if (!bakePath.empty())
+                baked = loadBake(bakePath, obj.positions.size() / 3);
 
-            return Mesh(vertices, indices, texPath);
+            // A vertex is added once for every different position, normal and texcoord
+            // The streams are read from the obj arrays as they are, and the mesh uploads the store as it is
+            auto store = std::make_shared<MeshStore>(MeshStore::fromCorners(
+                obj.positions.data(), obj.normals.empty() ? nullptr : obj.normals.data(),
+                obj.texcoords.empty() ? nullptr : obj.texcoords.data(),
+                baked.empty() ? nullptr : &baked[0].x, obj.corners.data(), obj.corners.size()));
+            return Mesh(store, texPath);
         }
 };
 #endif
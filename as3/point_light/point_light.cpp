@@ -81,9 +81,12 @@ int main(void) {
     // Load model
     std::vector<std::string> objPaths;
     std::vector<std::string> texPaths;
+    // Lighting baked with as4's ray_bake
+    std::vector<std::string> bakePaths;
     objPaths.push_back("../data/timmy.obj");
     texPaths.push_back("../data/timmy.png");
-    Model src(objPaths, texPaths);
+    bakePaths.push_back("../data/timmy.bake");
+    Model src(objPaths, texPaths, bakePaths);
 
     float theta = 0;
 
@@ -2,10 +2,12 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in vec4 aBaked;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
+out vec4 Baked;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -16,5 +18,6 @@ void main() {
     FragPos = vec3(model * vec4(aPos, 1.0));
     Normal = normal * aNormal;
     TexCoord = aTexCoord;
+    Baked = aBaked;
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
@@ -31,6 +31,7 @@ struct SpotLight {
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoord;
+in vec4 Baked;
 out vec4 FragColor;
 
 uniform sampler2D textureT;
@@ -57,8 +58,8 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos) {
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
 
-    // Ambient lighting
-    vec3 ambient = light.ambient * vec3(texture(textureT, TexCoord));
+    // Ambient lighting, scaled by the baked light reaching this point
+    vec3 ambient = light.ambient * Baked.rgb * vec3(texture(textureT, TexCoord));
     // Diffuse lighting
     float diff = max(dot(normal, lightDir), 0.0);    
     vec3 diffuse = light.diffuse * vec3(texture(textureT, TexCoord)) * diff;
@@ -75,8 +76,8 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos) {
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
 
-    // Ambient lighting
-    vec3 ambient = light.ambient * vec3(texture(textureT, TexCoord));    
+    // Ambient lighting, scaled by the baked light reaching this point
+    vec3 ambient = light.ambient * Baked.rgb * vec3(texture(textureT, TexCoord));    
     // Diffuse lighting
     float diff = max(dot(normal, lightDir), 0.0);  
     // Check whether fragPos is in the spot light
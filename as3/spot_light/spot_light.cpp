@@ -102,13 +102,18 @@ int main(void) {
     // Load model
     std::vector<std::string> objPaths;
     std::vector<std::string> texPaths;
+    // Lighting baked with as4's ray_bake
+    std::vector<std::string> bakePaths;
     objPaths.push_back("../data/timmy.obj");
     texPaths.push_back("../data/timmy.png");
+    bakePaths.push_back("../data/timmy.bake");
     objPaths.push_back("../data/bucket.obj");
     texPaths.push_back("../data/bucket.jpg");
+    bakePaths.push_back("../data/bucket.bake");
     objPaths.push_back("../data/floor.obj");
     texPaths.push_back("../data/floor.jpeg");
-    Model src(objPaths, texPaths);
+    bakePaths.push_back("../data/floor.bake");
+    Model src(objPaths, texPaths, bakePaths);
 
     float theta = 0;
 
@@ -1,10 +1,12 @@
 #version 330 core
 
 in vec2 TexCoord;
+in vec4 Baked;
 out vec4 FragColor;
 
 uniform sampler2D textureT;
 
 void main() {
-    FragColor = texture(textureT, TexCoord);
+    // Darken by the baked ambient occlusion
+    FragColor = texture(textureT, TexCoord) * vec4(vec3(Baked.a), 1.0);
 }
@@ -2,8 +2,10 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in vec4 aBaked;
 
 out vec2 TexCoord;
+out vec4 Baked;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -11,5 +13,6 @@ uniform mat4 projection;
 
 void main() {
     TexCoord = aTexCoord;
+    Baked = aBaked;
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
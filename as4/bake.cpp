@@ -0,0 +1,62 @@
+#include "Baker.h"
+
+#include <iostream>
+#include <chrono>
+
+// Bake ambient occlusion and indirect light into the vertices of OBJ meshes
+// All meshes are loaded into one scene, so they shadow each other, and every
+// mesh.obj gets a mesh.bake that the as3 Model can load next to it
+// Usage: ray_bake [-n samples] [-d occlusion_distance] mesh.obj ...
+// e.g.   ray_bake ../../as3/data/timmy.obj ../../as3/data/bucket.obj ../../as3/data/floor.obj
+int main(int argc, char** argv)
+{
+    BakeSettings settings;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc)
+            settings.m_samples = std::stoi(argv[++i]);
+        else if (arg == "-d" && i + 1 < argc)
+            settings.m_occlusionDistance = std::stof(argv[++i]);
+        else
+            paths.push_back(arg);
+    }
+    if (settings.m_samples <= 0) {
+        std::cout << "The number of samples must be positive" << std::endl;
+        return -1;
+    }
+    if (paths.empty()) {
+        std::cout << "Usage: ray_bake [-n samples] [-d occlusion_distance] mesh.obj ..." << std::endl;
+        return -1;
+    }
+
+    // Light grey surfaces under the white background
+    World world;
+    auto material = make_shared<Diffuse>(Vector3D(0.6, 0.6, 0.6));
+    for (auto &path : paths) {
+        auto mesh = make_shared<TriangleMesh>(material);
+        if (!mesh->load_obj(path)) {
+            std::cout << "Failed to read " << path << std::endl;
+            return -1;
+        }
+        world.m_meshes.push_back(mesh);
+    }
+
+    for (size_t m = 0; m < paths.size(); ++m) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<BakedVertex> baked = bake_vertices(world, *world.m_meshes[m], settings);
+
+        // Swap the extension, keeping any dots in the directories
+        size_t dot = paths[m].rfind('.');
+        size_t slash = paths[m].rfind('/');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            dot = paths[m].size();
+        std::string bake_path = paths[m].substr(0, dot) + ".bake";
+        if (!write_baked_vertices(bake_path, baked)) {
+            std::cout << "Failed to write " << bake_path << std::endl;
+            return -1;
+        }
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        std::cout << baked.size() << " vertices baked to " << bake_path << " in " << seconds.count() << " s" << std::endl;
+    }
+}
@@ -0,0 +1,159 @@
+#include "RenderJob.h"
+#include "ImageBuffer.h"
+#include "ImageMetrics.h"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+// Convergence of a render against time
+// A reference of the scene is rendered once with many samples and no irradiance cache,
+// and kept in ../results, then the configuration under test is rendered in passes of
+// spp samples per pixel. After every pass the running mean is compared with the reference,
+// so changes to the tracer can be judged by the time they take to reach a given quality
+// Only render time is counted, not the time spent measuring the error
+// Usage: ray_benchmark [-r reference_spp] [-t seconds] [-q psnr] [-o name] [key=value ...]
+// with the keys of RenderJob.h, e.g.
+//        ray_benchmark -t 20 -q 30 scene=multi_diffuse cache=1 spp=2
+// The curve is written to ../results/<name>.csv and ../results/<name>.json
+int main(int argc, char** argv)
+{
+    int reference_spp = 4096;
+    double budget = 30;
+    double target_psnr = 0;
+    std::string name;
+
+    JobSpec spec;
+    spec.m_settings.m_width = 192;
+    spec.m_settings.m_height = 135;
+    spec.m_settings.m_raysPerPixel = 1;
+    spec.m_settings.m_useIrradianceCache = false;
+    std::string line;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-r" && i + 1 < argc)
+            reference_spp = std::stoi(argv[++i]);
+        else if (arg == "-t" && i + 1 < argc)
+            budget = std::stod(argv[++i]);
+        else if (arg == "-q" && i + 1 < argc)
+            target_psnr = std::stod(argv[++i]);
+        else if (arg == "-o" && i + 1 < argc)
+            name = argv[++i];
+        else
+            line += arg + " ";
+    }
+    std::string error;
+    if (!spec.parse(line, error)) {
+        std::cout << error << std::endl
+                  << "Usage: ray_benchmark [-r reference_spp] [-t seconds] [-q psnr] [-o name] [key=value ...]" << std::endl;
+        return -1;
+    }
+    if (name.empty())
+        name = "benchmark_" + spec.m_scene;
+
+    World world;
+    if (!spec.build_world(world)) {
+        std::cout << "Unknown scene " << spec.m_scene << std::endl;
+        return -1;
+    }
+    Camera camera = spec.camera();
+    int width = spec.m_settings.m_width, height = spec.m_settings.m_height;
+
+    // The reference only depends on the scene, the camera, the image size and the bounces
+    JobSpec reference_spec = spec;
+    reference_spec.m_settings.m_raysPerPixel = reference_spp;
+    reference_spec.m_settings.m_useIrradianceCache = false;
+    reference_spec.m_settings.m_tileSize = 64;
+    std::ostringstream reference_path;
+    reference_path << "../results/reference_" << std::hex << reference_spec.hash() << ".pfm";
+
+    RadianceBuffer reference(width, height);
+    if (reference.load_pfm(reference_path.str()) && reference.m_width == width && reference.m_height == height) {
+        std::cout << "reference read from " << reference_path.str() << std::endl;
+    }
+    else {
+        // Seeded apart from the passes below, so its noise is not correlated with theirs
+        RenderSettings settings = reference_spec.m_settings;
+        settings.m_seed = 0x7fffffff;
+        reference = RadianceBuffer(width, height);
+        Renderer renderer(world, camera, settings);
+        renderer.render(reference, [&](int done, int total) {
+            std::cout << "\rreference at " << reference_spp << " spp: tile " << done << " of " << total << std::flush;
+        });
+        std::cout << std::endl;
+        if (!reference.save_pfm(reference_path.str()))
+            std::cout << "Failed to save " << reference_path.str() << ", it will be rendered again next time" << std::endl;
+        else
+            std::cout << "reference saved at " << reference_path.str() << std::endl;
+    }
+
+    struct Sample {
+        double m_seconds;
+        int m_spp;
+        ImageError m_error;
+    };
+    std::vector<Sample> curve;
+
+    // One cache for every pass, as a single render with more samples would have
+    RenderSettings settings = spec.m_settings;
+    unique_ptr<IrradianceCache> cache;
+    if (settings.m_useIrradianceCache)
+        cache = make_unique<IrradianceCache>();
+
+    std::vector<Vector3D> sum(size_t(width) * height), mean(sum.size());
+    double seconds = 0;
+    double target_seconds = -1;
+    std::cout << std::setw(10) << "seconds" << std::setw(8) << "spp" << std::setw(10) << "rmse" << std::setw(10) << "psnr" << std::setw(10) << "flip" << std::endl;
+    for (int pass = 0; seconds < budget && (pass + 1) * settings.m_raysPerPixel <= reference_spp; ++pass) {
+        settings.m_seed = pass + 1;
+        RadianceBuffer frame(width, height);
+        auto start = std::chrono::steady_clock::now();
+        Renderer renderer(world, camera, settings, cache.get());
+        renderer.render(frame);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        for (size_t p = 0; p < sum.size(); ++p) {
+            sum[p] += frame.m_pixels[p];
+            mean[p] = sum[p] / float(pass + 1);
+        }
+        Sample sample = {seconds, (pass + 1) * settings.m_raysPerPixel, image_error(mean, reference.m_pixels, width, height)};
+        curve.push_back(sample);
+        std::cout << std::fixed << std::setprecision(3) << std::setw(10) << sample.m_seconds << std::setw(8) << sample.m_spp
+                  << std::setprecision(5) << std::setw(10) << sample.m_error.m_rmse << std::setprecision(2) << std::setw(10) << sample.m_error.m_psnr
+                  << std::setprecision(5) << std::setw(10) << sample.m_error.m_flip << std::endl;
+        if (target_psnr > 0 && target_seconds < 0 && sample.m_error.m_psnr >= target_psnr)
+            target_seconds = seconds;
+    }
+    std::cout << std::defaultfloat;
+    if (target_psnr > 0) {
+        if (target_seconds < 0)
+            std::cout << target_psnr << " dB not reached" << std::endl;
+        else
+            std::cout << target_psnr << " dB reached after " << target_seconds << " s" << std::endl;
+    }
+
+    std::string csv_path = "../results/" + name + ".csv";
+    std::ofstream csv(csv_path);
+    csv << "seconds,spp,rmse,psnr,flip\n";
+    for (auto &s : curve)
+        csv << s.m_seconds << ',' << s.m_spp << ',' << s.m_error.m_rmse << ',' << s.m_error.m_psnr << ',' << s.m_error.m_flip << '\n';
+
+    std::string json_path = "../results/" + name + ".json";
+    std::ofstream json(json_path);
+    json << "{\n  \"config\": \"" << spec.canonical() << "\",\n  \"reference_spp\": " << reference_spp << ",\n";
+    if (target_psnr > 0)
+        json << "  \"target_psnr\": " << target_psnr << ",\n  \"target_seconds\": " << (target_seconds < 0 ? std::string("null") : std::to_string(target_seconds)) << ",\n";
+    json << "  \"curve\": [\n";
+    for (size_t i = 0; i < curve.size(); ++i) {
+        const Sample& s = curve[i];
+        json << "    {\"seconds\": " << s.m_seconds << ", \"spp\": " << s.m_spp << ", \"rmse\": " << s.m_error.m_rmse
+             << ", \"psnr\": " << s.m_error.m_psnr << ", \"flip\": " << s.m_error.m_flip << "}" << (i + 1 < curve.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+
+    if (!csv || !json) {
+        std::cout << "Failed to write the curve" << std::endl;
+        return -1;
+    }
+    std::cout << "curve saved at " << csv_path << " and " << json_path << std::endl;
+}
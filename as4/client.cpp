@@ -0,0 +1,51 @@
+#include "Socket.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+// Send one job to ray_server and save the image
+// Usage: ray_client [-s socket] [-o output.ppm] [key=value ...]
+// e.g.   ray_client -o diffuse.ppm scene=multi_diffuse spp=64 priority=2
+int main(int argc, char** argv)
+{
+    std::string socket_path = default_socket_path;
+    std::string output_path = "result.ppm";
+    std::string job;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-s" && i + 1 < argc)
+            socket_path = argv[++i];
+        else if (arg == "-o" && i + 1 < argc)
+            output_path = argv[++i];
+        else
+            job += (job.empty() ? "" : " ") + arg;
+    }
+
+    int fd = connect_local(socket_path);
+    if (fd < 0) {
+        std::cout << "Failed to connect to " << socket_path << std::endl;
+        return -1;
+    }
+    write_line(fd, job);
+
+    std::string line;
+    while (read_line(fd, line)) {
+        if (line.rfind("result ", 0) == 0) {
+            std::vector<char> image(std::stoull(line.substr(7)));
+            if (!read_exact(fd, image.data(), image.size()))
+                break;
+            std::ofstream fout(output_path, std::ios::binary);
+            fout.write(image.data(), image.size());
+            std::cout << "ppm saved at " << output_path << std::endl;
+            close(fd);
+            return 0;
+        }
+        std::cout << line << std::endl;
+        if (line.rfind("error", 0) == 0)
+            break;
+    }
+
+    close(fd);
+    return -1;
+}
@@ -0,0 +1,111 @@
+#include "Camera.h"
+#include "World.h"
+#include "Renderer.h"
+#include "Incremental.h"
+#include "ImageBuffer.h"
+
+#include <iostream>
+#include <chrono>
+
+// Look-dev loop on generate_scene_all: a few small edits, each rendered again
+// incrementally and from scratch. The incremental render traces only the tiles
+// the edit can reach, and must give the same image as the full render
+// The images are written to ../results/edit_<step>.ppm
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+AABB sphere_box(const Sphere& sphere) {
+    Vector3D r(sphere.m_radius, sphere.m_radius, sphere.m_radius);
+    return AABB(sphere.m_center - r, sphere.m_center + r);
+}
+
+int main()
+{
+    RenderSettings settings;
+    settings.m_width = 384;
+    settings.m_height = 270;
+    settings.m_raysPerPixel = 16;
+    settings.m_maxLightBounceNum = 5;
+    settings.m_useIrradianceCache = false;
+    // Smaller tiles follow the edits more closely
+    settings.m_tileSize = 32;
+
+    Vector3D eye(20, 3, 3);
+    Vector3D target(0, 0, 0);
+    Vector3D up(0, 1, 0);
+    Camera camera(eye, target, up, 20, settings.m_width / float(settings.m_height));
+
+    World world;
+    seed_random(1);
+    world.generate_scene_all();
+
+    IncrementalRenderer incremental(world, camera, settings);
+    RadianceBuffer image(settings.m_width, settings.m_height);
+    auto start = std::chrono::steady_clock::now();
+    incremental.render(image);
+    std::cout << "first render: " << incremental.tile_count() << " tiles in " << seconds_since(start) << " s" << std::endl;
+
+    struct Edit {
+        std::string m_name;
+        std::function<void()> m_apply;
+    };
+    // Spheres are laid out in rows of 10, row -5 first
+    Sphere& near_sphere = *world.m_spheres[12 * 10 + 5];
+    Sphere& far_sphere = *world.m_spheres[0 * 10 + 3];
+    std::vector<Edit> edits = {
+        {"move a sphere near the camera up", [&]() {
+            AABB before = sphere_box(near_sphere);
+            near_sphere.m_center += Vector3D(0, 0.3, 0);
+            world.refit_bvh();
+            incremental.geometry_changed(before, sphere_box(near_sphere));
+        }},
+        {"recolour a far sphere", [&]() {
+            far_sphere.m_pMaterial->m_color = Vector3D(0.9, 0.1, 0.1);
+            incremental.material_changed(far_sphere.m_pMaterial.get());
+        }},
+        {"shrink a far sphere", [&]() {
+            AABB before = sphere_box(far_sphere);
+            far_sphere.m_radius *= 0.5;
+            far_sphere.m_center = far_sphere.m_center - Vector3D(0, far_sphere.m_radius, 0);
+            world.refit_bvh();
+            incremental.geometry_changed(before, sphere_box(far_sphere));
+        }},
+        {"recolour the floor", [&]() {
+            Material* floor = world.m_unbounded[0]->m_pMaterial.get();
+            floor->m_color = Vector3D(0.4, 0.45, 0.5);
+            incremental.material_changed(floor);
+        }},
+    };
+
+    for (size_t step = 0; step < edits.size(); ++step) {
+        edits[step].m_apply();
+        int dirty = incremental.dirty_tile_count();
+
+        start = std::chrono::steady_clock::now();
+        incremental.render(image);
+        double incremental_seconds = seconds_since(start);
+
+        RadianceBuffer full(settings.m_width, settings.m_height);
+        start = std::chrono::steady_clock::now();
+        Renderer renderer(world, camera, settings);
+        renderer.render(full);
+        double full_seconds = seconds_since(start);
+
+        float largest_difference = 0;
+        for (size_t p = 0; p < full.m_pixels.size(); ++p) {
+            Vector3D d = image.m_pixels[p] - full.m_pixels[p];
+            largest_difference = fmax(largest_difference, fmax(fabs(d.x()), fmax(fabs(d.y()), fabs(d.z()))));
+        }
+        std::cout << edits[step].m_name << ": " << dirty << " of " << incremental.tile_count() << " tiles in "
+                  << incremental_seconds << " s, full render " << full_seconds << " s, largest difference " << largest_difference << std::endl;
+
+        std::string path = "../results/edit_" + std::to_string(step) + ".ppm";
+        if (!image.save_ppm(path)) {
+            std::cout << "Failed to save " << path << std::endl;
+            return -1;
+        }
+    }
+    std::cout << "ppm saved at ../results/edit_<step>.ppm" << std::endl;
+}
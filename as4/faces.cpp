@@ -0,0 +1,137 @@
+#include "Camera.h"
+#include "World.h"
+#include "Renderer.h"
+#include "MappedImage.h"
+
+#include <iostream>
+#include <chrono>
+
+// Ray trace the blendshape faces of as2, one frame per weights file
+// The face deforms every frame, so its hierarchy is rebuilt every frame with the
+// linear builder. The full SAH build and a refit of the first frame's tree are
+// timed too, and all three are compared by how fast they trace the same rays
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Mean time of repeats calls of f, in milliseconds
+template<class F>
+double time_ms(int repeats, F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; ++i)
+        f();
+    return 1000 * seconds_since(start) / repeats;
+}
+
+// Primary rays through a grid of the image, traced against the mesh alone
+double trace_mrays(TriangleMesh& mesh, Camera& camera, int n) {
+    auto start = std::chrono::steady_clock::now();
+    int hits = 0;
+    for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < n; ++i) {
+            Ray r = camera.generate_ray((i + 0.5f) / n, (j + 0.5f) / n);
+            hits += mesh.hit(r, 0.001, std::numeric_limits<float>::infinity()).m_isHit;
+        }
+    }
+    return n * n / seconds_since(start) / 1e6;
+}
+
+std::vector<float> read_weights(const std::string& path) {
+    std::vector<float> weights;
+    std::ifstream fin(path);
+    float w;
+    while (fin >> w)
+        weights.push_back(w);
+    return weights;
+}
+
+int main()
+{
+    const std::string faces = "../../as2/data/faces/";
+    const std::string weights_dir = "../../as2/data/weights/";
+    const int target_count = 35;
+    const int frame_count = 12;
+
+    RenderSettings settings;
+    settings.m_width = 320;
+    settings.m_height = 240;
+    settings.m_raysPerPixel = 4;
+    settings.m_maxLightBounceNum = 3;
+    settings.m_useIrradianceCache = false;
+
+    // Base face and the targets, only their positions are used
+    auto face = make_shared<TriangleMesh>(make_shared<Diffuse>(Vector3D(0.7, 0.55, 0.45)));
+    if (!face->load_obj(faces + "base.obj")) {
+        std::cout << "Failed to read " << faces << "base.obj" << std::endl;
+        return -1;
+    }
+    std::vector<Vector3D> base = face->m_positions;
+    std::vector<std::vector<Vector3D>> deltas(target_count);
+    for (int t = 0; t < target_count; ++t) {
+        TriangleMesh target;
+        std::string path = faces + std::to_string(t) + ".obj";
+        if (!target.load_obj(path) || target.m_positions.size() != base.size()) {
+            std::cout << "Failed to read " << path << " or it does not match base.obj" << std::endl;
+            return -1;
+        }
+        deltas[t].resize(base.size());
+        for (size_t i = 0; i < base.size(); ++i)
+            deltas[t][i] = target.m_positions[i] - base[i];
+    }
+    std::cout << base.size() << " vertices, " << face->triangle_count() << " triangles, " << target_count << " targets" << std::endl;
+
+    World world;
+    world.m_meshes.push_back(face);
+    world.add_shape(make_shared<Plane>(Vector3D(0, 80, 0), Vector3D(0, 1, 0), make_shared<Diffuse>(Vector3D(0.5, 0.5, 0.5))));
+    world.build_bvh();
+
+    Vector3D eye(0, 115, 160);
+    Vector3D target(0, 112, 0);
+    Vector3D up(0, 1, 0);
+    Camera camera(eye, target, up, 30, settings.m_width / float(settings.m_height));
+
+    LBVHBuilder builder;
+    BVH refitted;
+    for (int frame = 0; frame < frame_count; ++frame) {
+        std::vector<float> weights = read_weights(weights_dir + std::to_string(frame) + ".weights");
+        if (weights.size() < size_t(target_count)) {
+            std::cout << "Failed to read " << target_count << " weights for frame " << frame << std::endl;
+            return -1;
+        }
+
+        // Base plus the weighted offsets of every target
+        for (size_t i = 0; i < base.size(); ++i) {
+            Vector3D p = base[i];
+            for (int t = 0; t < target_count; ++t)
+                if (weights[t] != 0)
+                    p += weights[t] * deltas[t][i];
+            face->m_positions[i] = p;
+        }
+        face->compute_normals();
+
+        double sah_ms = time_ms(5, [&]() { face->build_bvh(); });
+        double sah_mrays = trace_mrays(*face, camera, 256);
+        if (frame == 0)
+            refitted = face->m_bvh;
+        face->m_bvh = refitted;
+        double refit_ms = time_ms(20, [&]() { face->refit_bvh(); });
+        double refit_mrays = trace_mrays(*face, camera, 256);
+        double lbvh_ms = time_ms(20, [&]() { face->build_bvh(builder); });
+        double lbvh_mrays = trace_mrays(*face, camera, 256);
+
+        std::cout << "frame " << frame << ": build SAH " << sah_ms << " ms, LBVH " << lbvh_ms << " ms, refit " << refit_ms << " ms" << std::endl;
+        std::cout << "  trace SAH " << sah_mrays << " Mrays/s, LBVH " << lbvh_mrays << " Mrays/s, refit " << refit_mrays << " Mrays/s" << std::endl;
+
+        std::string path = "../results/face_" + std::to_string(frame) + ".ppm";
+        MappedImage image(path, settings.m_width, settings.m_height);
+        if (!image.is_open()) {
+            std::cout << "Failed to create " << path << std::endl;
+            return -1;
+        }
+        settings.m_seed = frame;
+        Renderer renderer(world, camera, settings);
+        renderer.render(image);
+    }
+    std::cout << "ppm saved at ../results/face_<frame>.ppm" << std::endl;
+}
@@ -0,0 +1,77 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <limits>
+#include <algorithm>
+
+#include "Vector3D.h"
+#include "Ray.h"
+
+// Axis aligned bounding box
+class AABB {
+public:
+    Vector3D m_min;
+    Vector3D m_max;
+
+    // An empty box, growing it by anything gives that thing's bounds
+    AABB() {
+        float inf = std::numeric_limits<float>::infinity();
+        m_min = Vector3D(inf, inf, inf);
+        m_max = Vector3D(-inf, -inf, -inf);
+    }
+
+    AABB(const Vector3D& min, const Vector3D& max) {
+        m_min = min;
+        m_max = max;
+    }
+
+    // std::min and max compile to single instructions where fmin and fmax are library calls,
+    // NaN coordinates are still ignored as the box starts from infinities
+    void grow(const Vector3D& p) {
+        m_min = Vector3D(std::min(m_min.x(), p.x()), std::min(m_min.y(), p.y()), std::min(m_min.z(), p.z()));
+        m_max = Vector3D(std::max(m_max.x(), p.x()), std::max(m_max.y(), p.y()), std::max(m_max.z(), p.z()));
+    }
+
+    void grow(const AABB& box) {
+        grow(box.m_min);
+        grow(box.m_max);
+    }
+
+    Vector3D center() const {
+        return 0.5 * (m_min + m_max);
+    }
+
+    // Slab test, inv_dir is 1 / ray direction per axis
+    bool hit(const Vector3D& origin, const Vector3D& inv_dir, float min_t, float max_t) const {
+        float entry;
+        return hit(origin, inv_dir, min_t, max_t, entry);
+    }
+
+    // Same, entry receives the distance at which the ray enters the box
+    bool hit(const Vector3D& origin, const Vector3D& inv_dir, float min_t, float max_t, float& entry) const {
+        float t0 = (m_min.x() - origin.x()) * inv_dir.x();
+        float t1 = (m_max.x() - origin.x()) * inv_dir.x();
+        min_t = fmax(min_t, fmin(t0, t1));
+        max_t = fmin(max_t, fmax(t0, t1));
+
+        t0 = (m_min.y() - origin.y()) * inv_dir.y();
+        t1 = (m_max.y() - origin.y()) * inv_dir.y();
+        min_t = fmax(min_t, fmin(t0, t1));
+        max_t = fmin(max_t, fmax(t0, t1));
+
+        t0 = (m_min.z() - origin.z()) * inv_dir.z();
+        t1 = (m_max.z() - origin.z()) * inv_dir.z();
+        min_t = fmax(min_t, fmin(t0, t1));
+        max_t = fmin(max_t, fmax(t0, t1));
+
+        entry = min_t;
+        return min_t <= max_t;
+    }
+};
+
+Vector3D inverse_direction(Ray& ray) {
+    Vector3D d = ray.direction();
+    return Vector3D(1 / d.x(), 1 / d.y(), 1 / d.z());
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <vector>
+#include <algorithm>
+
+#include "Camera.h"
+#include "World.h"
+
+using namespace std;
+
+class Keyframe {
+public:
+    float m_time;
+    Vector3D m_value;
+};
+
+
+// Smooth path through keyframes (Catmull-Rom), constant before the first
+// key and after the last one
+class Track {
+public:
+    vector<Keyframe> m_keys;
+
+    bool empty() const { return m_keys.empty(); }
+    void add(float time, Vector3D value);
+    Vector3D at(float time) const;
+};
+
+
+// Keyframed centre of one sphere of World::m_spheres
+class SphereTrack {
+public:
+    size_t m_sphere;
+    Track m_center;
+};
+
+
+class Animation {
+public:
+    Track m_eye;
+    Track m_target;
+    float m_fov = 20;
+    vector<SphereTrack> m_spheres;
+
+    bool has_object_motion() const { return !m_spheres.empty(); }
+
+    // Move the animated spheres to where they are at time and refit the hierarchy
+    void apply(World& world, float time) const;
+    Camera camera(float time, float aspect_ratio) const;
+
+    // Camera circling once around target in duration, at the height and distance of eye
+    static Animation turntable(Vector3D eye, Vector3D target, float duration, int keys = 16);
+};
+
+
+void Track::add(float time, Vector3D value) {
+    Keyframe key;
+    key.m_time = time;
+    key.m_value = value;
+    auto it = upper_bound(m_keys.begin(), m_keys.end(), time, [](float t, const Keyframe& k) { return t < k.m_time; });
+    m_keys.insert(it, key);
+}
+
+Vector3D Track::at(float time) const {
+    if (m_keys.empty())
+        return Vector3D(0, 0, 0);
+    if (time <= m_keys.front().m_time)
+        return m_keys.front().m_value;
+    if (time >= m_keys.back().m_time)
+        return m_keys.back().m_value;
+
+    // Key i starts the segment holding time
+    size_t i = 0;
+    while (m_keys[i + 1].m_time <= time)
+        ++i;
+    const Keyframe& k0 = m_keys[i > 0 ? i - 1 : i];
+    const Keyframe& k1 = m_keys[i];
+    const Keyframe& k2 = m_keys[i + 1];
+    const Keyframe& k3 = m_keys[i + 2 < m_keys.size() ? i + 2 : i + 1];
+
+    // Hermite curve with finite difference tangents scaled to the segment
+    float span = k2.m_time - k1.m_time;
+    float s = (time - k1.m_time) / span;
+    Vector3D m1 = (k2.m_value - k0.m_value) * (span / fmax(k2.m_time - k0.m_time, 1e-6));
+    Vector3D m2 = (k3.m_value - k1.m_value) * (span / fmax(k3.m_time - k1.m_time, 1e-6));
+    float s2 = s * s, s3 = s2 * s;
+    return (2 * s3 - 3 * s2 + 1) * k1.m_value + (s3 - 2 * s2 + s) * m1 + (-2 * s3 + 3 * s2) * k2.m_value + (s3 - s2) * m2;
+}
+
+
+void Animation::apply(World& world, float time) const {
+    if (m_spheres.empty())
+        return;
+    for (auto &track : m_spheres)
+        world.m_spheres[track.m_sphere]->m_center = track.m_center.at(time);
+    // The spheres moved but are the same, so the hierarchy only needs new bounds
+    world.refit_bvh();
+}
+
+Camera Animation::camera(float time, float aspect_ratio) const {
+    return Camera(m_eye.at(time), m_target.at(time), Vector3D(0, 1, 0), m_fov, aspect_ratio);
+}
+
+Animation Animation::turntable(Vector3D eye, Vector3D target, float duration, int keys) {
+    Animation animation;
+    Vector3D offset = eye - target;
+    float radius = sqrt(offset.x() * offset.x() + offset.z() * offset.z());
+    float start = atan2(offset.z(), offset.x());
+    for (int k = 0; k <= keys; ++k) {
+        float angle = start + 2 * M_PI * k / keys;
+        animation.m_eye.add(duration * k / keys, target + Vector3D(radius * cos(angle), offset.y(), radius * sin(angle)));
+    }
+    animation.m_target.add(0, target);
+    return animation;
+}
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <cstdint>
+
+#include "AABB.h"
+
+using namespace std;
+
+// Node of a bounding volume hierarchy, stored depth first
+// Leaves have m_count > 0 primitives starting at m_offset in BVH::m_indices,
+// inner nodes have their left child right after them and their right child at m_offset
+struct BVHNode {
+    AABB m_bounds;
+    uint32_t m_offset;
+    uint32_t m_count;
+};
+
+
+// Bounding volume hierarchy over any primitives given by their bounds
+// Children are always stored after their parent, so refit can update every
+// node in one backwards pass when primitives move but the topology is kept
+class BVH {
+public:
+    vector<BVHNode> m_nodes;
+    // Primitive indices, in leaf order
+    vector<uint32_t> m_indices;
+
+    bool empty() const { return m_nodes.empty(); }
+    void clear();
+
+    // Build with the surface area heuristic over binned centroids
+    void build(const vector<AABB>& bounds);
+    // Recompute node bounds for moved primitives, same number of primitives as build
+    void refit(const vector<AABB>& bounds);
+
+    // Visit the primitives a ray may hit, nearest subtrees first
+    // hit_primitive(index, max_t) tests one primitive, max_t is a float& and its return value is
+    // ignored. On a hit closer than max_t it records the hit and lowers max_t to its distance,
+    // which culls the boxes visited after it
+    template<class HitPrimitive>
+    void traverse(Ray& ray, float min_t, float max_t, HitPrimitive hit_primitive) const;
+
+private:
+    static const uint32_t leaf_size = 4;
+    static const int bin_count = 12;
+    uint32_t build_node(const vector<AABB>& bounds, vector<Vector3D>& centers, uint32_t first, uint32_t count);
+};
+
+
+void BVH::clear() {
+    m_nodes.clear();
+    m_indices.clear();
+}
+
+float surface_area(const AABB& box) {
+    Vector3D d = box.m_max - box.m_min;
+    if (d.x() < 0)
+        return 0;
+    return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+void BVH::build(const vector<AABB>& bounds) {
+    clear();
+    if (bounds.empty())
+        return;
+
+    vector<Vector3D> centers(bounds.size());
+    m_indices.resize(bounds.size());
+    for (uint32_t i = 0; i < bounds.size(); ++i) {
+        centers[i] = bounds[i].center();
+        m_indices[i] = i;
+    }
+    m_nodes.reserve(2 * bounds.size());
+    build_node(bounds, centers, 0, static_cast<uint32_t>(bounds.size()));
+}
+
+uint32_t BVH::build_node(const vector<AABB>& bounds, vector<Vector3D>& centers, uint32_t first, uint32_t count) {
+    uint32_t index = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back(BVHNode());
+
+    AABB box, center_box;
+    for (uint32_t i = first; i < first + count; ++i) {
+        box.grow(bounds[m_indices[i]]);
+        center_box.grow(centers[m_indices[i]]);
+    }
+    m_nodes[index].m_bounds = box;
+
+    // Find the cheapest split among the bin boundaries of every axis
+    int best_axis = -1;
+    int best_split = 0;
+    float best_cost = count * surface_area(box);
+    if (count > leaf_size) {
+        for (int axis = 0; axis < 3; ++axis) {
+            float lo = component(center_box.m_min, axis);
+            float extent = component(center_box.m_max, axis) - lo;
+            if (extent <= 0)
+                continue;
+
+            AABB bin_bounds[bin_count];
+            int bin_counts[bin_count] = {0};
+            for (uint32_t i = first; i < first + count; ++i) {
+                int bin = min(bin_count - 1, int(bin_count * (component(centers[m_indices[i]], axis) - lo) / extent));
+                bin_bounds[bin].grow(bounds[m_indices[i]]);
+                bin_counts[bin]++;
+            }
+
+            // Sweep from the right, then from the left
+            float right_area[bin_count];
+            int right_count[bin_count];
+            AABB right;
+            int n = 0;
+            for (int b = bin_count - 1; b > 0; --b) {
+                right.grow(bin_bounds[b]);
+                n += bin_counts[b];
+                right_area[b] = surface_area(right);
+                right_count[b] = n;
+            }
+            AABB left;
+            n = 0;
+            for (int b = 0; b < bin_count - 1; ++b) {
+                left.grow(bin_bounds[b]);
+                n += bin_counts[b];
+                float cost = n * surface_area(left) + right_count[b + 1] * right_area[b + 1];
+                if (n > 0 && right_count[b + 1] > 0 && cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = b + 1;
+                }
+            }
+        }
+    }
+
+    uint32_t mid = first;
+    if (best_axis >= 0) {
+        float lo = component(center_box.m_min, best_axis);
+        float extent = component(center_box.m_max, best_axis) - lo;
+        for (uint32_t i = first; i < first + count; ++i) {
+            int bin = min(bin_count - 1, int(bin_count * (component(centers[m_indices[i]], best_axis) - lo) / extent));
+            if (bin < best_split)
+                swap(m_indices[i], m_indices[mid++]);
+        }
+    }
+    // Too many primitives for a leaf but no useful split, halve the list
+    else if (count > 2 * leaf_size) {
+        mid = first + count / 2;
+    }
+
+    if (mid == first || mid == first + count) {
+        m_nodes[index].m_offset = first;
+        m_nodes[index].m_count = count;
+        return index;
+    }
+
+    build_node(bounds, centers, first, mid - first);
+    uint32_t right = build_node(bounds, centers, mid, first + count - mid);
+    m_nodes[index].m_offset = right;
+    m_nodes[index].m_count = 0;
+    return index;
+}
+
+void BVH::refit(const vector<AABB>& bounds) {
+    for (size_t i = m_nodes.size(); i-- > 0;) {
+        BVHNode& node = m_nodes[i];
+        AABB box;
+        if (node.m_count > 0) {
+            for (uint32_t p = node.m_offset; p < node.m_offset + node.m_count; ++p)
+                box.grow(bounds[m_indices[p]]);
+        }
+        else {
+            box.grow(m_nodes[i + 1].m_bounds);
+            box.grow(m_nodes[node.m_offset].m_bounds);
+        }
+        node.m_bounds = box;
+    }
+}
+
+template<class HitPrimitive>
+void BVH::traverse(Ray& ray, float min_t, float max_t, HitPrimitive hit_primitive) const {
+    if (m_nodes.empty())
+        return;
+
+    Vector3D origin = ray.origin();
+    Vector3D inv_dir = inverse_direction(ray);
+
+    uint32_t stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        uint32_t index = stack[--stack_size];
+        const BVHNode& node = m_nodes[index];
+        if (!node.m_bounds.hit(origin, inv_dir, min_t, max_t))
+            continue;
+
+        if (node.m_count > 0) {
+            for (uint32_t p = node.m_offset; p < node.m_offset + node.m_count; ++p)
+                hit_primitive(m_indices[p], max_t);
+            continue;
+        }
+
+        // Visit the nearer child first so later boxes are culled by the closest hit
+        uint32_t left = index + 1, right = node.m_offset;
+        float t_left, t_right;
+        bool hit_left = m_nodes[left].m_bounds.hit(origin, inv_dir, min_t, max_t, t_left);
+        bool hit_right = m_nodes[right].m_bounds.hit(origin, inv_dir, min_t, max_t, t_right);
+        if (hit_left && hit_right) {
+            stack[stack_size++] = t_left < t_right ? right : left;
+            stack[stack_size++] = t_left < t_right ? left : right;
+        }
+        else if (hit_left)
+            stack[stack_size++] = left;
+        else if (hit_right)
+            stack[stack_size++] = right;
+    }
+}
+
+#endif
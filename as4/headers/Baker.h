@@ -0,0 +1,107 @@
+#ifndef BAKER_H
+#define BAKER_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+#include "Ray.h"
+#include "World.h"
+#include "Renderer.h"
+
+// Settings of a bake
+class BakeSettings {
+public:
+    int m_samples = 256;
+    // Occluders further than this do not count, 0 uses a tenth of the scene's size
+    float m_occlusionDistance = 0;
+    int m_maxLightBounceNum = 3;
+    // 0 uses every hardware thread
+    int m_numThreads = 0;
+};
+
+
+// Lighting precomputed at one vertex
+class BakedVertex {
+public:
+    // Cosine weighted fraction of the hemisphere left open within the occlusion distance
+    float m_occlusion = 1;
+    // Hemisphere average of the light from the background and the other surfaces,
+    // the factor the ambient term of a shader is scaled by
+    Vector3D m_light = Vector3D(1, 1, 1);
+};
+
+
+// Bake every position of mesh, which must be one of world.m_meshes
+// Vertices are split into chunks traced in parallel, every chunk seeds its own
+// random numbers so the result does not depend on the number of threads
+std::vector<BakedVertex> bake_vertices(World& world, const TriangleMesh& mesh, const BakeSettings& settings) {
+    std::vector<BakedVertex> baked(mesh.positions().size());
+    Span<const Vector3D> positions = mesh.positions(), normals = mesh.normals();
+
+    // Scale the ray offset and the default distance with the scene, OBJs come in any unit
+    AABB scene;
+    for (auto &m : world.m_meshes)
+        for (auto &p : m->positions())
+            scene.grow(p);
+    float size = baked.empty() ? 1 : (scene.m_max - scene.m_min).length();
+    float distance = settings.m_occlusionDistance > 0 ? settings.m_occlusionDistance : 0.1 * size;
+    float offset = 1e-4 * size;
+
+    const int chunk_size = 256;
+    int chunks = static_cast<int>((baked.size() + chunk_size - 1) / chunk_size);
+    std::atomic<int> next(0);
+
+    auto worker = [&]() {
+        for (int chunk = next++; chunk < chunks; chunk = next++) {
+            seed_random(0x9e3779b9u * (chunk + 1));
+            size_t end = std::min(baked.size(), size_t(chunk + 1) * chunk_size);
+            for (size_t i = size_t(chunk) * chunk_size; i < end; ++i) {
+                Vector3D normal = normals[i];
+                // Positions no face uses keep the neutral value
+                if (normal.length_squared() == 0)
+                    continue;
+                Vector3D origin = positions[i] + offset * normal;
+
+                float open = 0;
+                Vector3D light(0, 0, 0);
+                for (int s = 0; s < settings.m_samples; ++s) {
+                    Vector3D dir = uniform_hemisphere_direction(normal);
+                    Ray r(origin, dir);
+                    float hit_distance;
+                    light += ray_hit_color(r, world, settings.m_maxLightBounceNum, nullptr, &hit_distance);
+                    // Uniform directions weighted by 2 cos give the cosine weighted average
+                    if (hit_distance > distance)
+                        open += 2 * dot(dir, normal);
+                }
+                baked[i].m_occlusion = fmin(open / settings.m_samples, 1);
+                baked[i].m_light = light / float(settings.m_samples);
+            }
+        }
+    };
+
+    int num_threads = settings.m_numThreads > 0 ? settings.m_numThreads : max(1u, thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i)
+        threads.emplace_back(worker);
+    for (auto &thread : threads)
+        thread.join();
+    return baked;
+}
+
+// Text file with one line per position of the OBJ: "occlusion r g b"
+bool write_baked_vertices(const std::string& path, const std::vector<BakedVertex>& baked) {
+    std::ofstream fout(path);
+    if (!fout)
+        return false;
+    fout << "# Baked lighting, one line per \"v\" line of the OBJ: occlusion r g b\n";
+    fout << "bake " << baked.size() << "\n";
+    for (auto &b : baked)
+        fout << b.m_occlusion << " " << b.m_light.x() << " " << b.m_light.y() << " " << b.m_light.z() << "\n";
+    fout.flush();
+    return bool(fout);
+}
+
+#endif
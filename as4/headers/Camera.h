@@ -23,6 +23,31 @@ public:
         return Ray(m_eye, direction);
     }
 
+    // Inverse of generate_ray: the (col, row) whose ray goes through p
+    // Returns false for points behind the camera
+    bool project(const Vector3D& p, float& col, float& row) const {
+        Vector3D d = p - m_eye;
+        float depth = -dot(d, m_w);
+        if (depth <= 0)
+            return false;
+        col = dot(d, m_u) / depth / m_ndc_width + 0.5;
+        row = dot(d, m_v) / depth / m_ndc_height + 0.5;
+        return true;
+    }
+
+    Vector3D eye() const {
+        return m_eye;
+    }
+
+    // Camera frame: u to the right, v up and w backwards, and the size of the image plane at distance 1
+    void basis(Vector3D& u, Vector3D& v, Vector3D& w, float& ndc_width, float& ndc_height) const {
+        u = m_u;
+        v = m_v;
+        w = m_w;
+        ndc_width = m_ndc_width;
+        ndc_height = m_ndc_height;
+    }
+
 private:
     Vector3D m_eye;
     float m_ndc_width, m_ndc_height;
@@ -0,0 +1,334 @@
+#ifndef COMPACTSCENE_H
+#define COMPACTSCENE_H
+
+#include <vector>
+#include <map>
+#include <tuple>
+#include <typeindex>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include "AABB.h"
+#include "Sphere.h"
+#include "Material.h"
+
+using namespace std;
+
+// Materials shared by value, so a scene of millions of primitives only needs
+// one 16 bit index per primitive
+class MaterialTable {
+public:
+    static const size_t max_size = 65536;
+
+    // Index of the material with the same type and colour, added if new
+    // Once the table holds max_size materials nothing more is added, a new material gets
+    // the entry of the same type with the nearest colour, or of any type if there is none
+    uint16_t add(shared_ptr<Material> material);
+    shared_ptr<Material>& operator[](uint16_t index) { return m_materials[index]; }
+    size_t size() const { return m_materials.size(); }
+    void clear();
+
+private:
+    vector<shared_ptr<Material>> m_materials;
+    map<tuple<type_index, float, float, float>, uint16_t> m_lookup;
+};
+
+
+// A sphere quantized relative to its cell, 10 bytes
+struct CompactSphere {
+    uint16_t m_x, m_y, m_z;
+    uint16_t m_radius;
+    uint16_t m_material;
+};
+
+
+// A cubic cell of the scene, its spheres are stored contiguously
+// Sphere centres lie inside the cell and radii are at most a quarter of the cell size
+struct CompactCell {
+    float m_origin[3];
+    float m_size;
+    uint32_t m_first;
+    uint32_t m_count;
+
+    Vector3D origin() const { return Vector3D(m_origin[0], m_origin[1], m_origin[2]); }
+
+    Vector3D center(const CompactSphere& s) const {
+        const float scale = m_size / 65535.0;
+        return origin() + scale * Vector3D(s.m_x, s.m_y, s.m_z);
+    }
+
+    float radius(const CompactSphere& s) const {
+        return s.m_radius * (0.25 * m_size / 65535.0);
+    }
+
+    // Cell expanded by the largest radius a sphere can have
+    AABB bounds() const {
+        float r = 0.25 * m_size;
+        return AABB(origin() - Vector3D(r, r, r), origin() + Vector3D(m_size + r, m_size + r, m_size + r));
+    }
+};
+
+
+// Node of the hierarchy over cells, stored depth first
+// Leaves have m_count > 0 cells starting at m_offset, inner nodes have their
+// left child right after them and their right child at m_offset
+struct CompactNode {
+    AABB m_bounds;
+    uint32_t m_offset;
+    uint32_t m_count;
+};
+
+
+// Sphere set for scenes of millions of primitives
+// Spheres cost 10 bytes each, plus about 3 bytes for their cell and 2 for the
+// hierarchy at the default 8 spheres per cell
+// Cells are sorted along a Morton curve, so halving the cell list already
+// gives a good hierarchy without any per-sphere sorting
+class CompactScene {
+public:
+    vector<CompactSphere> m_spheres;
+    vector<CompactCell> m_cells;
+    vector<CompactNode> m_nodes;
+    MaterialTable m_materials;
+
+    bool empty() const { return m_spheres.empty(); }
+    void clear();
+
+    // Fill the box [min, max] with about count random spheres
+    // Spheres are generated cell by cell straight into the compact arrays
+    void generate_particles(uint64_t count, Vector3D min, Vector3D max, int spheres_per_cell = 8);
+
+    HitResult hit(Ray& ray, float min_t, float max_t);
+
+    size_t memory_bytes() const;
+
+private:
+    static const uint32_t leaf_cells = 4;
+    uint32_t build_node(uint32_t first, uint32_t count);
+};
+
+
+uint16_t MaterialTable::add(shared_ptr<Material> material) {
+    auto key = make_tuple(type_index(typeid(*material)), material->m_color.x(), material->m_color.y(), material->m_color.z());
+    auto found = m_lookup.find(key);
+    if (found != m_lookup.end())
+        return found->second;
+
+    if (m_materials.size() >= max_size) {
+        size_t nearest = 0;
+        float nearest_distance = numeric_limits<float>::infinity();
+        bool nearest_same_type = false;
+        for (size_t i = 0; i < m_materials.size(); ++i) {
+            bool same_type = type_index(typeid(*m_materials[i])) == get<0>(key);
+            float distance = (m_materials[i]->m_color - material->m_color).length_squared();
+            if ((same_type && !nearest_same_type) || (same_type == nearest_same_type && distance < nearest_distance)) {
+                nearest = i;
+                nearest_distance = distance;
+                nearest_same_type = same_type;
+            }
+        }
+        // Later adds of the same material find it without another search
+        m_lookup[key] = static_cast<uint16_t>(nearest);
+        return static_cast<uint16_t>(nearest);
+    }
+    uint16_t index = static_cast<uint16_t>(m_materials.size());
+    m_materials.push_back(material);
+    m_lookup[key] = index;
+    return index;
+}
+
+void MaterialTable::clear() {
+    m_materials.clear();
+    m_lookup.clear();
+}
+
+
+void CompactScene::clear() {
+    m_spheres.clear();
+    m_cells.clear();
+    m_nodes.clear();
+    m_materials.clear();
+}
+
+size_t CompactScene::memory_bytes() const {
+    return m_spheres.size() * sizeof(CompactSphere) + m_cells.size() * sizeof(CompactCell) + m_nodes.size() * sizeof(CompactNode);
+}
+
+// Spread the lower 21 bits of x so there are two zero bits between each
+uint64_t morton_spread(uint64_t x) {
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8) & 0x100f00f00f00f00full;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+}
+
+uint64_t morton_code(uint32_t x, uint32_t y, uint32_t z) {
+    return morton_spread(x) | (morton_spread(y) << 1) | (morton_spread(z) << 2);
+}
+
+void CompactScene::generate_particles(uint64_t count, Vector3D min, Vector3D max, int spheres_per_cell) {
+    clear();
+
+    // Cubic cells sized so each holds about spheres_per_cell spheres
+    Vector3D extent = max - min;
+    float volume = extent.x() * extent.y() * extent.z();
+    float cell_size = cbrt(volume * spheres_per_cell / float(count));
+    uint32_t nx = std::max(1, int(ceil(extent.x() / cell_size)));
+    uint32_t ny = std::max(1, int(ceil(extent.y() / cell_size)));
+    uint32_t nz = std::max(1, int(ceil(extent.z() / cell_size)));
+
+    // Visit the cells along a Morton curve
+    vector<uint64_t> order;
+    order.reserve(uint64_t(nx) * ny * nz);
+    for (uint32_t z = 0; z < nz; ++z)
+        for (uint32_t y = 0; y < ny; ++y)
+            for (uint32_t x = 0; x < nx; ++x)
+                order.push_back(morton_code(x, y, z));
+    sort(order.begin(), order.end());
+
+    m_cells.reserve(order.size());
+    m_spheres.reserve(order.size() * spheres_per_cell);
+    // Material index of each quantized diffuse and specular colour, -1 until used
+    vector<int> palette(2 * 4096, -1);
+    for (uint64_t code : order) {
+        uint32_t x = 0, y = 0, z = 0;
+        for (int bit = 0; bit < 21; ++bit) {
+            x |= uint32_t((code >> (3 * bit)) & 1) << bit;
+            y |= uint32_t((code >> (3 * bit + 1)) & 1) << bit;
+            z |= uint32_t((code >> (3 * bit + 2)) & 1) << bit;
+        }
+
+        CompactCell cell;
+        cell.m_origin[0] = min.x() + x * cell_size;
+        cell.m_origin[1] = min.y() + y * cell_size;
+        cell.m_origin[2] = min.z() + z * cell_size;
+        cell.m_size = cell_size;
+        cell.m_first = static_cast<uint32_t>(m_spheres.size());
+        cell.m_count = spheres_per_cell;
+
+        for (int i = 0; i < spheres_per_cell; ++i) {
+            CompactSphere sphere;
+            sphere.m_x = random_int(0, 65535);
+            sphere.m_y = random_int(0, 65535);
+            sphere.m_z = random_int(0, 65535);
+            // Radii between a tenth and a quarter of the cell size
+            sphere.m_radius = random_int(26214, 65535);
+
+            // Colours are quantized to 16 levels so materials can be shared
+            bool isDiffuse = random_float() <= 0.6;
+            Vector3D color = isDiffuse ? Vector3D::random() * Vector3D::random() : Vector3D::random(0.5, 1);
+            // A channel of exactly 1 after rounding still falls in the top level
+            int r = std::min(15, int(color.x() * 16)), g = std::min(15, int(color.y() * 16)), b = std::min(15, int(color.z() * 16));
+            int& material = palette[(isDiffuse ? 0 : 4096) + (r * 16 + g) * 16 + b];
+            if (material < 0) {
+                color = Vector3D(r, g, b) / 16;
+                if (isDiffuse)
+                    material = m_materials.add(make_shared<Diffuse>(color));
+                else
+                    material = m_materials.add(make_shared<Specular>(color));
+            }
+            sphere.m_material = static_cast<uint16_t>(material);
+
+            m_spheres.push_back(sphere);
+        }
+        m_cells.push_back(cell);
+    }
+
+    m_nodes.reserve(2 * m_cells.size() / leaf_cells + 1);
+    build_node(0, static_cast<uint32_t>(m_cells.size()));
+}
+
+uint32_t CompactScene::build_node(uint32_t first, uint32_t count) {
+    uint32_t index = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back(CompactNode());
+
+    AABB bounds;
+    if (count <= leaf_cells) {
+        for (uint32_t i = first; i < first + count; ++i)
+            bounds.grow(m_cells[i].bounds());
+        m_nodes[index].m_offset = first;
+        m_nodes[index].m_count = count;
+    }
+    else {
+        // Halving a Morton sorted list splits space along the curve
+        uint32_t half = count / 2;
+        uint32_t left = build_node(first, half);
+        uint32_t right = build_node(first + half, count - half);
+        bounds.grow(m_nodes[left].m_bounds);
+        bounds.grow(m_nodes[right].m_bounds);
+        m_nodes[index].m_offset = right;
+        m_nodes[index].m_count = 0;
+    }
+    m_nodes[index].m_bounds = bounds;
+    return index;
+}
+
+HitResult CompactScene::hit(Ray& ray, float min_t, float max_t) {
+    HitResult hit_result;
+    if (m_nodes.empty())
+        return hit_result;
+
+    Vector3D origin = ray.origin();
+    Vector3D inv_dir = inverse_direction(ray);
+    const CompactCell* hit_cell = nullptr;
+    const CompactSphere* closest = nullptr;
+
+    uint32_t stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        uint32_t index = stack[--stack_size];
+        const CompactNode& node = m_nodes[index];
+        if (!node.m_bounds.hit(origin, inv_dir, min_t, max_t))
+            continue;
+
+        // Visit the nearer child first so later boxes are culled by the closest hit
+        if (node.m_count == 0) {
+            uint32_t left = index + 1, right = node.m_offset;
+            float t_left, t_right;
+            bool hit_left = m_nodes[left].m_bounds.hit(origin, inv_dir, min_t, max_t, t_left);
+            bool hit_right = m_nodes[right].m_bounds.hit(origin, inv_dir, min_t, max_t, t_right);
+            if (hit_left && hit_right) {
+                stack[stack_size++] = t_left < t_right ? right : left;
+                stack[stack_size++] = t_left < t_right ? left : right;
+            }
+            else if (hit_left)
+                stack[stack_size++] = left;
+            else if (hit_right)
+                stack[stack_size++] = right;
+            continue;
+        }
+
+        for (uint32_t c = node.m_offset; c < node.m_offset + node.m_count; ++c) {
+            const CompactCell& cell = m_cells[c];
+            if (!cell.bounds().hit(origin, inv_dir, min_t, max_t))
+                continue;
+            for (uint32_t s = cell.m_first; s < cell.m_first + cell.m_count; ++s) {
+                float t;
+                if (hit_sphere(ray, cell.center(m_spheres[s]), cell.radius(m_spheres[s]), min_t, max_t, t)) {
+                    // Shrink the range to find the closest hit
+                    max_t = t;
+                    hit_cell = &cell;
+                    closest = &m_spheres[s];
+                }
+            }
+        }
+    }
+
+    if (closest) {
+        Vector3D center = hit_cell->center(*closest);
+        float radius = hit_cell->radius(*closest);
+        hit_result.m_isHit = true;
+        hit_result.m_t = max_t;
+        hit_result.m_hitPos = ray.at(max_t);
+        hit_result.m_hitNormal = (hit_result.m_hitPos - center) / radius;
+        hit_result.m_hitMaterial = m_materials[closest->m_material];
+    }
+    return hit_result;
+}
+
+#endif
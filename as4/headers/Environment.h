@@ -0,0 +1,294 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "Vector3D.h"
+
+using namespace std;
+
+// Piecewise constant density over [0, 1) with n equal bins, sampled by inverting its CDF
+class Distribution1D {
+public:
+    vector<float> m_func;
+    // m_cdf[i] is the probability of the bins before i, m_cdf[n] = 1
+    vector<float> m_cdf;
+    float m_integral = 0;
+
+    void build(const float* func, int n);
+    int size() const { return static_cast<int>(m_func.size()); }
+
+    // Continuous sample in [0, 1), pdf is its density and bin the bin it falls in
+    float sample(float u, float& pdf, int& bin) const;
+    float pdf(int bin) const { return m_integral > 0 ? m_func[bin] / m_integral : 1; }
+};
+
+
+// Lat-long (equirectangular) environment seen by every ray that leaves the scene
+// Column u covers the azimuth atan2(z, x) over [0, 2 pi), row v the angle from
+// +y over [0, pi], so row 0 looks straight up
+// Directions can be drawn in proportion to the luminance of the map, which finds
+// small bright suns that uniform hemisphere sampling almost never hits
+class Environment {
+public:
+    int m_width = 0, m_height = 0;
+    // Linear radiance, row by row from the top
+    vector<Vector3D> m_pixels;
+
+    Environment() {}
+    Environment(int width, int height, const vector<Vector3D>& pixels);
+
+    // Read a Radiance .hdr (RGBE) file, returns false if it cannot be read
+    bool load_hdr(const string& path);
+
+    // Blue sky over a grey ground with a sun of sun_radiance, sun_angle degrees across
+    static Environment sky(Vector3D sun_direction, Vector3D sun_radiance, float sun_angle = 0.5,
+                           int width = 1024, int height = 512);
+
+    bool empty() const { return m_pixels.empty(); }
+    Vector3D radiance(const Vector3D& direction) const;
+
+    // Draw a direction with density proportional to the map's luminance
+    // pdf is per unit solid angle, and 0 if the map is black everywhere
+    Vector3D sample(float u1, float u2, float& pdf) const;
+    float pdf(const Vector3D& direction) const;
+
+private:
+    // Marginal density of the rows and the density of the columns within each row
+    Distribution1D m_rows;
+    vector<Distribution1D> m_columns;
+
+    void build_distribution();
+    int pixel_index(const Vector3D& direction, int& row) const;
+};
+
+
+// Multiple importance sampling weight of a sample drawn with density pdf_a
+// against a second strategy with density pdf_b (Veach's power heuristic)
+float power_heuristic(float pdf_a, float pdf_b) {
+    float a = pdf_a * pdf_a, b = pdf_b * pdf_b;
+    return a + b > 0 ? a / (a + b) : 0;
+}
+
+float luminance(const Vector3D& c) {
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
+
+void Distribution1D::build(const float* func, int n) {
+    m_func.assign(func, func + n);
+    m_cdf.resize(n + 1);
+    m_cdf[0] = 0;
+    for (int i = 0; i < n; ++i)
+        m_cdf[i + 1] = m_cdf[i] + m_func[i] / n;
+    m_integral = m_cdf[n];
+
+    // A black row is sampled uniformly, it is never picked by the rows anyway
+    for (int i = 1; i <= n; ++i)
+        m_cdf[i] = m_integral > 0 ? m_cdf[i] / m_integral : float(i) / n;
+}
+
+float Distribution1D::sample(float u, float& pdf, int& bin) const {
+    // Last bin whose cdf is <= u
+    bin = int(upper_bound(m_cdf.begin(), m_cdf.end(), u) - m_cdf.begin()) - 1;
+    bin = std::max(0, std::min(bin, size() - 1));
+    pdf = this->pdf(bin);
+
+    float du = u - m_cdf[bin];
+    float width = m_cdf[bin + 1] - m_cdf[bin];
+    if (width > 0)
+        du /= width;
+    return std::min((bin + du) / size(), 0.99999994f);
+}
+
+
+Environment::Environment(int width, int height, const vector<Vector3D>& pixels)
+    : m_width(width), m_height(height), m_pixels(pixels) {
+    build_distribution();
+}
+
+void Environment::build_distribution() {
+    // Each pixel is weighted by its solid angle, which shrinks with sin(theta) towards the poles
+    vector<float> func(m_width);
+    vector<float> row_integral(m_height);
+    m_columns.resize(m_height);
+    for (int y = 0; y < m_height; ++y) {
+        float sin_theta = sin(M_PI * (y + 0.5) / m_height);
+        for (int x = 0; x < m_width; ++x)
+            func[x] = fmax(luminance(m_pixels[size_t(y) * m_width + x]), 0) * sin_theta;
+        m_columns[y].build(func.data(), m_width);
+        row_integral[y] = m_columns[y].m_integral;
+    }
+    m_rows.build(row_integral.data(), m_height);
+}
+
+int Environment::pixel_index(const Vector3D& direction, int& row) const {
+    Vector3D d = normalize(direction);
+    float phi = atan2(d.z(), d.x());
+    if (phi < 0)
+        phi += 2 * M_PI;
+    float theta = acos(clamp(d.y(), -1, 1));
+    int x = std::min(int(phi / (2 * M_PI) * m_width), m_width - 1);
+    row = std::min(int(theta / M_PI * m_height), m_height - 1);
+    return row * m_width + x;
+}
+
+Vector3D Environment::radiance(const Vector3D& direction) const {
+    if (empty())
+        return Vector3D(0, 0, 0);
+    int row;
+    return m_pixels[pixel_index(direction, row)];
+}
+
+Vector3D Environment::sample(float u1, float u2, float& pdf) const {
+    pdf = 0;
+    if (empty() || m_rows.m_integral <= 0)
+        return Vector3D(0, 1, 0);
+
+    float row_pdf, column_pdf;
+    int row, column;
+    float v = m_rows.sample(u1, row_pdf, row);
+    float u = m_columns[row].sample(u2, column_pdf, column);
+
+    float theta = v * M_PI;
+    float phi = u * 2 * M_PI;
+    float sin_theta = sin(theta);
+    if (sin_theta <= 0)
+        return Vector3D(0, 1, 0);
+
+    // From density over the (u, v) square to density over solid angle
+    pdf = row_pdf * column_pdf / (2 * M_PI * M_PI * sin_theta);
+    return Vector3D(sin_theta * cos(phi), cos(theta), sin_theta * sin(phi));
+}
+
+float Environment::pdf(const Vector3D& direction) const {
+    if (empty() || m_rows.m_integral <= 0)
+        return 0;
+    int row;
+    int index = pixel_index(direction, row);
+    int column = index - row * m_width;
+    float y = normalize(direction).y();
+    float sin_theta = sqrt(fmax(0, 1 - y * y));
+    if (sin_theta <= 0)
+        return 0;
+    return m_rows.pdf(row) * m_columns[row].pdf(column) / (2 * M_PI * M_PI * sin_theta);
+}
+
+
+// Decode one run-length encoded scanline of a Radiance file into RGBE bytes
+bool read_hdr_scanline(istream& in, int width, vector<unsigned char>& rgbe) {
+    unsigned char head[4];
+    if (!in.read(reinterpret_cast<char*>(head), 4))
+        return false;
+
+    // Flat scanline, the four bytes read were the first pixel
+    bool rle = width >= 8 && width < 32768 && head[0] == 2 && head[1] == 2 && ((head[2] << 8) | head[3]) == width;
+    if (!rle) {
+        copy(head, head + 4, rgbe.begin());
+        return bool(in.read(reinterpret_cast<char*>(rgbe.data() + 4), 4 * (width - 1)));
+    }
+
+    // Each of the four channels is encoded separately as runs and literals
+    for (int c = 0; c < 4; ++c) {
+        int x = 0;
+        while (x < width) {
+            int count = in.get();
+            if (count == EOF)
+                return false;
+            if (count > 128) {
+                count -= 128;
+                int value = in.get();
+                if (value == EOF || x + count > width)
+                    return false;
+                for (int i = 0; i < count; ++i)
+                    rgbe[4 * x++ + c] = static_cast<unsigned char>(value);
+            }
+            else {
+                if (count == 0 || x + count > width)
+                    return false;
+                for (int i = 0; i < count; ++i) {
+                    int value = in.get();
+                    if (value == EOF)
+                        return false;
+                    rgbe[4 * x++ + c] = static_cast<unsigned char>(value);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool Environment::load_hdr(const string& path) {
+    ifstream in(path, ios::binary);
+    if (!in)
+        return false;
+
+    // Header lines up to an empty one, then the resolution
+    string line;
+    if (!getline(in, line) || line.rfind("#?", 0) != 0)
+        return false;
+    while (getline(in, line) && !line.empty()) {
+        if (line.rfind("FORMAT=", 0) == 0 && line != "FORMAT=32-bit_rle_rgbe")
+            return false;
+    }
+    // Only the usual top to bottom, left to right orientation
+    string y_axis, x_axis;
+    int width = 0, height = 0;
+    if (!getline(in, line))
+        return false;
+    istringstream resolution(line);
+    resolution >> y_axis >> height >> x_axis >> width;
+    if (y_axis != "-Y" || x_axis != "+X" || width <= 0 || height <= 0)
+        return false;
+
+    vector<Vector3D> pixels(size_t(width) * height);
+    vector<unsigned char> rgbe(4 * size_t(width));
+    for (int y = 0; y < height; ++y) {
+        if (!read_hdr_scanline(in, width, rgbe))
+            return false;
+        for (int x = 0; x < width; ++x) {
+            const unsigned char* p = &rgbe[4 * x];
+            if (p[3] == 0)
+                continue;
+            float scale = ldexp(1.0f, int(p[3]) - (128 + 8));
+            pixels[size_t(y) * width + x] = Vector3D((p[0] + 0.5f) * scale, (p[1] + 0.5f) * scale, (p[2] + 0.5f) * scale);
+        }
+    }
+
+    *this = Environment(width, height, pixels);
+    return true;
+}
+
+Environment Environment::sky(Vector3D sun_direction, Vector3D sun_radiance, float sun_angle, int width, int height) {
+    Vector3D sun = normalize(sun_direction);
+    float cos_sun = cos(0.5 * sun_angle * M_PI / 180.0);
+    // The sun covers at least the pixel it is centred in, however small it is
+    float sun_phi = atan2(sun.z(), sun.x());
+    if (sun_phi < 0)
+        sun_phi += 2 * M_PI;
+    int sun_x = std::min(int(sun_phi / (2 * M_PI) * width), width - 1);
+    int sun_y = std::min(int(acos(clamp(sun.y(), -1, 1)) / M_PI * height), height - 1);
+    vector<Vector3D> pixels(size_t(width) * height);
+    for (int y = 0; y < height; ++y) {
+        float theta = M_PI * (y + 0.5) / height;
+        for (int x = 0; x < width; ++x) {
+            float phi = 2 * M_PI * (x + 0.5) / width;
+            Vector3D d(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+            Vector3D color;
+            if (dot(d, sun) >= cos_sun || (x == sun_x && y == sun_y))
+                color = sun_radiance;
+            else if (d.y() >= 0)
+                color = (1 - d.y()) * Vector3D(1, 1, 1) + d.y() * Vector3D(0.5, 0.7, 1.0);
+            else
+                color = Vector3D(0.3, 0.3, 0.3);
+            pixels[size_t(y) * width + x] = color;
+        }
+    }
+    return Environment(width, height, pixels);
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "Ray.h"
+#include "Sphere.h"
+
+using namespace std;
+
+class Material;
+
+// First hits of a frame found without tracing, e.g. by a rasterizer
+// Every pixel is split into m_samples x m_samples sub-pixels, sub-pixel (x, y)
+// is seen through the camera at col = (x + 0.5) / (m_samples * (width - 1)) and
+// row = (y + 0.5) / (m_samples * (height - 1)), matching the pixels of Renderer
+// Rows are counted from the bottom, like the camera's rows
+class GBuffer {
+public:
+    int m_width = 0, m_height = 0;
+    int m_samples = 1;
+    // Per sub-pixel, row by row
+    vector<Vector3D> m_position;
+    vector<Vector3D> m_normal;
+    vector<float> m_distance;
+    // Index into m_materials, -1 where nothing is hit
+    vector<int32_t> m_material;
+    vector<shared_ptr<Material>> m_materials;
+
+    void resize(int width, int height, int samples) {
+        m_width = width;
+        m_height = height;
+        m_samples = samples;
+        size_t size = size_t(width) * height;
+        m_position.assign(size, Vector3D());
+        m_normal.assign(size, Vector3D());
+        m_distance.assign(size, 0);
+        m_material.assign(size, -1);
+    }
+
+    // The first hit at sub-pixel (x, y), returns false if it sees the background
+    bool hit(int x, int y, HitResult& hit) const {
+        size_t p = size_t(y) * m_width + x;
+        if (m_material[p] < 0)
+            return false;
+        hit.m_isHit = true;
+        hit.m_hitPos = m_position[p];
+        hit.m_hitNormal = m_normal[p];
+        hit.m_t = m_distance[p];
+        hit.m_hitMaterial = m_materials[m_material[p]];
+        return true;
+    }
+};
+
+#endif
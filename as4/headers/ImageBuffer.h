@@ -0,0 +1,116 @@
+#ifndef IMAGEBUFFER_H
+#define IMAGEBUFFER_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <fstream>
+
+#include "Renderer.h"
+
+// Binary ppm (P6) kept in memory, for images that are sent rather than saved
+// Tiles cover disjoint pixels, so they can be written from several threads at once
+class ImageBuffer : public TileSink {
+public:
+    ImageBuffer(int width, int height);
+
+    virtual void write_tile(const Tile& tile, const std::vector<Vector3D>& pixels) override;
+    // The whole file, header included
+    const std::vector<unsigned char>& ppm() const { return m_bytes; }
+
+private:
+    int m_width, m_height;
+    size_t m_headerSize;
+    std::vector<unsigned char> m_bytes;
+};
+
+
+// Linear radiance of every pixel, for comparing renders before they are quantized
+class RadianceBuffer : public TileSink {
+public:
+    int m_width, m_height;
+    // Row by row from the top
+    std::vector<Vector3D> m_pixels;
+
+    RadianceBuffer(int width, int height) : m_width(width), m_height(height), m_pixels(size_t(width) * height) {}
+
+    virtual void write_tile(const Tile& tile, const std::vector<Vector3D>& pixels) override;
+    // Save as a binary ppm
+    bool save_ppm(const std::string& path) const;
+    // Save or load the radiance itself as a little endian pfm, loading resizes the buffer
+    bool save_pfm(const std::string& path) const;
+    bool load_pfm(const std::string& path);
+};
+
+
+ImageBuffer::ImageBuffer(int width, int height) {
+    m_width = width;
+    m_height = height;
+    std::string header = "P6\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n";
+    m_headerSize = header.size();
+    m_bytes.resize(m_headerSize + size_t(width) * height * 3);
+    memcpy(m_bytes.data(), header.data(), m_headerSize);
+}
+
+void ImageBuffer::write_tile(const Tile& tile, const std::vector<Vector3D>& pixels) {
+    size_t row_bytes = size_t(m_width) * 3;
+    for (int y = tile.m_y0; y < tile.m_y1; ++y) {
+        unsigned char* row = m_bytes.data() + m_headerSize + y * row_bytes;
+        for (int x = tile.m_x0; x < tile.m_x1; ++x)
+            color_to_rgb(pixels[(y - tile.m_y0) * tile.width() + (x - tile.m_x0)], row + x * 3);
+    }
+}
+
+void RadianceBuffer::write_tile(const Tile& tile, const std::vector<Vector3D>& pixels) {
+    for (int y = tile.m_y0; y < tile.m_y1; ++y)
+        for (int x = tile.m_x0; x < tile.m_x1; ++x)
+            m_pixels[size_t(y) * m_width + x] = pixels[(y - tile.m_y0) * tile.width() + (x - tile.m_x0)];
+}
+
+bool RadianceBuffer::save_ppm(const std::string& path) const {
+    ImageBuffer image(m_width, m_height);
+    Tile all = {0, 0, m_width, m_height};
+    image.write_tile(all, m_pixels);
+    std::ofstream fout(path, std::ios::binary);
+    fout.write(reinterpret_cast<const char*>(image.ppm().data()), image.ppm().size());
+    return bool(fout);
+}
+
+bool RadianceBuffer::save_pfm(const std::string& path) const {
+    std::ofstream fout(path, std::ios::binary);
+    fout << "PF\n" << m_width << ' ' << m_height << "\n-1.0\n";
+    // pfm rows start at the bottom
+    std::vector<float> row(size_t(m_width) * 3);
+    for (int y = m_height - 1; y >= 0; --y) {
+        for (int x = 0; x < m_width; ++x)
+            for (int c = 0; c < 3; ++c)
+                row[size_t(x) * 3 + c] = component(m_pixels[size_t(y) * m_width + x], c);
+        fout.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+    }
+    return bool(fout);
+}
+
+bool RadianceBuffer::load_pfm(const std::string& path) {
+    std::ifstream fin(path, std::ios::binary);
+    std::string magic;
+    int width, height;
+    float scale;
+    if (!(fin >> magic >> width >> height >> scale) || magic != "PF" || width <= 0 || height <= 0 || scale >= 0)
+        return false;
+    fin.get();
+
+    std::vector<Vector3D> pixels(size_t(width) * height);
+    std::vector<float> row(size_t(width) * 3);
+    for (int y = height - 1; y >= 0; --y) {
+        if (!fin.read(reinterpret_cast<char*>(row.data()), row.size() * sizeof(float)))
+            return false;
+        for (int x = 0; x < width; ++x)
+            pixels[size_t(y) * width + x] = Vector3D(row[size_t(x) * 3], row[size_t(x) * 3 + 1], row[size_t(x) * 3 + 2]);
+    }
+    m_width = width;
+    m_height = height;
+    m_pixels = std::move(pixels);
+    return true;
+}
+
+#endif
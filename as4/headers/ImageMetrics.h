@@ -0,0 +1,244 @@
+#ifndef IMAGEMETRICS_H
+#define IMAGEMETRICS_H
+
+#include <vector>
+#include <cmath>
+
+#include "Vector3D.h"
+
+using namespace std;
+
+// Errors of an image against a reference of the same size, both in linear radiance
+// and compared as they are displayed, i.e. after the gamma and clamping of color_to_rgb
+struct ImageError {
+    double m_rmse = 0;
+    // In dB, for a peak of 1
+    double m_psnr = 0;
+    // Mean of the FLIP-style perceptual error, from 0 for identical images to 1
+    double m_flip = 0;
+};
+
+ImageError image_error(const vector<Vector3D>& image, const vector<Vector3D>& reference, int width, int height);
+
+
+// The value color_to_rgb shows on screen, in [0, 1]
+float display_value(float c) {
+    if (c != c)
+        return 0;
+    return clamp(sqrt(fmax(c, 0)), 0, 1);
+}
+
+double image_rmse(const vector<Vector3D>& image, const vector<Vector3D>& reference) {
+    double squared = 0;
+    for (size_t p = 0; p < reference.size(); ++p) {
+        for (int c = 0; c < 3; ++c) {
+            double d = display_value(component(image[p], c)) - display_value(component(reference[p], c));
+            squared += d * d;
+        }
+    }
+    return sqrt(squared / (3.0 * reference.size()));
+}
+
+double rmse_to_psnr(double rmse) {
+    return 20 * log10(1 / fmax(rmse, 1e-9));
+}
+
+
+// FLIP-style error, after Andersson et al., "FLIP: A Difference Evaluator for
+// Alternating Images", 2020, at 67 pixels per degree (a 0.7 m wide 4K screen
+// seen from 0.7 m). Colours are blurred the way the eye blurs them, compared in
+// a perceptual space and the error is raised where edges or points differ
+namespace flip {
+
+const float pixels_per_degree = 67.0f;
+
+// Sum of Gaussians normalized to 1, of standard deviations sigma0 and sigma1 pixels
+vector<float> gaussian_kernel(float a0, float sigma0, float a1, float sigma1) {
+    float sigma = fmax(sigma0, sigma1);
+    int radius = int(ceil(3 * sigma));
+    vector<float> kernel(2 * radius + 1);
+    float sum = 0;
+    for (int i = -radius; i <= radius; ++i) {
+        float k = a0 * exp(-i * i / (2 * sigma0 * sigma0)) / sigma0;
+        if (a1 > 0)
+            k += a1 * exp(-i * i / (2 * sigma1 * sigma1)) / sigma1;
+        kernel[i + radius] = k;
+        sum += k;
+    }
+    for (auto &k : kernel)
+        k /= sum;
+    return kernel;
+}
+
+// Filter one channel with kernel_x along rows then kernel_y along columns, clamping at the borders
+vector<float> convolve(const vector<float>& channel, int width, int height, const vector<float>& kernel_x, const vector<float>& kernel_y) {
+    vector<float> rows(channel.size()), result(channel.size());
+    int rx = int(kernel_x.size()) / 2, ry = int(kernel_y.size()) / 2;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            float sum = 0;
+            for (int i = -rx; i <= rx; ++i)
+                sum += kernel_x[i + rx] * channel[size_t(y) * width + min(max(x + i, 0), width - 1)];
+            rows[size_t(y) * width + x] = sum;
+        }
+    }
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            float sum = 0;
+            for (int i = -ry; i <= ry; ++i)
+                sum += kernel_y[i + ry] * rows[size_t(min(max(y + i, 0), height - 1)) * width + x];
+            result[size_t(y) * width + x] = sum;
+        }
+    }
+    return result;
+}
+
+Vector3D linear_rgb_to_xyz(const Vector3D& c) {
+    return Vector3D(0.4124f * c.x() + 0.3576f * c.y() + 0.1805f * c.z(),
+                    0.2126f * c.x() + 0.7152f * c.y() + 0.0722f * c.z(),
+                    0.0193f * c.x() + 0.1192f * c.y() + 0.9505f * c.z());
+}
+
+Vector3D xyz_to_linear_rgb(const Vector3D& c) {
+    return Vector3D( 3.2406f * c.x() - 1.5372f * c.y() - 0.4986f * c.z(),
+                    -0.9689f * c.x() + 1.8758f * c.y() + 0.0415f * c.z(),
+                     0.0557f * c.x() - 0.2040f * c.y() + 1.0570f * c.z());
+}
+
+// D65 white
+const Vector3D white(0.9505f, 1.0f, 1.0888f);
+
+Vector3D xyz_to_ycxcz(const Vector3D& c) {
+    float x = c.x() / white.x(), y = c.y() / white.y(), z = c.z() / white.z();
+    return Vector3D(116 * y - 16, 500 * (x - y), 200 * (y - z));
+}
+
+Vector3D ycxcz_to_xyz(const Vector3D& c) {
+    float y = (c.x() + 16) / 116;
+    return Vector3D((y + c.y() / 500) * white.x(), y * white.y(), (y - c.z() / 200) * white.z());
+}
+
+Vector3D xyz_to_lab(const Vector3D& c) {
+    auto f = [](float t) { return t > 0.008856f ? cbrt(t) : 7.787f * t + 16.0f / 116; };
+    float x = f(c.x() / white.x()), y = f(c.y() / white.y()), z = f(c.z() / white.z());
+    return Vector3D(116 * y - 16, 500 * (x - y), 200 * (y - z));
+}
+
+// L*a*b* with the chroma scaled by lightness (Hunt effect), compared with the HyAB distance
+Vector3D hunt_lab(const Vector3D& linear) {
+    Vector3D lab = xyz_to_lab(linear_rgb_to_xyz(linear));
+    return Vector3D(lab.x(), 0.01f * lab.x() * lab.y(), 0.01f * lab.x() * lab.z());
+}
+
+float hyab(const Vector3D& a, const Vector3D& b) {
+    float da = a.y() - b.y(), db = a.z() - b.z();
+    return fabs(a.x() - b.x()) + sqrt(da * da + db * db);
+}
+
+float srgb_to_linear(float c) {
+    return c <= 0.04045f ? c / 12.92f : pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+} // namespace flip
+
+// Per pixel FLIP-style error of the displayed images
+vector<float> flip_error_map(const vector<Vector3D>& image, const vector<Vector3D>& reference, int width, int height) {
+    using namespace flip;
+    size_t size = size_t(width) * height;
+
+    // Spatial filters of the contrast sensitivity of the achromatic and the two opponent
+    // channels, as Gaussians of sigma sqrt(b / 2) / pi degrees
+    auto sigma = [](float b) { return sqrt(b / 2) / float(M_PI) * pixels_per_degree; };
+    vector<float> csf[3] = {
+        gaussian_kernel(1, sigma(0.0047f), 0, 1),
+        gaussian_kernel(1, sigma(0.0053f), 0, 1),
+        gaussian_kernel(34.1f, sigma(0.04f), 13.5f, sigma(0.025f))
+    };
+
+    // Edge and point detectors, first and second derivatives of a Gaussian
+    float feature_sigma = 0.5f * 0.082f * pixels_per_degree;
+    int radius = int(ceil(3 * feature_sigma));
+    vector<float> smooth(2 * radius + 1), edge(2 * radius + 1), point(2 * radius + 1);
+    float smooth_sum = 0, edge_sum = 0, point_positive = 0, point_negative = 0;
+    for (int i = -radius; i <= radius; ++i) {
+        float g = exp(-i * i / (2 * feature_sigma * feature_sigma));
+        smooth[i + radius] = g;
+        edge[i + radius] = -i * g;
+        point[i + radius] = (i * i / (feature_sigma * feature_sigma) - 1) * g;
+        smooth_sum += g;
+        edge_sum += edge[i + radius] > 0 ? edge[i + radius] : 0;
+        (point[i + radius] > 0 ? point_positive : point_negative) += point[i + radius];
+    }
+    // The smoothing part sums to 1, the positive part of the edge detector too,
+    // and the point detector to 0
+    for (int i = 0; i <= 2 * radius; ++i) {
+        smooth[i] /= smooth_sum;
+        edge[i] /= edge_sum;
+        point[i] = point[i] > 0 ? point[i] / point_positive : -point[i] / point_negative;
+    }
+
+    vector<float> filtered[2][3], features[2][4];
+    const vector<Vector3D>* images[2] = {&image, &reference};
+    for (int k = 0; k < 2; ++k) {
+        vector<float> channels[3];
+        for (auto &channel : channels)
+            channel.resize(size);
+        vector<float> achromatic(size);
+        for (size_t p = 0; p < size; ++p) {
+            const Vector3D& c = (*images[k])[p];
+            Vector3D linear(flip::srgb_to_linear(display_value(c.x())), flip::srgb_to_linear(display_value(c.y())), flip::srgb_to_linear(display_value(c.z())));
+            Vector3D ycxcz = xyz_to_ycxcz(linear_rgb_to_xyz(linear));
+            for (int i = 0; i < 3; ++i)
+                channels[i][p] = component(ycxcz, i);
+            achromatic[p] = (ycxcz.x() + 16) / 116;
+        }
+        for (int i = 0; i < 3; ++i)
+            filtered[k][i] = convolve(channels[i], width, height, csf[i], csf[i]);
+        features[k][0] = convolve(achromatic, width, height, edge, smooth);
+        features[k][1] = convolve(achromatic, width, height, smooth, edge);
+        features[k][2] = convolve(achromatic, width, height, point, smooth);
+        features[k][3] = convolve(achromatic, width, height, smooth, point);
+    }
+
+    // Largest distance of the colour metric, between green and blue
+    const float cmax = pow(hyab(hunt_lab(Vector3D(0, 1, 0)), hunt_lab(Vector3D(0, 0, 1))), 0.7f);
+    const float pc = 0.4f, pt = 0.95f;
+
+    vector<float> error(size);
+    for (size_t p = 0; p < size; ++p) {
+        Vector3D lab[2];
+        float edge_magnitude[2], point_magnitude[2];
+        for (int k = 0; k < 2; ++k) {
+            Vector3D ycxcz(filtered[k][0][p], filtered[k][1][p], filtered[k][2][p]);
+            Vector3D linear = xyz_to_linear_rgb(ycxcz_to_xyz(ycxcz));
+            linear = Vector3D(clamp(linear.x(), 0, 1), clamp(linear.y(), 0, 1), clamp(linear.z(), 0, 1));
+            lab[k] = hunt_lab(linear);
+            edge_magnitude[k] = sqrt(features[k][0][p] * features[k][0][p] + features[k][1][p] * features[k][1][p]);
+            point_magnitude[k] = sqrt(features[k][2][p] * features[k][2][p] + features[k][3][p] * features[k][3][p]);
+        }
+
+        // Colour difference, compressed and remapped so small differences stay small
+        float colour = pow(hyab(lab[0], lab[1]), 0.7f);
+        colour = colour < pc * cmax ? pt / (pc * cmax) * colour : pt + (colour - pc * cmax) / (cmax - pc * cmax) * (1 - pt);
+        colour = fmin(colour, 1.0f);
+
+        float feature_difference = fmax(fabs(edge_magnitude[0] - edge_magnitude[1]), fabs(point_magnitude[0] - point_magnitude[1]));
+        float feature = pow(feature_difference / sqrt(2.0f), 0.5f);
+
+        error[p] = pow(colour, 1 - fmin(feature, 1.0f));
+    }
+    return error;
+}
+
+ImageError image_error(const vector<Vector3D>& image, const vector<Vector3D>& reference, int width, int height) {
+    ImageError result;
+    result.m_rmse = image_rmse(image, reference);
+    result.m_psnr = rmse_to_psnr(result.m_rmse);
+    double sum = 0;
+    for (float e : flip_error_map(image, reference, width, height))
+        sum += e;
+    result.m_flip = sum / reference.size();
+    return result;
+}
+
+#endif
@@ -0,0 +1,316 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <vector>
+#include <cstdint>
+#include <unordered_set>
+#include <functional>
+
+#include "Camera.h"
+#include "World.h"
+#include "Renderer.h"
+
+using namespace std;
+
+// Coarse grid of cells over the bounded part of a scene, cells numbered x first
+class TouchGrid {
+public:
+    AABB m_bounds;
+    int m_resolution = 0;
+
+    // Cover everything bounded in world, padded so nearby moves stay inside
+    void build(World& world, int resolution);
+    size_t cell_count() const { return size_t(m_resolution) * m_resolution * m_resolution; }
+    bool contains(const AABB& box) const;
+
+    // Call f(cell) for the cells overlapping box, which must be inside m_bounds
+    template<class F>
+    void for_each_cell(const AABB& box, F f) const;
+    // Call f(cell) for the cells the ray crosses over [min_t, max_t]
+    template<class F>
+    void for_each_cell(const Ray& ray, float min_t, float max_t, F f) const;
+
+private:
+    float m_cellSize[3];
+    int cell_coordinate(float p, int axis) const;
+};
+
+
+// What the rays of one tile went near: the cells they crossed up to their hits
+// and the materials of those hits
+class TileTouches : public HitObserver {
+public:
+    vector<uint64_t> m_cells;
+    unordered_set<const Material*> m_materials;
+
+    void reset(const TouchGrid& grid);
+    virtual void observe(const Ray& ray, float min_t, float max_t, const HitResult& hit) override;
+    bool touches_cell(size_t cell) const { return (m_cells[cell / 64] >> (cell % 64)) & 1; }
+    bool touches_material(const Material* material) const { return m_materials.count(material) > 0; }
+
+private:
+    const TouchGrid* m_grid = nullptr;
+    const Material* m_lastMaterial = nullptr;
+};
+
+
+// Renderer that keeps its last image and traces again only the tiles an edit can change
+// Every tile remembers the cells of a coarse grid its rays crossed and the materials they
+// hit. Moving a primitive changes the tiles whose rays crossed its old or new bounds, changing
+// a material the tiles that hit it; every other tile is carried over from the last render.
+// Tiles are seeded by their index, so the result is the same as a full render of the edited scene
+// The irradiance cache is not used, as its records would carry light between tiles unseen
+class IncrementalRenderer : public TileSink {
+public:
+    IncrementalRenderer(World& world, Camera& camera, const RenderSettings& settings, int grid_resolution = 32);
+
+    // Trace the tiles changed since the last call, the first call traces all of them,
+    // then write every tile to sink. Returns the number of tiles traced
+    int render(TileSink& sink, std::function<void(int done, int total)> progress = nullptr);
+
+    // A primitive was moved or resized from before to after
+    // Edit the world and refit or rebuild its hierarchies as usual, in either order
+    void geometry_changed(const AABB& before, const AABB& after);
+    // A primitive was added or removed
+    void geometry_changed(const AABB& bounds);
+    // The colour or kind of material changed, everything using it is traced again
+    void material_changed(const Material* material);
+    // Trace everything, e.g. after the camera or the environment changes
+    void invalidate() { m_all = true; }
+
+    int tile_count() const { return m_renderer.tile_count(); }
+    int dirty_tile_count() const;
+
+    virtual void write_tile(const Tile& tile, const std::vector<Vector3D>& pixels) override;
+
+private:
+    World& m_world;
+    RenderSettings m_settings;
+    Renderer m_renderer;
+    int m_gridResolution;
+    TouchGrid m_grid;
+    vector<TileTouches> m_touches;
+    vector<char> m_dirty;
+    bool m_all = true;
+    // Last image, row by row from the top
+    vector<Vector3D> m_pixels;
+
+    static RenderSettings without_cache(RenderSettings settings);
+};
+
+
+void TouchGrid::build(World& world, int resolution) {
+    m_resolution = resolution;
+    AABB bounds;
+    if (!world.m_bvh.empty())
+        bounds.grow(world.m_bvh.m_nodes[0].m_bounds);
+    if (!world.m_shapeBvh.empty())
+        bounds.grow(world.m_shapeBvh.m_nodes[0].m_bounds);
+    for (auto &mesh : world.m_meshes)
+        if (!mesh->m_bvh.empty())
+            bounds.grow(mesh->m_bvh.m_nodes[0].m_bounds);
+    if (!world.m_compact.m_nodes.empty())
+        bounds.grow(world.m_compact.m_nodes[0].m_bounds);
+    if (bounds.m_min.x() > bounds.m_max.x())
+        bounds = AABB(Vector3D(-1, -1, -1), Vector3D(1, 1, 1));
+
+    // A quarter of the size on every side, and never flat
+    Vector3D size = bounds.m_max - bounds.m_min;
+    float largest = fmax(size.x(), fmax(size.y(), size.z()));
+    Vector3D pad = 0.25 * size + Vector3D(0.05, 0.05, 0.05) * largest + Vector3D(1e-3, 1e-3, 1e-3);
+    m_bounds = AABB(bounds.m_min - pad, bounds.m_max + pad);
+    size = m_bounds.m_max - m_bounds.m_min;
+    m_cellSize[0] = size.x() / resolution;
+    m_cellSize[1] = size.y() / resolution;
+    m_cellSize[2] = size.z() / resolution;
+}
+
+bool TouchGrid::contains(const AABB& box) const {
+    return box.m_min.x() >= m_bounds.m_min.x() && box.m_min.y() >= m_bounds.m_min.y() && box.m_min.z() >= m_bounds.m_min.z() &&
+           box.m_max.x() <= m_bounds.m_max.x() && box.m_max.y() <= m_bounds.m_max.y() && box.m_max.z() <= m_bounds.m_max.z();
+}
+
+int TouchGrid::cell_coordinate(float p, int axis) const {
+    float min = axis == 0 ? m_bounds.m_min.x() : axis == 1 ? m_bounds.m_min.y() : m_bounds.m_min.z();
+    int c = int(floor((p - min) / m_cellSize[axis]));
+    return std::max(0, std::min(m_resolution - 1, c));
+}
+
+template<class F>
+void TouchGrid::for_each_cell(const AABB& box, F f) const {
+    int x0 = cell_coordinate(box.m_min.x(), 0), x1 = cell_coordinate(box.m_max.x(), 0);
+    int y0 = cell_coordinate(box.m_min.y(), 1), y1 = cell_coordinate(box.m_max.y(), 1);
+    int z0 = cell_coordinate(box.m_min.z(), 2), z1 = cell_coordinate(box.m_max.z(), 2);
+    for (int z = z0; z <= z1; ++z)
+        for (int y = y0; y <= y1; ++y)
+            for (int x = x0; x <= x1; ++x)
+                f((size_t(z) * m_resolution + y) * m_resolution + x);
+}
+
+// Cell by cell along the ray, as in Amanatides and Woo, "A fast voxel traversal
+// algorithm for ray tracing", 1987
+template<class F>
+void TouchGrid::for_each_cell(const Ray& ray, float min_t, float max_t, F f) const {
+    float origin[3] = {ray.m_origin.x(), ray.m_origin.y(), ray.m_origin.z()};
+    float dir[3] = {ray.m_direction.x(), ray.m_direction.y(), ray.m_direction.z()};
+    float lo[3] = {m_bounds.m_min.x(), m_bounds.m_min.y(), m_bounds.m_min.z()};
+    float hi[3] = {m_bounds.m_max.x(), m_bounds.m_max.y(), m_bounds.m_max.z()};
+
+    // Keep the part of the ray inside the grid
+    for (int a = 0; a < 3; ++a) {
+        if (dir[a] == 0) {
+            if (origin[a] < lo[a] || origin[a] > hi[a])
+                return;
+            continue;
+        }
+        float t0 = (lo[a] - origin[a]) / dir[a];
+        float t1 = (hi[a] - origin[a]) / dir[a];
+        min_t = std::max(min_t, std::min(t0, t1));
+        max_t = std::min(max_t, std::max(t0, t1));
+    }
+    if (!(min_t <= max_t))
+        return;
+
+    int cell[3], step[3];
+    float next_t[3], delta_t[3];
+    for (int a = 0; a < 3; ++a) {
+        cell[a] = cell_coordinate(origin[a] + min_t * dir[a], a);
+        if (dir[a] > 0) {
+            step[a] = 1;
+            next_t[a] = (lo[a] + (cell[a] + 1) * m_cellSize[a] - origin[a]) / dir[a];
+            delta_t[a] = m_cellSize[a] / dir[a];
+        }
+        else if (dir[a] < 0) {
+            step[a] = -1;
+            next_t[a] = (lo[a] + cell[a] * m_cellSize[a] - origin[a]) / dir[a];
+            delta_t[a] = -m_cellSize[a] / dir[a];
+        }
+        else {
+            step[a] = 0;
+            next_t[a] = std::numeric_limits<float>::infinity();
+            delta_t[a] = 0;
+        }
+    }
+
+    while (true) {
+        f((size_t(cell[2]) * m_resolution + cell[1]) * m_resolution + cell[0]);
+        int a = next_t[0] < next_t[1] ? (next_t[0] < next_t[2] ? 0 : 2) : (next_t[1] < next_t[2] ? 1 : 2);
+        if (next_t[a] > max_t)
+            break;
+        cell[a] += step[a];
+        if (cell[a] < 0 || cell[a] >= m_resolution)
+            break;
+        next_t[a] += delta_t[a];
+    }
+}
+
+
+void TileTouches::reset(const TouchGrid& grid) {
+    m_grid = &grid;
+    m_cells.assign((grid.cell_count() + 63) / 64, 0);
+    m_materials.clear();
+    m_lastMaterial = nullptr;
+}
+
+void TileTouches::observe(const Ray& ray, float min_t, float max_t, const HitResult& hit) {
+    m_grid->for_each_cell(ray, min_t, max_t, [&](size_t cell) {
+        m_cells[cell / 64] |= uint64_t(1) << (cell % 64);
+    });
+    // Paths mostly hit the same material again, which saves most lookups
+    const Material* material = hit.m_isHit ? hit.m_hitMaterial.get() : nullptr;
+    if (material && material != m_lastMaterial) {
+        m_materials.insert(material);
+        m_lastMaterial = material;
+    }
+}
+
+
+RenderSettings IncrementalRenderer::without_cache(RenderSettings settings) {
+    settings.m_useIrradianceCache = false;
+    return settings;
+}
+
+IncrementalRenderer::IncrementalRenderer(World& world, Camera& camera, const RenderSettings& settings, int grid_resolution)
+    : m_world(world), m_settings(without_cache(settings)), m_renderer(world, camera, m_settings), m_gridResolution(grid_resolution) {
+    m_touches.resize(m_renderer.tile_count());
+    m_dirty.assign(m_renderer.tile_count(), 0);
+    m_pixels.resize(size_t(settings.m_width) * settings.m_height);
+    m_renderer.set_tile_observer([this](int index) -> HitObserver* { return &m_touches[index]; });
+}
+
+int IncrementalRenderer::render(TileSink& sink, std::function<void(int done, int total)> progress) {
+    if (m_all) {
+        // The scene may have grown, so the grid is fitted again
+        m_grid.build(m_world, m_gridResolution);
+        m_dirty.assign(m_dirty.size(), 1);
+        m_all = false;
+    }
+    std::vector<int> indices;
+    for (int i = 0; i < tile_count(); ++i) {
+        if (m_dirty[i]) {
+            indices.push_back(i);
+            m_touches[i].reset(m_grid);
+            m_dirty[i] = 0;
+        }
+    }
+    m_renderer.render_tiles(indices, *this, progress);
+
+    // Every tile goes out, the ones not traced as they were
+    for (int i = 0; i < tile_count(); ++i) {
+        Tile t = m_renderer.tile(i);
+        std::vector<Vector3D> pixels(t.width() * t.height());
+        for (int y = t.m_y0; y < t.m_y1; ++y)
+            for (int x = t.m_x0; x < t.m_x1; ++x)
+                pixels[(y - t.m_y0) * t.width() + (x - t.m_x0)] = m_pixels[size_t(y) * m_settings.m_width + x];
+        sink.write_tile(t, pixels);
+    }
+    return static_cast<int>(indices.size());
+}
+
+void IncrementalRenderer::write_tile(const Tile& tile, const std::vector<Vector3D>& pixels) {
+    for (int y = tile.m_y0; y < tile.m_y1; ++y)
+        for (int x = tile.m_x0; x < tile.m_x1; ++x)
+            m_pixels[size_t(y) * m_settings.m_width + x] = pixels[(y - tile.m_y0) * tile.width() + (x - tile.m_x0)];
+}
+
+void IncrementalRenderer::geometry_changed(const AABB& before, const AABB& after) {
+    geometry_changed(before);
+    geometry_changed(after);
+}
+
+void IncrementalRenderer::geometry_changed(const AABB& bounds) {
+    if (m_all)
+        return;
+    // Nothing was recorded outside the grid, e.g. for the floor plane
+    if (!m_grid.contains(bounds)) {
+        m_all = true;
+        return;
+    }
+    // Rays that graze the box on a cell face count as crossing it
+    Vector3D margin = 1e-3 * (m_grid.m_bounds.m_max - m_grid.m_bounds.m_min) / float(m_grid.m_resolution);
+    AABB box(bounds.m_min - margin, bounds.m_max + margin);
+    m_grid.for_each_cell(box, [&](size_t cell) {
+        for (int i = 0; i < tile_count(); ++i)
+            if (!m_dirty[i] && m_touches[i].touches_cell(cell))
+                m_dirty[i] = 1;
+    });
+}
+
+void IncrementalRenderer::material_changed(const Material* material) {
+    if (m_all)
+        return;
+    for (int i = 0; i < tile_count(); ++i)
+        if (m_touches[i].touches_material(material))
+            m_dirty[i] = 1;
+}
+
+int IncrementalRenderer::dirty_tile_count() const {
+    if (m_all)
+        return tile_count();
+    int count = 0;
+    for (char dirty : m_dirty)
+        count += dirty;
+    return count;
+}
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef IRRADIANCECACHE_H
+#define IRRADIANCECACHE_H
+
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include "Vector3D.h"
+
+// One sparse sample of the indirect light arriving at a diffuse surface
+// m_irradiance is the hemisphere average of incoming radiance, which is what
+// Diffuse::reflect estimates with one uniformly chosen direction
+class IrradianceRecord {
+public:
+    Vector3D m_pos;
+    Vector3D m_normal;
+    Vector3D m_irradiance;
+    // Harmonic mean distance to the surrounding geometry (clamped)
+    float m_radius;
+    // Rotational and translational gradients, one vector per colour channel
+    Vector3D m_rotGrad[3];
+    Vector3D m_transGrad[3];
+};
+
+
+// Irradiance cache (Ward et al. 1988) with gradients (Ward and Heckbert 1992)
+// Records are filled lazily and kept in a hash grid; every record is stored in
+// each cell its area of influence overlaps, so a lookup only visits one cell
+// Lookups take a shared lock and inserts an exclusive one, so both are safe
+// to call from several render threads at once
+class IrradianceCache {
+public:
+    // accuracy is Ward's a: the larger, the further records are reused
+    IrradianceCache(float accuracy = 0.3, float min_radius = 0.1, float max_radius = 3.0,
+                    int theta_strata = 8, int phi_strata = 24);
+
+    // Interpolate the cached irradiance at pos, returns false if no record is close enough
+    bool lookup(const Vector3D& pos, const Vector3D& normal, Vector3D& irradiance);
+    void insert(const IrradianceRecord& record);
+
+    // Direction of the stratified hemisphere sample (j, k), j along theta and k along phi
+    Vector3D sample_direction(const Vector3D& normal, int j, int k);
+    // Build a record from the radiance and hit distance of every sample_direction
+    // Samples are laid out as [j * phi_strata + k], a miss has an infinite distance
+    IrradianceRecord make_record(const Vector3D& pos, const Vector3D& normal,
+                                 const std::vector<Vector3D>& radiance, const std::vector<float>& distance);
+
+    int theta_strata() const { return m_thetaStrata; }
+    int phi_strata() const { return m_phiStrata; }
+    size_t record_count();
+    long lookup_count() const { return m_lookups; }
+    long hit_count() const { return m_hits; }
+
+private:
+    float m_accuracy;
+    float m_minRadius, m_maxRadius;
+    int m_thetaStrata, m_phiStrata;
+    float m_cellSize;
+
+    std::shared_mutex m_mutex;
+    std::vector<IrradianceRecord> m_records;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> m_cells;
+
+    std::atomic<long> m_lookups;
+    std::atomic<long> m_hits;
+
+    int cell_coord(float x) const { return static_cast<int>(floor(x / m_cellSize)); }
+    static uint64_t cell_key(int x, int y, int z);
+};
+
+
+// Orthonormal basis (t, b, n) around a normal
+void tangent_frame(const Vector3D& n, Vector3D& t, Vector3D& b) {
+    Vector3D a = fabs(n.x()) > 0.9 ? Vector3D(0, 1, 0) : Vector3D(1, 0, 0);
+    t = normalize(cross(a, n));
+    b = cross(n, t);
+}
+
+
+IrradianceCache::IrradianceCache(float accuracy, float min_radius, float max_radius, int theta_strata, int phi_strata) {
+    m_accuracy = accuracy;
+    m_minRadius = min_radius;
+    m_maxRadius = max_radius;
+    m_thetaStrata = theta_strata;
+    m_phiStrata = phi_strata;
+    // A record influences points within accuracy * radius, so with this cell size
+    // a record touches at most 3 cells along each axis
+    m_cellSize = accuracy * max_radius;
+    m_lookups = 0;
+    m_hits = 0;
+}
+
+uint64_t IrradianceCache::cell_key(int x, int y, int z) {
+    // 21 bits per axis, offset so negative coordinates stay positive
+    const uint64_t mask = (1u << 21) - 1;
+    return ((uint64_t(x + (1 << 20)) & mask) << 42) | ((uint64_t(y + (1 << 20)) & mask) << 21) | (uint64_t(z + (1 << 20)) & mask);
+}
+
+size_t IrradianceCache::record_count() {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_records.size();
+}
+
+bool IrradianceCache::lookup(const Vector3D& pos, const Vector3D& normal, Vector3D& irradiance) {
+    m_lookups++;
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    auto cell = m_cells.find(cell_key(cell_coord(pos.x()), cell_coord(pos.y()), cell_coord(pos.z())));
+    if (cell == m_cells.end())
+        return false;
+
+    float weight_sum = 0;
+    Vector3D sum(0, 0, 0);
+    for (uint32_t index : cell->second) {
+        const IrradianceRecord& record = m_records[index];
+        Vector3D offset = pos - record.m_pos;
+
+        // Skip records in front of the point, they see different light
+        if (dot(offset, record.m_normal + normal) < -0.02)
+            continue;
+
+        // Ward's weight, the record is usable when the weight exceeds 1 / a
+        float n_dot = clamp(dot(normal, record.m_normal), -1, 1);
+        float error = offset.length() / record.m_radius + sqrt(1 - n_dot);
+        if (error >= m_accuracy)
+            continue;
+        float weight = 1 / fmax(error, 1e-4);
+
+        // First order extrapolation of the record with its gradients
+        Vector3D rotation = cross(record.m_normal, normal);
+        float value[3];
+        for (int c = 0; c < 3; c++) {
+            value[c] = component(record.m_irradiance, c) + dot(record.m_rotGrad[c], rotation) + dot(record.m_transGrad[c], offset);
+            value[c] = fmax(value[c], 0);
+        }
+        sum += weight * Vector3D(value[0], value[1], value[2]);
+        weight_sum += weight;
+    }
+
+    if (weight_sum <= 0)
+        return false;
+
+    irradiance = sum / weight_sum;
+    m_hits++;
+    return true;
+}
+
+void IrradianceCache::insert(const IrradianceRecord& record) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    uint32_t index = static_cast<uint32_t>(m_records.size());
+    m_records.push_back(record);
+
+    // Add the record to every cell overlapping its area of influence
+    float reach = m_accuracy * record.m_radius;
+    int x0 = cell_coord(record.m_pos.x() - reach), x1 = cell_coord(record.m_pos.x() + reach);
+    int y0 = cell_coord(record.m_pos.y() - reach), y1 = cell_coord(record.m_pos.y() + reach);
+    int z0 = cell_coord(record.m_pos.z() - reach), z1 = cell_coord(record.m_pos.z() + reach);
+    for (int x = x0; x <= x1; x++)
+        for (int y = y0; y <= y1; y++)
+            for (int z = z0; z <= z1; z++)
+                m_cells[cell_key(x, y, z)].push_back(index);
+}
+
+Vector3D IrradianceCache::sample_direction(const Vector3D& normal, int j, int k) {
+    Vector3D t, b;
+    tangent_frame(normal, t, b);
+
+    // Uniform in solid angle: cos(theta) is uniform in [0, 1]
+    float cos_theta = 1 - (j + random_float()) / m_thetaStrata;
+    float sin_theta = sqrt(fmax(0, 1 - cos_theta * cos_theta));
+    float phi = 2 * M_PI * (k + random_float()) / m_phiStrata;
+    return normalize(sin_theta * (cos(phi) * t + sin(phi) * b) + cos_theta * normal);
+}
+
+IrradianceRecord IrradianceCache::make_record(const Vector3D& pos, const Vector3D& normal,
+                                              const std::vector<Vector3D>& radiance, const std::vector<float>& distance) {
+    const int M = m_thetaStrata, N = m_phiStrata;
+    IrradianceRecord record;
+    record.m_pos = pos;
+    record.m_normal = normal;
+
+    Vector3D t, b;
+    tangent_frame(normal, t, b);
+
+    // Average radiance and harmonic mean distance
+    Vector3D sum(0, 0, 0);
+    float inv_distance_sum = 0;
+    for (int s = 0; s < M * N; s++) {
+        sum += radiance[s];
+        inv_distance_sum += 1 / distance[s];
+    }
+    record.m_irradiance = sum / float(M * N);
+    float radius = inv_distance_sum > 0 ? M * N / inv_distance_sum : m_maxRadius;
+    record.m_radius = clamp(radius, m_minRadius, m_maxRadius);
+
+    // Gradients, following Ward and Heckbert with the strata weighted uniformly
+    // in solid angle instead of by cosine
+    for (int c = 0; c < 3; c++) {
+        Vector3D rot_grad(0, 0, 0);
+        Vector3D trans_grad(0, 0, 0);
+
+        for (int k = 0; k < N; k++) {
+            float phi = 2 * M_PI * (k + 0.5) / N;
+            float phi_edge = 2 * M_PI * k / N;
+            // Centre of column k, and the direction across the edge shared with column k - 1
+            Vector3D u_k = cos(phi) * t + sin(phi) * b;
+            Vector3D v_k = -sin(phi_edge) * t + cos(phi_edge) * b;
+            int k_prev = (k + N - 1) % N;
+
+            // Rotating the normal moves the horizon across the last theta stratum
+            rot_grad += component(radiance[(M - 1) * N + k], c) / N * cross(normal, u_k);
+
+            float across_theta = 0;
+            float across_phi = 0;
+            for (int j = 0; j < M; j++) {
+                float theta_lo = acos(1 - float(j) / M);
+                float theta_hi = acos(1 - float(j + 1) / M);
+                float L = component(radiance[j * N + k], c);
+
+                // Edge between theta strata j - 1 and j
+                if (j > 0) {
+                    float r = fmin(distance[j * N + k], distance[(j - 1) * N + k]);
+                    across_theta += sin(theta_lo) * cos(theta_lo) * (L - component(radiance[(j - 1) * N + k], c)) / r;
+                }
+                // Edge between phi strata k - 1 and k
+                float r = fmin(distance[j * N + k], distance[j * N + k_prev]);
+                across_phi += (theta_hi - theta_lo) * (L - component(radiance[j * N + k_prev], c)) / r;
+            }
+            trans_grad += (across_theta / N) * u_k + (across_phi / (2 * M_PI)) * v_k;
+        }
+
+        record.m_rotGrad[c] = rot_grad;
+        record.m_transGrad[c] = trans_grad;
+    }
+
+    return record;
+}
+
+#endif
@@ -0,0 +1,349 @@
+#ifndef LBVH_H
+#define LBVH_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+
+#include "BVH.h"
+
+using namespace std;
+
+// Linear BVH builder for primitives that move every frame, e.g. a blendshape face
+// Primitives are sorted along a Morton curve through their centres with a parallel
+// radix sort, the tree is split where the codes first differ and the bounds are
+// fitted bottom up. The tree is slower to trace than BVH::build's but takes a fraction
+// of the time to build, and it has the same layout, so BVH::traverse and refit work on it
+// The worker threads and the scratch memory are kept between builds
+class LBVHBuilder {
+public:
+    // 0 uses every hardware thread
+    LBVHBuilder(int num_threads = 0);
+    ~LBVHBuilder();
+
+    void build(const vector<AABB>& bounds, BVH& bvh);
+
+private:
+    static const uint32_t leaf_size = 4;
+    static const int radix_bits = 10;
+    static const uint32_t radix = 1u << radix_bits;
+    // Fewer primitives than this per thread are not worth waking a thread for
+    static const size_t grain = 2048;
+
+    // Top of the tree, down to the subtrees that are built in parallel
+    struct TopNode {
+        uint32_t m_first, m_count;
+        int m_left = -1, m_right = -1;
+        int m_subtree = -1;
+    };
+    struct Subtree {
+        uint32_t m_first, m_count;
+        // Offsets relative to the subtree until they are copied into the BVH
+        vector<BVHNode> m_nodes;
+        uint32_t m_base;
+    };
+
+    int m_numThreads;
+    vector<thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_start, m_done;
+    const function<void(int)>* m_task = nullptr;
+    int m_taskThreads = 0;
+    int m_pending = 0;
+    uint64_t m_generation = 0;
+    bool m_stop = false;
+
+    vector<uint32_t> m_codes, m_codesTemp, m_indicesTemp;
+    vector<uint32_t> m_histograms;
+    vector<AABB> m_threadBounds;
+    vector<TopNode> m_top;
+    // Only the first m_subtreeCount are used, the rest keep their memory for later builds
+    vector<Subtree> m_subtrees;
+    size_t m_subtreeCount = 0;
+    vector<uint32_t> m_topOrder;
+
+    // Run task(thread) on threads threads, the calling thread being thread 0
+    void run(int threads, const function<void(int thread)>& task);
+    void worker(int thread);
+    int threads_for(size_t count) const;
+
+    uint32_t split(uint32_t first, uint32_t count) const;
+    int build_top(uint32_t first, uint32_t count, uint32_t subtree_size);
+    void build_subtree(vector<BVHNode>& nodes, uint32_t first, uint32_t count);
+    uint32_t assemble(int top, BVH& bvh);
+};
+
+
+// Spread the lowest 10 bits of v over every third bit
+uint32_t expand_bits(uint32_t v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// 30 bit Morton code of a point with coordinates in [0, 1]
+uint32_t morton_code(float x, float y, float z) {
+    auto quantize = [](float c) { return static_cast<uint32_t>(clamp(c * 1024, 0, 1023)); };
+    return (expand_bits(quantize(x)) << 2) | (expand_bits(quantize(y)) << 1) | expand_bits(quantize(z));
+}
+
+
+LBVHBuilder::LBVHBuilder(int num_threads) {
+    m_numThreads = num_threads > 0 ? num_threads : max(1u, thread::hardware_concurrency());
+    for (int t = 1; t < m_numThreads; ++t)
+        m_workers.emplace_back(&LBVHBuilder::worker, this, t);
+}
+
+LBVHBuilder::~LBVHBuilder() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for (auto &worker : m_workers)
+        worker.join();
+}
+
+void LBVHBuilder::run(int threads, const function<void(int thread)>& task) {
+    if (threads <= 1) {
+        task(0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_taskThreads = threads;
+        m_pending = threads - 1;
+        ++m_generation;
+    }
+    m_start.notify_all();
+    task(0);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&]() { return m_pending == 0; });
+}
+
+void LBVHBuilder::worker(int thread) {
+    uint64_t seen = 0;
+    while (true) {
+        const function<void(int)>* task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start.wait(lock, [&]() { return m_stop || m_generation != seen; });
+            if (m_stop)
+                return;
+            seen = m_generation;
+            if (thread >= m_taskThreads)
+                continue;
+            task = m_task;
+        }
+        (*task)(thread);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_pending == 0)
+            m_done.notify_one();
+    }
+}
+
+int LBVHBuilder::threads_for(size_t count) const {
+    return static_cast<int>(max<size_t>(1, min<size_t>(m_numThreads, count / grain)));
+}
+
+// First primitive of the right child of a node over sorted codes, where the
+// highest differing bit of the codes flips, or the middle for equal codes
+uint32_t LBVHBuilder::split(uint32_t first, uint32_t count) const {
+    uint32_t last = first + count - 1;
+    uint32_t difference = m_codes[first] ^ m_codes[last];
+    if (difference == 0)
+        return first + count / 2;
+    uint32_t bit = 1u << 31;
+    while (!(difference & bit))
+        bit >>= 1;
+
+    // Codes share every bit above, so they are sorted by this one
+    uint32_t lo = first + 1, hi = last;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (m_codes[mid] & bit)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+int LBVHBuilder::build_top(uint32_t first, uint32_t count, uint32_t subtree_size) {
+    int index = static_cast<int>(m_top.size());
+    m_top.push_back(TopNode());
+    m_top[index].m_first = first;
+    m_top[index].m_count = count;
+    if (count <= subtree_size || count <= leaf_size) {
+        if (m_subtrees.size() <= m_subtreeCount)
+            m_subtrees.emplace_back();
+        m_top[index].m_subtree = static_cast<int>(m_subtreeCount);
+        m_subtrees[m_subtreeCount].m_first = first;
+        m_subtrees[m_subtreeCount].m_count = count;
+        m_subtreeCount++;
+        return index;
+    }
+    uint32_t mid = split(first, count);
+    int left = build_top(first, mid - first, subtree_size);
+    int right = build_top(mid, first + count - mid, subtree_size);
+    m_top[index].m_left = left;
+    m_top[index].m_right = right;
+    return index;
+}
+
+void LBVHBuilder::build_subtree(vector<BVHNode>& nodes, uint32_t first, uint32_t count) {
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(BVHNode());
+    if (count <= leaf_size) {
+        nodes[index].m_offset = first;
+        nodes[index].m_count = count;
+        return;
+    }
+    uint32_t mid = split(first, count);
+    build_subtree(nodes, first, mid - first);
+    uint32_t right = static_cast<uint32_t>(nodes.size());
+    build_subtree(nodes, mid, first + count - mid);
+    nodes[index].m_offset = right;
+    nodes[index].m_count = 0;
+}
+
+// Copy the top node and the subtrees below it into bvh, depth first
+uint32_t LBVHBuilder::assemble(int top, BVH& bvh) {
+    uint32_t index = static_cast<uint32_t>(bvh.m_nodes.size());
+    if (m_top[top].m_subtree >= 0) {
+        Subtree& subtree = m_subtrees[m_top[top].m_subtree];
+        subtree.m_base = index;
+        for (const BVHNode& node : subtree.m_nodes) {
+            bvh.m_nodes.push_back(node);
+            if (node.m_count == 0)
+                bvh.m_nodes.back().m_offset += index;
+        }
+        return index;
+    }
+    m_topOrder.push_back(index);
+    bvh.m_nodes.push_back(BVHNode());
+    assemble(m_top[top].m_left, bvh);
+    uint32_t right = assemble(m_top[top].m_right, bvh);
+    bvh.m_nodes[index].m_offset = right;
+    bvh.m_nodes[index].m_count = 0;
+    return index;
+}
+
+void LBVHBuilder::build(const vector<AABB>& bounds, BVH& bvh) {
+    bvh.clear();
+    if (bounds.empty())
+        return;
+    size_t count = bounds.size();
+    int threads = threads_for(count);
+    auto chunk_begin = [&](int thread, int chunks) { return count * thread / chunks; };
+
+    // Bounds of the centres
+    m_threadBounds.assign(threads, AABB());
+    run(threads, [&](int thread) {
+        AABB box;
+        for (size_t i = chunk_begin(thread, threads); i < chunk_begin(thread + 1, threads); ++i)
+            box.grow(bounds[i].center());
+        m_threadBounds[thread] = box;
+    });
+    AABB center_box;
+    for (auto &box : m_threadBounds)
+        center_box.grow(box);
+    Vector3D extent = center_box.m_max - center_box.m_min;
+    Vector3D scale(extent.x() > 0 ? 1 / extent.x() : 0, extent.y() > 0 ? 1 / extent.y() : 0, extent.z() > 0 ? 1 / extent.z() : 0);
+
+    // Morton codes
+    m_codes.resize(count);
+    m_codesTemp.resize(count);
+    m_indicesTemp.resize(count);
+    bvh.m_indices.resize(count);
+    run(threads, [&](int thread) {
+        for (size_t i = chunk_begin(thread, threads); i < chunk_begin(thread + 1, threads); ++i) {
+            Vector3D c = (bounds[i].center() - center_box.m_min) * scale;
+            m_codes[i] = morton_code(c.x(), c.y(), c.z());
+            bvh.m_indices[i] = static_cast<uint32_t>(i);
+        }
+    });
+
+    // Least significant digit first radix sort, each thread counts its chunk then
+    // scatters it after the same digits of the threads before it, so the sort is stable
+    m_histograms.resize(size_t(threads) * radix);
+    for (int shift = 0; shift < 30; shift += radix_bits) {
+        run(threads, [&](int thread) {
+            uint32_t* histogram = &m_histograms[size_t(thread) * radix];
+            fill(histogram, histogram + radix, 0);
+            for (size_t i = chunk_begin(thread, threads); i < chunk_begin(thread + 1, threads); ++i)
+                histogram[(m_codes[i] >> shift) & (radix - 1)]++;
+        });
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < radix; ++digit) {
+            for (int thread = 0; thread < threads; ++thread) {
+                uint32_t n = m_histograms[size_t(thread) * radix + digit];
+                m_histograms[size_t(thread) * radix + digit] = offset;
+                offset += n;
+            }
+        }
+        run(threads, [&](int thread) {
+            uint32_t* next = &m_histograms[size_t(thread) * radix];
+            for (size_t i = chunk_begin(thread, threads); i < chunk_begin(thread + 1, threads); ++i) {
+                uint32_t position = next[(m_codes[i] >> shift) & (radix - 1)]++;
+                m_codesTemp[position] = m_codes[i];
+                m_indicesTemp[position] = bvh.m_indices[i];
+            }
+        });
+        swap(m_codes, m_codesTemp);
+        swap(bvh.m_indices, m_indicesTemp);
+    }
+
+    // Split the top of the tree serially into a few subtrees per thread, then build those in parallel
+    m_top.clear();
+    m_topOrder.clear();
+    uint32_t subtree_size = static_cast<uint32_t>(threads > 1 ? max<size_t>(count / (4 * threads), grain / 4) : count);
+    m_subtreeCount = 0;
+    build_top(0, static_cast<uint32_t>(count), subtree_size);
+
+    std::atomic<size_t> next_subtree(0);
+    run(threads, [&](int) {
+        for (size_t s = next_subtree++; s < m_subtreeCount; s = next_subtree++) {
+            m_subtrees[s].m_nodes.clear();
+            build_subtree(m_subtrees[s].m_nodes, m_subtrees[s].m_first, m_subtrees[s].m_count);
+        }
+    });
+
+    bvh.m_nodes.reserve(2 * count / leaf_size + 1);
+    assemble(0, bvh);
+
+    // Fit the bounds bottom up, each subtree is a contiguous run of nodes
+    auto fit = [&](uint32_t i) {
+        BVHNode& node = bvh.m_nodes[i];
+        AABB box;
+        if (node.m_count > 0) {
+            for (uint32_t p = node.m_offset; p < node.m_offset + node.m_count; ++p)
+                box.grow(bounds[bvh.m_indices[p]]);
+        }
+        else {
+            box.grow(bvh.m_nodes[i + 1].m_bounds);
+            box.grow(bvh.m_nodes[node.m_offset].m_bounds);
+        }
+        node.m_bounds = box;
+    };
+    next_subtree = 0;
+    run(threads, [&](int) {
+        for (size_t s = next_subtree++; s < m_subtreeCount; s = next_subtree++) {
+            uint32_t base = m_subtrees[s].m_base;
+            for (uint32_t i = base + static_cast<uint32_t>(m_subtrees[s].m_nodes.size()); i-- > base;)
+                fit(i);
+        }
+    });
+    for (size_t k = m_topOrder.size(); k-- > 0;)
+        fit(m_topOrder[k]);
+}
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include <vector>
+#include <cstdint>
+#include <unordered_set>
+
+#include "World.h"
+#include "IrradianceCache.h"
+
+using namespace std;
+
+// Spherical emitter, an emissive sphere of World::m_spheres
+struct SphereLight {
+    Vector3D m_center;
+    float m_radius;
+    Vector3D m_radiance;
+};
+
+
+// Every emissive sphere of a World, drawn in proportion to its power
+// Lights are sampled by the solid angle they cover, which for the diffuse
+// convention of this tracer (colour times the average incoming light over the
+// hemisphere) makes the light of one sphere 1 / (2 pi) times its radiance times
+// that solid angle, whatever the distance
+class LightList {
+public:
+    vector<SphereLight> m_lights;
+
+    void build(World& world);
+    bool empty() const { return m_lights.empty(); }
+    // True for the material of a light in the list, whose light is sampled rather than hit
+    bool is_light(Material* material) const { return m_materials.count(material) > 0; }
+    // Pick one light, pmf receives the probability it had
+    uint32_t sample(float u, float& pmf) const;
+
+private:
+    Distribution1D m_power;
+    unordered_set<Material*> m_materials;
+};
+
+
+// One light picked out of a stream of candidates by weighted reservoir sampling,
+// as in Bitterli et al., "Spatiotemporal reservoir resampling for real-time ray
+// tracing with dynamic direct lighting", 2020
+struct Reservoir {
+    uint32_t m_light = 0;
+    // Sum of the candidates' weights
+    float m_weightSum = 0;
+    // Number of candidates seen
+    float m_count = 0;
+    // Contribution weight of the light kept, an estimate of 1 / its density
+    float m_weight = 0;
+
+    // Keep light with probability weight / m_weightSum
+    bool update(uint32_t light, float weight, float count = 1) {
+        m_weightSum += weight;
+        m_count += count;
+        if (weight > 0 && random_float() * m_weightSum < weight) {
+            m_light = light;
+            return true;
+        }
+        return false;
+    }
+
+    // Set m_weight once every candidate is in, target is the target function of m_light
+    void finalize(float target) {
+        m_weight = target > 0 && m_count > 0 ? m_weightSum / (m_count * target) : 0;
+    }
+};
+
+
+void LightList::build(World& world) {
+    m_lights.clear();
+    m_materials.clear();
+    vector<float> power;
+    for (auto &sphere : world.m_spheres) {
+        if (!sphere->m_pMaterial->is_emissive())
+            continue;
+        SphereLight light = {sphere->m_center, sphere->m_radius, sphere->m_pMaterial->m_color};
+        m_lights.push_back(light);
+        m_materials.insert(sphere->m_pMaterial.get());
+        power.push_back(luminance(light.m_radiance) * light.m_radius * light.m_radius);
+    }
+    if (!power.empty())
+        m_power.build(power.data(), static_cast<int>(power.size()));
+}
+
+uint32_t LightList::sample(float u, float& pmf) const {
+    float pdf;
+    int bin;
+    m_power.sample(u, pdf, bin);
+    pmf = pdf / m_power.size();
+    return static_cast<uint32_t>(bin);
+}
+
+// 1 - cos of the half angle of the cone light covers seen from position,
+// or 0 when position is inside it
+float light_cone(const SphereLight& light, const Vector3D& position, float& distance) {
+    Vector3D d = light.m_center - position;
+    float distance_squared = d.length_squared();
+    float r2 = light.m_radius * light.m_radius;
+    distance = sqrt(distance_squared);
+    if (distance_squared <= r2)
+        return 0;
+    // 1 - sqrt(1 - x) without the cancellation for far lights
+    float x = r2 / distance_squared;
+    return x / (1 + sqrt(1 - x));
+}
+
+// Unshadowed light of one emitter reaching a diffuse surface, in luminance
+// This is the target function resampling draws lights in proportion to
+float light_target(const SphereLight& light, const Vector3D& position, const Vector3D& normal) {
+    float distance;
+    float one_minus_cos = light_cone(light, position, distance);
+    if (one_minus_cos <= 0)
+        return 0;
+    // Entirely below the horizon
+    float sin_max = light.m_radius / distance;
+    if (dot(light.m_center - position, normal) < -sin_max * distance)
+        return 0;
+    return luminance(light.m_radiance) * one_minus_cos;
+}
+
+// Light of one emitter reaching a diffuse surface, through one shadow ray to a
+// direction drawn uniformly over the cone the light covers
+Vector3D light_contribution(const SphereLight& light, const Vector3D& position, const Vector3D& normal, World& world) {
+    float distance;
+    float one_minus_cos = light_cone(light, position, distance);
+    if (one_minus_cos <= 0)
+        return Vector3D(0, 0, 0);
+
+    Vector3D w = (light.m_center - position) / distance;
+    Vector3D t, b;
+    tangent_frame(w, t, b);
+    float cos_theta = 1 - random_float() * one_minus_cos;
+    float sin_theta = sqrt(fmax(0, 1 - cos_theta * cos_theta));
+    float phi = 2 * M_PI * random_float();
+    Vector3D dir = normalize(sin_theta * (cos(phi) * t + sin(phi) * b) + cos_theta * w);
+    if (dot(dir, normal) <= 0)
+        return Vector3D(0, 0, 0);
+
+    Vector3D origin = position;
+    Ray shadow(origin, dir);
+    float t_light;
+    if (!hit_sphere(shadow, light.m_center, light.m_radius, 0, std::numeric_limits<float>::infinity(), t_light))
+        return Vector3D(0, 0, 0);
+    if (world.hit(shadow, 0.001, t_light * 0.9999f).m_isHit)
+        return Vector3D(0, 0, 0);
+
+    // Radiance times solid angle 2 pi (1 - cos), over the 2 pi of the hemisphere average
+    return one_minus_cos * light.m_radiance;
+}
+
+// Resample candidates lights drawn by power down to one, by their unshadowed light at the hit
+Reservoir sample_lights(const LightList& lights, const Vector3D& position, const Vector3D& normal, int candidates) {
+    Reservoir reservoir;
+    for (int i = 0; i < candidates; ++i) {
+        float pmf;
+        uint32_t light = lights.sample(random_float(), pmf);
+        float target = light_target(lights.m_lights[light], position, normal);
+        reservoir.update(light, pmf > 0 ? target / pmf : 0);
+    }
+    reservoir.finalize(light_target(lights.m_lights[reservoir.m_light], position, normal));
+    return reservoir;
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef MAPPEDIMAGE_H
+#define MAPPEDIMAGE_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "Renderer.h"
+
+// Binary ppm (P6) written in place through a memory-mapped file
+// The file is created at its final size up front, so tiles can be written in
+// any order and from any thread; each tile goes straight to the page cache
+// and its pages are released once written, so resident memory stays bounded
+// by the tiles being traced rather than by the size of the image
+class MappedImage : public TileSink {
+public:
+    MappedImage(const std::string& path, int width, int height);
+    ~MappedImage();
+
+    bool is_open() const { return m_data != nullptr; }
+    virtual void write_tile(const Tile& tile, const std::vector<Vector3D>& pixels) override;
+
+private:
+    int m_width, m_height;
+    int m_fd;
+    size_t m_headerSize;
+    size_t m_fileSize;
+    unsigned char* m_data;
+};
+
+
+MappedImage::MappedImage(const std::string& path, int width, int height) {
+    m_width = width;
+    m_height = height;
+    m_data = nullptr;
+
+    std::string header = "P6\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n";
+    m_headerSize = header.size();
+    m_fileSize = m_headerSize + size_t(width) * height * 3;
+
+    m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+        return;
+    if (ftruncate(m_fd, m_fileSize) != 0)
+        return;
+
+    void* data = mmap(nullptr, m_fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED)
+        return;
+    m_data = static_cast<unsigned char*>(data);
+    memcpy(m_data, header.data(), m_headerSize);
+}
+
+MappedImage::~MappedImage() {
+    if (m_data) {
+        msync(m_data, m_fileSize, MS_SYNC);
+        munmap(m_data, m_fileSize);
+    }
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+void MappedImage::write_tile(const Tile& tile, const std::vector<Vector3D>& pixels) {
+    if (!m_data)
+        return;
+
+    size_t row_bytes = size_t(m_width) * 3;
+    for (int y = tile.m_y0; y < tile.m_y1; ++y) {
+        unsigned char* row = m_data + m_headerSize + y * row_bytes;
+        for (int x = tile.m_x0; x < tile.m_x1; ++x)
+            color_to_rgb(pixels[(y - tile.m_y0) * tile.width() + (x - tile.m_x0)], row + x * 3);
+    }
+
+    // Start writing the rows back and drop them from this process
+    // The pages stay in the page cache, so neighbouring tiles sharing a page are not lost
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t begin = (m_headerSize + tile.m_y0 * row_bytes) / page * page;
+    size_t end = m_headerSize + tile.m_y1 * row_bytes;
+    msync(m_data + begin, end - begin, MS_ASYNC);
+    madvise(m_data + begin, end - begin, MADV_DONTNEED);
+}
+
+#endif
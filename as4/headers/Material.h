@@ -15,6 +15,12 @@ class Material {
 public:
     Vector3D m_color;
     virtual ReflectResult reflect(Ray& ray, HitResult& hit) = 0;
+    // Diffuse surfaces can take their indirect light from the irradiance cache
+    virtual bool is_diffuse() { return false; }
+    // Emissive surfaces give off m_color and reflect nothing
+    virtual bool is_emissive() { return false; }
+    // Colour at one hit, m_color unless the material is textured
+    virtual Vector3D albedo(const HitResult& hit) { return m_color; }
 };
 
 
@@ -44,9 +50,11 @@ public:
         dir = normalize(dir);
         res.m_ray = Ray(hit.m_hitPos, dir);
         
-        res.m_color = m_color;
+        res.m_color = albedo(hit);
         return res;
     }
+
+    virtual bool is_diffuse() override { return true; }
 };
 
 
@@ -70,4 +78,23 @@ public:
         return res;
     }
 };
+
+
+class Emissive : public Material {
+public:
+    // radiance is the light given off in every direction
+    Emissive(const Vector3D& radiance) {
+        m_color = radiance;
+    }
+
+    // Nothing is reflected, paths end here
+    virtual ReflectResult reflect(Ray& ray, HitResult& hit) override {
+        ReflectResult res;
+        res.m_ray = Ray(hit.m_hitPos, hit.m_hitNormal);
+        res.m_color = Vector3D(0, 0, 0);
+        return res;
+    }
+
+    virtual bool is_emissive() override { return true; }
+};
 #endif
@@ -0,0 +1,400 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#define GL_GLEXT_PROTOTYPES
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <vector>
+
+#include "Camera.h"
+#include "World.h"
+#include "GBuffer.h"
+
+// OpenGL 3.3 context without a window or display, through EGL
+// Mesa's surfaceless platform is tried first, so it also runs on its software
+// rasterizer on machines without a GPU or an X server
+class HeadlessContext {
+public:
+    HeadlessContext();
+    ~HeadlessContext();
+
+    bool is_open() const { return m_context != EGL_NO_CONTEXT; }
+    std::string renderer() const;
+
+private:
+    EGLDisplay m_display = EGL_NO_DISPLAY;
+    EGLContext m_context = EGL_NO_CONTEXT;
+};
+
+
+// Rasterizes the first hit of every sub-pixel of a World into a GBuffer
+// Spheres are drawn as the cubes around them and intersected exactly per fragment,
+// so the hits are the ones the tracer would find, triangle meshes are drawn as they are
+// Planes, disks and boxes cover the whole image and are intersected per fragment too
+// The compact particle scene is not supported
+class GBufferRasterizer {
+public:
+    // Shaders are read from shader_dir
+    GBufferRasterizer(const std::string& shader_dir = "../shaders");
+    ~GBufferRasterizer();
+
+    bool is_ready() const { return m_sphereProgram && m_meshProgram && m_shapeProgram; }
+    // Fill gbuffer for an image of width x height pixels with samples x samples sub-pixels each
+    bool rasterize(World& world, const Camera& camera, int width, int height, int samples, GBuffer& gbuffer);
+
+private:
+    GLuint m_sphereProgram = 0, m_meshProgram = 0, m_shapeProgram = 0;
+    GLuint m_framebuffer = 0;
+    GLuint m_textures[4] = {0, 0, 0, 0};
+    int m_width = 0, m_height = 0;
+
+    void resize(int width, int height);
+    void set_camera(GLuint program, const Camera& camera, float col_span, float row_span, float far);
+};
+
+
+// Compile and link a vertex and a fragment shader file, returns 0 on failure
+GLuint load_program(const std::string& vertex_path, const std::string& fragment_path) {
+    GLuint shaders[2];
+    const std::string paths[2] = {vertex_path, fragment_path};
+    const GLenum types[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+    for (int i = 0; i < 2; ++i) {
+        std::ifstream fin(paths[i]);
+        if (!fin) {
+            std::cout << "Failed to read " << paths[i] << std::endl;
+            return 0;
+        }
+        std::stringstream source;
+        source << fin.rdbuf();
+        std::string code = source.str();
+        const char* c_code = code.c_str();
+
+        shaders[i] = glCreateShader(types[i]);
+        glShaderSource(shaders[i], 1, &c_code, NULL);
+        glCompileShader(shaders[i]);
+        GLint success;
+        glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &success);
+        if (!success) {
+            GLchar log[1024];
+            glGetShaderInfoLog(shaders[i], 1024, NULL, log);
+            std::cout << "Failed to compile " << paths[i] << "\n" << log << std::endl;
+            return 0;
+        }
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shaders[0]);
+    glAttachShader(program, shaders[1]);
+    glLinkProgram(program);
+    glDeleteShader(shaders[0]);
+    glDeleteShader(shaders[1]);
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        GLchar log[1024];
+        glGetProgramInfoLog(program, 1024, NULL, log);
+        std::cout << "Failed to link " << vertex_path << " and " << fragment_path << "\n" << log << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+
+HeadlessContext::HeadlessContext() {
+    auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display)
+        m_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (m_display == EGL_NO_DISPLAY)
+        m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, NULL, NULL) || !eglBindAPI(EGL_OPENGL_API))
+        return;
+
+    // Everything is drawn into a framebuffer object, so no config or surface is needed
+    const EGLint attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    m_context = eglCreateContext(m_display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+    if (m_context != EGL_NO_CONTEXT && !eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context)) {
+        eglDestroyContext(m_display, m_context);
+        m_context = EGL_NO_CONTEXT;
+    }
+}
+
+HeadlessContext::~HeadlessContext() {
+    if (m_context != EGL_NO_CONTEXT) {
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(m_display, m_context);
+    }
+    if (m_display != EGL_NO_DISPLAY)
+        eglTerminate(m_display);
+}
+
+std::string HeadlessContext::renderer() const {
+    if (!is_open())
+        return "none";
+    return std::string((const char*) glGetString(GL_RENDERER)) + ", OpenGL " + (const char*) glGetString(GL_VERSION);
+}
+
+
+GBufferRasterizer::GBufferRasterizer(const std::string& shader_dir) {
+    m_sphereProgram = load_program(shader_dir + "/gbuffer_sphere.vs", shader_dir + "/gbuffer_sphere.fs");
+    m_meshProgram = load_program(shader_dir + "/gbuffer_mesh.vs", shader_dir + "/gbuffer_mesh.fs");
+    m_shapeProgram = load_program(shader_dir + "/gbuffer_shape.vs", shader_dir + "/gbuffer_shape.fs");
+}
+
+GBufferRasterizer::~GBufferRasterizer() {
+    if (m_framebuffer) {
+        glDeleteFramebuffers(1, &m_framebuffer);
+        glDeleteTextures(4, m_textures);
+    }
+    if (m_sphereProgram)
+        glDeleteProgram(m_sphereProgram);
+    if (m_meshProgram)
+        glDeleteProgram(m_meshProgram);
+    if (m_shapeProgram)
+        glDeleteProgram(m_shapeProgram);
+}
+
+void GBufferRasterizer::resize(int width, int height) {
+    if (m_framebuffer && width == m_width && height == m_height)
+        return;
+    if (m_framebuffer) {
+        glDeleteFramebuffers(1, &m_framebuffer);
+        glDeleteTextures(4, m_textures);
+    }
+    m_width = width;
+    m_height = height;
+
+    // Position and distance, normal, material index and depth
+    const GLenum internal_formats[4] = {GL_RGBA32F, GL_RGBA32F, GL_R32I, GL_DEPTH_COMPONENT32F};
+    const GLenum formats[4] = {GL_RGBA, GL_RGBA, GL_RED_INTEGER, GL_DEPTH_COMPONENT};
+    const GLenum types[4] = {GL_FLOAT, GL_FLOAT, GL_INT, GL_FLOAT};
+    glGenFramebuffers(1, &m_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glGenTextures(4, m_textures);
+    for (int i = 0; i < 4; ++i) {
+        glBindTexture(GL_TEXTURE_2D, m_textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_formats[i], width, height, 0, formats[i], types[i], NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        GLenum attachment = i < 3 ? GL_COLOR_ATTACHMENT0 + i : GL_DEPTH_ATTACHMENT;
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, m_textures[i], 0);
+    }
+    const GLenum draw_buffers[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+    glDrawBuffers(3, draw_buffers);
+}
+
+void GBufferRasterizer::set_camera(GLuint program, const Camera& camera, float col_span, float row_span, float far) {
+    Vector3D u, v, w;
+    float ndc_width, ndc_height;
+    camera.basis(u, v, w, ndc_width, ndc_height);
+    Vector3D eye = camera.eye();
+    glUseProgram(program);
+    glUniform3f(glGetUniformLocation(program, "eye"), eye.x(), eye.y(), eye.z());
+    glUniform3f(glGetUniformLocation(program, "u"), u.x(), u.y(), u.z());
+    glUniform3f(glGetUniformLocation(program, "v"), v.x(), v.y(), v.z());
+    glUniform3f(glGetUniformLocation(program, "w"), w.x(), w.y(), w.z());
+    glUniform2f(glGetUniformLocation(program, "ndcSize"), ndc_width, ndc_height);
+    glUniform2f(glGetUniformLocation(program, "span"), col_span, row_span);
+    glUniform1f(glGetUniformLocation(program, "far"), far);
+}
+
+bool GBufferRasterizer::rasterize(World& world, const Camera& camera, int width, int height, int samples, GBuffer& gbuffer) {
+    if (!is_ready())
+        return false;
+    if (!world.m_compact.empty()) {
+        std::cout << "The compact particle scene cannot be rasterized" << std::endl;
+        return false;
+    }
+
+    int sub_width = width * samples, sub_height = height * samples;
+    resize(sub_width, sub_height);
+    gbuffer.resize(sub_width, sub_height, samples);
+
+    // Material of every sphere, then of every mesh, then of every shape
+    gbuffer.m_materials.clear();
+    AABB scene;
+    std::vector<float> spheres;
+    std::vector<GLint> sphere_materials;
+    for (auto &sphere : world.m_spheres) {
+        spheres.insert(spheres.end(), {sphere->m_center.x(), sphere->m_center.y(), sphere->m_center.z(), sphere->m_radius});
+        sphere_materials.push_back(static_cast<GLint>(gbuffer.m_materials.size()));
+        gbuffer.m_materials.push_back(sphere->m_pMaterial);
+        Vector3D r(sphere->m_radius, sphere->m_radius, sphere->m_radius);
+        scene.grow(AABB(sphere->m_center - r, sphere->m_center + r));
+    }
+    for (auto &mesh : world.m_meshes)
+        for (auto &p : mesh->positions())
+            scene.grow(p);
+    for (auto &shape : world.m_shapes)
+        scene.grow(shape->bounds());
+
+    // Depth is scaled by the distance to the farthest corner of the bounded scene
+    Vector3D eye = camera.eye();
+    float far = 1;
+    for (int k = 0; k < 8; ++k) {
+        Vector3D corner((k & 1) ? scene.m_max.x() : scene.m_min.x(), (k & 2) ? scene.m_max.y() : scene.m_min.y(), (k & 4) ? scene.m_max.z() : scene.m_min.z());
+        // The corners of an empty scene are infinitely far
+        float distance = (corner - eye).length();
+        if (std::isfinite(distance))
+            far = fmax(far, distance);
+    }
+
+    // The image covers pixel i over [i, i + 1) / (width - 1), as Renderer does
+    float col_span = width / float(width - 1);
+    float row_span = height / float(height - 1);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glViewport(0, 0, sub_width, sub_height);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    // Cubes are seen from inside when the camera is close, so both sides are drawn
+    glDisable(GL_CULL_FACE);
+    const GLfloat clear_position[4] = {0, 0, 0, 0};
+    const GLint clear_material[4] = {-1, 0, 0, 0};
+    glClearBufferfv(GL_COLOR, 0, clear_position);
+    glClearBufferfv(GL_COLOR, 1, clear_position);
+    glClearBufferiv(GL_COLOR, 2, clear_material);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    GLuint vao, buffers[3];
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(3, buffers);
+    glBindVertexArray(vao);
+
+    if (!spheres.empty()) {
+        // Unit cube as 12 triangles, instanced once per sphere
+        std::vector<float> cube;
+        const int faces[6][4] = {{0, 1, 3, 2}, {4, 6, 7, 5}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 2, 6, 4}, {1, 5, 7, 3}};
+        for (auto &face : faces) {
+            for (int corner : {face[0], face[1], face[2], face[0], face[2], face[3]}) {
+                cube.push_back((corner & 1) ? 1 : -1);
+                cube.push_back((corner & 2) ? 1 : -1);
+                cube.push_back((corner & 4) ? 1 : -1);
+            }
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+        glBufferData(GL_ARRAY_BUFFER, cube.size() * sizeof(float), cube.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*) 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+        glBufferData(GL_ARRAY_BUFFER, spheres.size() * sizeof(float), spheres.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*) 0);
+        glVertexAttribDivisor(1, 1);
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[2]);
+        glBufferData(GL_ARRAY_BUFFER, sphere_materials.size() * sizeof(GLint), sphere_materials.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(2);
+        glVertexAttribIPointer(2, 1, GL_INT, sizeof(GLint), (void*) 0);
+        glVertexAttribDivisor(2, 1);
+
+        set_camera(m_sphereProgram, camera, col_span, row_span, far);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 36, static_cast<GLsizei>(world.m_spheres.size()));
+
+        glVertexAttribDivisor(1, 0);
+        glVertexAttribDivisor(2, 0);
+        glDisableVertexAttribArray(2);
+    }
+
+    // Meshes as positions and normals read in place, one buffer each
+    set_camera(m_meshProgram, camera, col_span, row_span, far);
+    for (auto &mesh : world.m_meshes) {
+        Span<const Vector3D> positions = mesh->positions(), normals = mesh->normals();
+        Span<const uint32_t> indices = mesh->indices();
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+        glBufferData(GL_ARRAY_BUFFER, positions.bytes(), positions.data(), GL_STREAM_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vector3D), (void*) 0);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+        glBufferData(GL_ARRAY_BUFFER, normals.bytes(), normals.data(), GL_STREAM_DRAW);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vector3D), (void*) 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.bytes(), indices.data(), GL_STREAM_DRAW);
+
+        glUniform1i(glGetUniformLocation(m_meshProgram, "materialId"), static_cast<GLint>(gbuffer.m_materials.size()));
+        gbuffer.m_materials.push_back(mesh->m_pMaterial);
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, 0);
+    }
+
+    // Shapes as one triangle over the whole image each
+    if (!world.m_shapes.empty() || !world.m_unbounded.empty()) {
+        set_camera(m_shapeProgram, camera, col_span, row_span, far);
+        glUniform2f(glGetUniformLocation(m_shapeProgram, "viewport"), sub_width, sub_height);
+        glDisableVertexAttribArray(0);
+        glDisableVertexAttribArray(1);
+        for (auto list : {&world.m_shapes, &world.m_unbounded}) {
+            for (auto &shape : *list) {
+                Vector3D a, b;
+                float radius = 0;
+                int type;
+                if (auto plane = dynamic_cast<Plane*>(shape.get())) {
+                    type = 0;
+                    a = plane->m_point;
+                    b = plane->m_normal;
+                }
+                else if (auto disk = dynamic_cast<Disk*>(shape.get())) {
+                    type = 1;
+                    a = disk->m_center;
+                    b = disk->m_normal;
+                    radius = disk->m_radius;
+                }
+                else if (auto box = dynamic_cast<Box*>(shape.get())) {
+                    type = 2;
+                    a = box->m_min;
+                    b = box->m_max;
+                }
+                else {
+                    std::cout << "Skipping a shape the rasterizer does not know" << std::endl;
+                    continue;
+                }
+                glUniform1i(glGetUniformLocation(m_shapeProgram, "shapeType"), type);
+                glUniform3f(glGetUniformLocation(m_shapeProgram, "shapeA"), a.x(), a.y(), a.z());
+                glUniform3f(glGetUniformLocation(m_shapeProgram, "shapeB"), b.x(), b.y(), b.z());
+                glUniform1f(glGetUniformLocation(m_shapeProgram, "shapeRadius"), radius);
+                glUniform1i(glGetUniformLocation(m_shapeProgram, "materialId"), static_cast<GLint>(gbuffer.m_materials.size()));
+                gbuffer.m_materials.push_back(shape->m_pMaterial);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            }
+        }
+    }
+
+    glBindVertexArray(0);
+    glDeleteBuffers(3, buffers);
+    glDeleteVertexArrays(1, &vao);
+
+    // Read the attachments back, GL rows start at the bottom like GBuffer's
+    size_t size = size_t(sub_width) * sub_height;
+    std::vector<float> position(4 * size), normal(4 * size);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, sub_width, sub_height, GL_RGBA, GL_FLOAT, position.data());
+    glReadBuffer(GL_COLOR_ATTACHMENT1);
+    glReadPixels(0, 0, sub_width, sub_height, GL_RGBA, GL_FLOAT, normal.data());
+    glReadBuffer(GL_COLOR_ATTACHMENT2);
+    glReadPixels(0, 0, sub_width, sub_height, GL_RED_INTEGER, GL_INT, gbuffer.m_material.data());
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    for (size_t p = 0; p < size; ++p) {
+        gbuffer.m_position[p] = Vector3D(position[4 * p], position[4 * p + 1], position[4 * p + 2]);
+        gbuffer.m_distance[p] = position[4 * p + 3];
+        gbuffer.m_normal[p] = Vector3D(normal[4 * p], normal[4 * p + 1], normal[4 * p + 2]);
+    }
+    return glGetError() == GL_NO_ERROR;
+}
+
+#endif
@@ -8,6 +8,10 @@ class Ray {
 public:
     Vector3D m_origin;
     Vector3D m_direction;
+    // Cone around the ray, its width at the origin and how fast it widens per unit of
+    // distance, so textures can be read at a level matching the area the ray stands for
+    float m_coneWidth = 0;
+    float m_coneSpread = 0;
     
     Ray(){}
 
@@ -0,0 +1,163 @@
+#ifndef RENDERJOB_H
+#define RENDERJOB_H
+
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <cstdint>
+
+#include "Camera.h"
+#include "World.h"
+#include "Renderer.h"
+
+// Everything that defines one render, sent as a line of key=value pairs, e.g.
+//   scene=multi_diffuse width=384 height=270 spp=64 priority=1
+// Keys left out keep the defaults of main.cpp
+class JobSpec {
+public:
+    std::string m_scene = "all";
+    uint64_t m_particles = 1000000;
+    int m_lights = 2000;
+    unsigned int m_seed = 1;
+    Vector3D m_eye = Vector3D(20, 3, 3);
+    Vector3D m_target = Vector3D(0, 0, 0);
+    float m_fov = 20;
+    RenderSettings m_settings;
+    // Higher runs first, does not change the image
+    int m_priority = 0;
+
+    // Largest values a job may ask for, so a request cannot make the server run out of memory
+    static const int max_size = 8192;
+    static const int max_spp = 1 << 16;
+    static const int max_bounces = 64;
+    static const uint64_t max_particles = 100000000;
+    static const int max_lights = 1000000;
+
+    bool parse(const std::string& line, std::string& error);
+    // Every field that changes the image, in a fixed order
+    std::string canonical() const;
+    uint64_t hash() const;
+
+    // Generate the scene, returns false for an unknown scene name
+    bool build_world(World& world) const;
+    Camera camera() const;
+};
+
+
+bool parse_vector(const std::string& text, Vector3D& v) {
+    float x, y, z;
+    char c0, c1;
+    std::istringstream in(text);
+    if (!(in >> x >> c0 >> y >> c1 >> z) || c0 != ',' || c1 != ',')
+        return false;
+    v = Vector3D(x, y, z);
+    return true;
+}
+
+bool JobSpec::parse(const std::string& line, std::string& error) {
+    std::istringstream in(line);
+    std::string pair;
+    while (in >> pair) {
+        size_t eq = pair.find('=');
+        if (eq == std::string::npos) {
+            error = "expected key=value, got " + pair;
+            return false;
+        }
+        std::string key = pair.substr(0, eq);
+        std::string value = pair.substr(eq + 1);
+
+        bool ok = true;
+        try {
+            if (key == "scene") m_scene = value;
+            else if (key == "particles") m_particles = std::stoull(value);
+            else if (key == "lights") m_lights = std::stoi(value);
+            else if (key == "seed") m_seed = std::stoul(value);
+            else if (key == "eye") ok = parse_vector(value, m_eye);
+            else if (key == "target") ok = parse_vector(value, m_target);
+            else if (key == "fov") m_fov = std::stof(value);
+            else if (key == "width") m_settings.m_width = std::stoi(value);
+            else if (key == "height") m_settings.m_height = std::stoi(value);
+            else if (key == "spp") m_settings.m_raysPerPixel = std::stoi(value);
+            else if (key == "bounces") m_settings.m_maxLightBounceNum = std::stoi(value);
+            else if (key == "cache") m_settings.m_useIrradianceCache = std::stoi(value) != 0;
+            else if (key == "tile") m_settings.m_tileSize = std::stoi(value);
+            else if (key == "priority") m_priority = std::stoi(value);
+            else {
+                error = "unknown key " + key;
+                return false;
+            }
+        }
+        catch (const std::exception&) {
+            ok = false;
+        }
+        if (!ok) {
+            error = "bad value for " + key + ": " + value;
+            return false;
+        }
+    }
+
+    if (m_settings.m_width <= 1 || m_settings.m_height <= 1 || m_settings.m_raysPerPixel <= 0 || m_settings.m_tileSize <= 0) {
+        error = "image size, spp and tile must be positive";
+        return false;
+    }
+    if (m_settings.m_width > max_size || m_settings.m_height > max_size || m_settings.m_raysPerPixel > max_spp
+        || m_settings.m_maxLightBounceNum < 0 || m_settings.m_maxLightBounceNum > max_bounces
+        || m_particles > max_particles || m_lights < 0 || m_lights > max_lights) {
+        error = "job too large, at most " + std::to_string(max_size) + "x" + std::to_string(max_size) + " pixels, spp "
+                + std::to_string(max_spp) + ", bounces " + std::to_string(max_bounces) + ", particles "
+                + std::to_string(max_particles) + " and lights " + std::to_string(max_lights);
+        return false;
+    }
+    return true;
+}
+
+std::string JobSpec::canonical() const {
+    std::ostringstream out;
+    // Enough digits that every float reads back as itself, so jobs that differ hash differently
+    out << std::setprecision(std::numeric_limits<float>::max_digits10);
+    out << "scene=" << m_scene;
+    if (m_scene == "particles")
+        out << " particles=" << m_particles;
+    if (m_scene == "party")
+        out << " lights=" << m_lights;
+    out << " seed=" << m_seed
+        << " eye=" << m_eye.x() << ',' << m_eye.y() << ',' << m_eye.z()
+        << " target=" << m_target.x() << ',' << m_target.y() << ',' << m_target.z()
+        << " fov=" << m_fov
+        << " width=" << m_settings.m_width << " height=" << m_settings.m_height
+        << " spp=" << m_settings.m_raysPerPixel << " bounces=" << m_settings.m_maxLightBounceNum
+        << " cache=" << m_settings.m_useIrradianceCache << " tile=" << m_settings.m_tileSize;
+    return out.str();
+}
+
+// 64 bit FNV-1a of the canonical form
+uint64_t JobSpec::hash() const {
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : canonical()) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+bool JobSpec::build_world(World& world) const {
+    // The scenes are random, seed them so the same job gives the same image
+    seed_random(m_seed);
+    if (m_scene == "one_diffuse") world.generate_scene_one_diffuse();
+    else if (m_scene == "one_specular") world.generate_scene_one_specular();
+    else if (m_scene == "multi_diffuse") world.generate_scene_multi_diffuse();
+    else if (m_scene == "multi_specular") world.generate_scene_multi_specular();
+    else if (m_scene == "all") world.generate_scene_all();
+    else if (m_scene == "particles") world.generate_scene_particles(m_particles);
+    else if (m_scene == "party") world.generate_scene_party(m_lights);
+    else return false;
+    return true;
+}
+
+Camera JobSpec::camera() const {
+    float aspect_ratio = m_settings.m_width / float(m_settings.m_height);
+    return Camera(m_eye, m_target, Vector3D(0, 1, 0), m_fov, aspect_ratio);
+}
+
+#endif
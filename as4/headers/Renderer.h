@@ -0,0 +1,420 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <limits>
+
+#include "Camera.h"
+#include "World.h"
+#include "IrradianceCache.h"
+#include "GBuffer.h"
+
+// Settings of one render
+class RenderSettings {
+public:
+    int m_width = 768;
+    int m_height = 540;
+    int m_raysPerPixel = 100;
+    int m_maxLightBounceNum = 5;
+    // Interpolate indirect diffuse light from sparse samples instead of tracing every bounce
+    bool m_useIrradianceCache = true;
+    // Tiles are square blocks of pixels, only the tiles being traced are kept in memory
+    int m_tileSize = 64;
+    // 0 uses every hardware thread
+    int m_numThreads = 0;
+    // Changes the random numbers, e.g. per frame of an animation
+    unsigned int m_seed = 0;
+    // Most samples a pixel carries over from the previous frame, so stale light fades out
+    float m_historyLimit = 256;
+};
+
+
+// Pixels [m_x0, m_x1) x [m_y0, m_y1), row 0 is the top of the image
+class Tile {
+public:
+    int m_x0, m_y0, m_x1, m_y1;
+
+    int width() const { return m_x1 - m_x0; }
+    int height() const { return m_y1 - m_y0; }
+};
+
+
+// Receives finished tiles in any order, possibly from several threads at once
+class TileSink {
+public:
+    virtual ~TileSink() {}
+    // pixels holds the averaged colour of the tile row by row, starting from the top
+    virtual void write_tile(const Tile& tile, const std::vector<Vector3D>& pixels) = 0;
+};
+
+
+// Radiance accumulated over a finished frame, reprojected into the next one
+// Only pixels whose centre sees a diffuse surface are kept, since their colour
+// does not depend on where they are seen from
+class FrameHistory {
+public:
+    int m_width, m_height;
+    Camera m_camera;
+    // Mean radiance and the number of samples behind it
+    vector<Vector3D> m_color;
+    vector<float> m_samples;
+    // Primary hit through the pixel centre
+    vector<Vector3D> m_position;
+    vector<char> m_reusable;
+
+    FrameHistory(int width, int height, const Camera& camera)
+        : m_width(width), m_height(height), m_camera(camera),
+          m_color(size_t(width) * height), m_samples(size_t(width) * height),
+          m_position(size_t(width) * height), m_reusable(size_t(width) * height, 0) {}
+};
+
+
+// Convert an averaged colour to 8 bit with gamma 2
+void color_to_rgb(Vector3D pixel_color, unsigned char rgb[3]) {
+    auto r = pixel_color.x();
+    auto g = pixel_color.y();
+    auto b = pixel_color.z();
+    if (r != r) r = 0.0;
+    if (g != g) g = 0.0;
+    if (b != b) b = 0.0;
+    rgb[0] = static_cast<unsigned char>(clamp(256 * sqrt(r), 0, 255));
+    rgb[1] = static_cast<unsigned char>(clamp(256 * sqrt(g), 0, 255));
+    rgb[2] = static_cast<unsigned char>(clamp(256 * sqrt(b), 0, 255));
+}
+
+
+Vector3D cached_irradiance(HitResult& hit, World& world, int max_light_bounce_num, IrradianceCache& cache);
+
+// Diffuse surfaces reflect their colour times the hemisphere average of the
+// incoming light (see Diffuse::reflect), so their sampling density is uniform
+const float hemisphere_pdf = 1 / (2 * M_PI);
+
+Vector3D uniform_hemisphere_direction(const Vector3D& normal) {
+    Vector3D t, b;
+    tangent_frame(normal, t, b);
+    float cos_theta = random_float();
+    float sin_theta = sqrt(fmax(0, 1 - cos_theta * cos_theta));
+    float phi = 2 * M_PI * random_float();
+    return normalize(sin_theta * (cos(phi) * t + sin(phi) * b) + cos_theta * normal);
+}
+
+// Environment light reaching a diffuse hit, from one direction drawn from the map
+// With mis the sample is weighted against the hemisphere sample that continues the path
+Vector3D environment_light(HitResult& hit, World& world, bool mis) {
+    const Environment& environment = *world.m_environment;
+    float pdf;
+    Vector3D dir = environment.sample(random_float(), random_float(), pdf);
+    if (pdf <= 0 || dot(dir, hit.m_hitNormal) <= 0)
+        return Vector3D(0, 0, 0);
+
+    Ray shadow(hit.m_hitPos, dir);
+    if (world.hit(shadow, 0.001, std::numeric_limits<float>::infinity()).m_isHit)
+        return Vector3D(0, 0, 0);
+
+    float weight = mis ? power_heuristic(pdf, hemisphere_pdf) : 1;
+    return (weight * hemisphere_pdf / pdf) * environment.radiance(dir);
+}
+
+Vector3D shade_hit(Ray& r, HitResult& hit, World& world, int max_light_bounce_num, IrradianceCache* cache = nullptr);
+Vector3D background(Ray& r, World& world, bool hemisphere_sampled = false);
+
+// Spread of the ray cone after a diffuse bounce, as if the hemisphere were shared
+// by about a hundred rays, so textures further along the path are read coarsely
+const float diffuse_cone_spread = 0.25;
+
+// Give next, which continues r from hit, the cone of r widened up to the hit
+void continue_cone(const Ray& r, const HitResult& hit, Ray& next, bool diffuse) {
+    next.m_coneWidth = r.m_coneWidth + r.m_coneSpread * hit.m_t;
+    next.m_coneSpread = diffuse ? fmax(r.m_coneSpread, diffuse_cone_spread) : r.m_coneSpread;
+}
+
+// hit_distance, if given, receives the distance to the first hit (infinity on a miss)
+// hemisphere_sampled tells that r continues a path from a diffuse hit that has
+// already sampled the environment, so the environment it reaches is weighted by MIS
+Vector3D ray_hit_color(Ray& r, World& world, int max_light_bounce_num, IrradianceCache* cache = nullptr,
+                       float* hit_distance = nullptr, bool hemisphere_sampled = false) {
+    if (hit_distance)
+        *hit_distance = std::numeric_limits<float>::infinity();
+    if (max_light_bounce_num <= 0)
+        return Vector3D(0, 0, 0);
+
+    HitResult hit = world.hit(r, 0.001, std::numeric_limits<float>::infinity());
+    if (hit.m_isHit) {
+        if (hit_distance)
+            *hit_distance = hit.m_t;
+        return shade_hit(r, hit, world, max_light_bounce_num, cache);
+    }
+    return background(r, world, hemisphere_sampled);
+}
+
+// Light leaving hit back along r, with max_light_bounce_num bounces left including this one
+// Split from ray_hit_color so first hits found some other way can be shaded too
+Vector3D shade_hit(Ray& r, HitResult& hit, World& world, int max_light_bounce_num, IrradianceCache* cache) {
+    if (hit.m_hitMaterial->is_emissive())
+        return hit.m_hitMaterial->m_color;
+    if (world.m_environment && hit.m_hitMaterial->is_diffuse()) {
+        // The cache holds indirect light only, direct light is always sampled from the map
+        if (cache)
+            return hit.m_hitMaterial->albedo(hit) * (environment_light(hit, world, false) + cached_irradiance(hit, world, max_light_bounce_num, *cache));
+        // Otherwise sample the map and the hemisphere, and combine both with MIS
+        Vector3D direct = environment_light(hit, world, true);
+        Vector3D dir = uniform_hemisphere_direction(hit.m_hitNormal);
+        Ray next(hit.m_hitPos, dir);
+        continue_cone(r, hit, next, true);
+        return hit.m_hitMaterial->albedo(hit) * (direct + ray_hit_color(next, world, max_light_bounce_num - 1, nullptr, nullptr, true));
+    }
+    // Indirect light on diffuse surfaces is interpolated from the cache
+    if (cache && hit.m_hitMaterial->is_diffuse())
+        return hit.m_hitMaterial->albedo(hit) * cached_irradiance(hit, world, max_light_bounce_num, *cache);
+    ReflectResult res = hit.m_hitMaterial->reflect(r, hit);
+    continue_cone(r, hit, res.m_ray, hit.m_hitMaterial->is_diffuse());
+    return res.m_color * ray_hit_color(res.m_ray, world, max_light_bounce_num - 1, cache);
+}
+
+// Light reaching a ray that leaves the scene
+Vector3D background(Ray& r, World& world, bool hemisphere_sampled) {
+    if (world.m_environment) {
+        Vector3D radiance = world.m_environment->radiance(r.direction());
+        if (hemisphere_sampled)
+            radiance *= power_heuristic(hemisphere_pdf, world.m_environment->pdf(r.direction()));
+        return radiance;
+    }
+    return world.m_background;
+}
+
+// Incoming light at a diffuse hit, interpolated from nearby cache records
+// When no record is close enough, a new one is traced over a stratified hemisphere
+Vector3D cached_irradiance(HitResult& hit, World& world, int max_light_bounce_num, IrradianceCache& cache) {
+    Vector3D irradiance;
+    if (cache.lookup(hit.m_hitPos, hit.m_hitNormal, irradiance))
+        return irradiance;
+
+    int M = cache.theta_strata();
+    int N = cache.phi_strata();
+    std::vector<Vector3D> radiance(M * N);
+    std::vector<float> distance(M * N);
+    for (int j = 0; j < M; ++j) {
+        for (int k = 0; k < N; ++k) {
+            Vector3D dir = cache.sample_direction(hit.m_hitNormal, j, k);
+            Ray r(hit.m_hitPos, dir);
+            // Records are shared by many pixels, so their rays start from a point
+            r.m_coneSpread = diffuse_cone_spread;
+            radiance[j * N + k] = ray_hit_color(r, world, max_light_bounce_num - 1, nullptr, &distance[j * N + k]);
+            // Direct environment light is sampled from the map at every hit instead
+            if (world.m_environment && std::isinf(distance[j * N + k]))
+                radiance[j * N + k] = Vector3D(0, 0, 0);
+        }
+    }
+
+    IrradianceRecord record = cache.make_record(hit.m_hitPos, hit.m_hitNormal, radiance, distance);
+    cache.insert(record);
+    return record.m_irradiance;
+}
+
+
+// Traces a frame tile by tile
+// Tiles are independent, so render_tile can be called from several threads at once
+// and every tile seeds its own random numbers. Without the irradiance cache that keeps
+// the image the same whatever order the tiles are traced in. With it the records depend
+// on which thread inserts first, so the image varies slightly from run to run
+class Renderer {
+public:
+    // shared_cache, if given, is used instead of a cache of its own, e.g. across frames
+    Renderer(World& world, Camera& camera, const RenderSettings& settings, IrradianceCache* shared_cache = nullptr);
+
+    int tile_count() const { return m_tilesX * m_tilesY; }
+    Tile tile(int index) const;
+    void render_tile(int index, TileSink& sink);
+    // Trace every tile on m_numThreads threads, progress is called after each tile
+    void render(TileSink& sink, std::function<void(int done, int total)> progress = nullptr);
+    // Same for the listed tiles only
+    void render_tiles(const std::vector<int>& indices, TileSink& sink, std::function<void(int done, int total)> progress = nullptr);
+
+    // Start each pixel from its reprojection in previous, and keep this frame in current
+    void set_history(const FrameHistory* previous, FrameHistory* current);
+    // Take the first hits from gbuffer instead of tracing them, rays per pixel are
+    // spread over its sub-pixels and only the bounces after the first hit are traced
+    void set_primary_visibility(const GBuffer* gbuffer) { m_gbuffer = gbuffer; }
+    // Watch the rays of each tile with observer(index) while it is traced
+    void set_tile_observer(std::function<HitObserver*(int index)> observer) { m_tileObserver = observer; }
+
+    IrradianceCache* cache() { return m_activeCache; }
+    const RenderSettings& settings() const { return m_settings; }
+
+private:
+    World& m_world;
+    Camera& m_camera;
+    RenderSettings m_settings;
+    int m_tilesX, m_tilesY;
+    // Angle between the rays of neighbouring pixels, the spread of primary ray cones
+    float m_pixelSpread;
+    std::unique_ptr<IrradianceCache> m_cache;
+    IrradianceCache* m_activeCache;
+    const FrameHistory* m_previous = nullptr;
+    FrameHistory* m_current = nullptr;
+    const GBuffer* m_gbuffer = nullptr;
+    std::function<HitObserver*(int index)> m_tileObserver;
+
+    bool reproject(const Vector3D& position, Vector3D& color, float& samples);
+};
+
+
+Renderer::Renderer(World& world, Camera& camera, const RenderSettings& settings, IrradianceCache* shared_cache)
+    : m_world(world), m_camera(camera), m_settings(settings) {
+    m_tilesX = (settings.m_width + settings.m_tileSize - 1) / settings.m_tileSize;
+    m_tilesY = (settings.m_height + settings.m_tileSize - 1) / settings.m_tileSize;
+    Vector3D a = camera.generate_ray(0.5, 0.5).direction();
+    Vector3D b = camera.generate_ray(0.5, 0.5 + 1.0 / (settings.m_height - 1)).direction();
+    m_pixelSpread = acos(clamp(dot(normalize(a), normalize(b)), -1, 1));
+    m_activeCache = shared_cache;
+    if (settings.m_useIrradianceCache && !shared_cache) {
+        m_cache = make_unique<IrradianceCache>();
+        m_activeCache = m_cache.get();
+    }
+    if (!settings.m_useIrradianceCache)
+        m_activeCache = nullptr;
+}
+
+void Renderer::set_history(const FrameHistory* previous, FrameHistory* current) {
+    m_previous = previous;
+    m_current = current;
+}
+
+// Add the previous frame's radiance at position, if that pixel saw the same point
+bool Renderer::reproject(const Vector3D& position, Vector3D& color, float& samples) {
+    const FrameHistory& previous = *m_previous;
+    float col, row;
+    if (!previous.m_camera.project(position, col, row))
+        return false;
+
+    int i = int(floor(col * (previous.m_width - 1) + 0.5));
+    int j = int(floor(row * (previous.m_height - 1) + 0.5));
+    if (i < 0 || i >= previous.m_width || j < 0 || j >= previous.m_height)
+        return false;
+
+    size_t p = size_t(previous.m_height - 1 - j) * previous.m_width + i;
+    if (!previous.m_reusable[p])
+        return false;
+    // Reject points that were hidden or have moved, with a tolerance growing with distance
+    // Points whose lighting changed are kept, e.g. under a moving object, so m_historyLimit
+    // should be kept low when objects move
+    float tolerance = 0.01 * (position - previous.m_camera.eye()).length();
+    if ((previous.m_position[p] - position).length() > tolerance)
+        return false;
+
+    float weight = fmin(previous.m_samples[p], m_settings.m_historyLimit);
+    color += weight * previous.m_color[p];
+    samples += weight;
+    return true;
+}
+
+Tile Renderer::tile(int index) const {
+    Tile tile;
+    tile.m_x0 = (index % m_tilesX) * m_settings.m_tileSize;
+    tile.m_y0 = (index / m_tilesX) * m_settings.m_tileSize;
+    tile.m_x1 = min(tile.m_x0 + m_settings.m_tileSize, m_settings.m_width);
+    tile.m_y1 = min(tile.m_y0 + m_settings.m_tileSize, m_settings.m_height);
+    return tile;
+}
+
+void Renderer::render_tile(int index, TileSink& sink) {
+    Tile t = tile(index);
+    int width = m_settings.m_width;
+    int height = m_settings.m_height;
+    int rays_per_pixel = m_settings.m_raysPerPixel;
+
+    seed_random(0x9e3779b9u * (index + 1) + 0x85ebca6bu * m_settings.m_seed);
+    if (m_tileObserver)
+        hit_observer() = m_tileObserver(index);
+
+    std::vector<Vector3D> pixels(t.width() * t.height());
+    for (int y = t.m_y0; y < t.m_y1; ++y) {
+        // Rows are counted from the bottom of the image by the camera
+        int j = height - 1 - y;
+        for (int i = t.m_x0; i < t.m_x1; ++i) {
+            Vector3D pixel_color(0, 0, 0);
+            for (int s = 0; s < rays_per_pixel; ++s) {
+                if (m_gbuffer) {
+                    // Sub-pixels take the rays in turn
+                    int n = m_gbuffer->m_samples;
+                    int sx = i * n + s % n;
+                    int sy = j * n + (s / n) % n;
+                    Ray r = m_camera.generate_ray((sx + 0.5) / (n * (width - 1)), (sy + 0.5) / (n * (height - 1)));
+                    r.m_coneSpread = m_pixelSpread / n;
+                    HitResult hit;
+                    if (m_gbuffer->hit(sx, sy, hit))
+                        pixel_color += shade_hit(r, hit, m_world, m_settings.m_maxLightBounceNum, m_activeCache);
+                    else
+                        pixel_color += background(r, m_world);
+                    continue;
+                }
+                float col = (i + random_float()) / (width - 1);
+                float row = (j + random_float()) / (height - 1);
+                Ray r = m_camera.generate_ray(col, row);
+                r.m_coneSpread = m_pixelSpread;
+                pixel_color += ray_hit_color(r, m_world, m_settings.m_maxLightBounceNum, m_activeCache);
+            }
+            float samples = rays_per_pixel;
+
+            if (m_current) {
+                // Primary hit through the pixel centre, to find this pixel in the previous frame
+                Ray r = m_camera.generate_ray(i / float(width - 1), j / float(height - 1));
+                HitResult hit = m_world.hit(r, 0.001, std::numeric_limits<float>::infinity());
+                bool reusable = hit.m_isHit && hit.m_hitMaterial->is_diffuse();
+                if (reusable && m_previous)
+                    reproject(hit.m_hitPos, pixel_color, samples);
+
+                size_t p = size_t(y) * width + i;
+                m_current->m_color[p] = pixel_color / samples;
+                m_current->m_samples[p] = samples;
+                m_current->m_position[p] = hit.m_hitPos;
+                m_current->m_reusable[p] = reusable;
+            }
+
+            pixels[(y - t.m_y0) * t.width() + (i - t.m_x0)] = pixel_color / samples;
+        }
+    }
+
+    if (m_tileObserver)
+        hit_observer() = nullptr;
+    sink.write_tile(t, pixels);
+}
+
+void Renderer::render(TileSink& sink, std::function<void(int done, int total)> progress) {
+    std::vector<int> indices(tile_count());
+    for (int i = 0; i < tile_count(); ++i)
+        indices[i] = i;
+    render_tiles(indices, sink, progress);
+}
+
+void Renderer::render_tiles(const std::vector<int>& indices, TileSink& sink, std::function<void(int done, int total)> progress) {
+    int num_threads = m_settings.m_numThreads > 0 ? m_settings.m_numThreads : max(1u, thread::hardware_concurrency());
+    int total = static_cast<int>(indices.size());
+    std::atomic<int> next(0);
+    int done = 0;
+    std::mutex progress_mutex;
+
+    // Each thread keeps taking the next untraced tile
+    auto worker = [&]() {
+        for (int i = next++; i < total; i = next++) {
+            render_tile(indices[i], sink);
+            if (progress) {
+                std::lock_guard<std::mutex> lock(progress_mutex);
+                progress(++done, total);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i)
+        threads.emplace_back(worker);
+    for (auto &thread : threads)
+        thread.join();
+}
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef RESTIR_H
+#define RESTIR_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "Camera.h"
+#include "World.h"
+#include "Renderer.h"
+#include "Lights.h"
+
+using namespace std;
+
+struct RestirSettings {
+    // Lights drawn by power for every new reservoir
+    int m_candidates = 32;
+    // Reuse the reservoir of the same pixel from the previous pass
+    bool m_temporal = true;
+    // A reservoir carried over counts as at most this many passes of new candidates
+    // Kept low: a long history makes the passes alike, and their mean converges slower
+    int m_temporalLimit = 4;
+    // Reuse the reservoirs of this many random neighbours within m_spatialRadius pixels
+    int m_spatialNeighbours = 4;
+    float m_spatialRadius = 16;
+};
+
+
+// Progressive renderer for scenes lit by many small emitters
+// Every pass traces one path per pixel. The direct light at the first diffuse hit
+// comes from a reservoir of lights resampled by their unshadowed light, merged with
+// the pixel's reservoir of the previous pass and with those of its neighbours,
+// so a shading point traces two shadow rays however many lights there are: one
+// to drop an occluded light before it is shared, one for the light finally kept
+// Later bounces resample their own candidates with a single shadow ray
+// Reuse between pixels is only allowed on similar surfaces, which leaves a small
+// bias where that test lets through a neighbour that sees different lights
+class RestirRenderer {
+public:
+    RestirRenderer(World& world, Camera& camera, const RenderSettings& settings, const RestirSettings& restir);
+
+    // One more path per pixel
+    void render_pass();
+    int passes() const { return m_passes; }
+    const LightList& lights() const { return m_lights; }
+    // Mean of the passes so far, as one tile
+    void write(TileSink& sink) const;
+    // The last pass alone, as a real time frame would show it
+    void write_last_pass(TileSink& sink) const;
+
+private:
+    World& m_world;
+    Camera& m_camera;
+    RenderSettings m_settings;
+    RestirSettings m_restir;
+    LightList m_lights;
+    int m_passes = 0;
+
+    // Per pixel, row by row from the top
+    // First hit of the pass and of the previous one, a reservoir only where it is diffuse
+    vector<HitResult> m_hits, m_previousHits;
+    vector<Reservoir> m_reservoirs, m_spatial;
+    vector<bool> m_hasReservoir, m_previousHasReservoir;
+    // Light of this pass, without the direct light at the first hit until it is shaded, and the sum of every pass
+    vector<Vector3D> m_color, m_sum;
+
+    // Run row(y) for every row on the render threads, with random numbers seeded per row and step
+    void for_each_row(int step, std::function<void(int y)> row);
+    void trace_first_hit(int x, int y);
+    void reuse_neighbours(int x, int y);
+    void shade(int x, int y);
+    Vector3D direct_light(const HitResult& hit);
+    Vector3D trace_path(Ray& r, int bounces, bool lights_sampled);
+    bool similar(const HitResult& a, const HitResult& b) const;
+};
+
+
+RestirRenderer::RestirRenderer(World& world, Camera& camera, const RenderSettings& settings, const RestirSettings& restir)
+    : m_world(world), m_camera(camera), m_settings(settings), m_restir(restir) {
+    m_lights.build(world);
+    size_t size = size_t(settings.m_width) * settings.m_height;
+    m_hits.resize(size);
+    m_previousHits.resize(size);
+    m_reservoirs.resize(size);
+    m_spatial.resize(size);
+    m_hasReservoir.assign(size, false);
+    m_previousHasReservoir.assign(size, false);
+    m_color.resize(size);
+    m_sum.assign(size, Vector3D(0, 0, 0));
+}
+
+void RestirRenderer::for_each_row(int step, std::function<void(int y)> row) {
+    int num_threads = m_settings.m_numThreads > 0 ? m_settings.m_numThreads : max(1u, thread::hardware_concurrency());
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int y = next++; y < m_settings.m_height; y = next++) {
+            seed_random(0x9e3779b9u * (y + 1) + 0x85ebca6bu * (m_settings.m_seed + m_passes) + 0xc2b2ae35u * step);
+            row(y);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i)
+        threads.emplace_back(worker);
+    for (auto &thread : threads)
+        thread.join();
+}
+
+void RestirRenderer::render_pass() {
+    m_hits.swap(m_previousHits);
+    m_hasReservoir.swap(m_previousHasReservoir);
+    // The reservoirs of the previous pass are in m_spatial, or in m_reservoirs without spatial reuse
+    if (m_restir.m_spatialNeighbours > 0)
+        m_reservoirs.swap(m_spatial);
+
+    int width = m_settings.m_width;
+    for_each_row(0, [&](int y) {
+        for (int x = 0; x < width; ++x)
+            trace_first_hit(x, y);
+    });
+    if (m_restir.m_spatialNeighbours > 0) {
+        for_each_row(1, [&](int y) {
+            for (int x = 0; x < width; ++x)
+                reuse_neighbours(x, y);
+        });
+    }
+    for_each_row(2, [&](int y) {
+        for (int x = 0; x < width; ++x)
+            shade(x, y);
+    });
+    m_passes++;
+}
+
+void RestirRenderer::write_last_pass(TileSink& sink) const {
+    Tile all = {0, 0, m_settings.m_width, m_settings.m_height};
+    sink.write_tile(all, m_color);
+}
+
+void RestirRenderer::write(TileSink& sink) const {
+    std::vector<Vector3D> pixels(m_sum.size());
+    for (size_t p = 0; p < m_sum.size(); ++p)
+        pixels[p] = m_passes > 0 ? m_sum[p] / float(m_passes) : Vector3D(0, 0, 0);
+    Tile all = {0, 0, m_settings.m_width, m_settings.m_height};
+    sink.write_tile(all, pixels);
+}
+
+// Neighbouring hits on surfaces that face the same way at about the same distance
+bool RestirRenderer::similar(const HitResult& a, const HitResult& b) const {
+    return dot(a.m_hitNormal, b.m_hitNormal) > 0.9f && fabs(a.m_t - b.m_t) < 0.1f * a.m_t;
+}
+
+void RestirRenderer::trace_first_hit(int x, int y) {
+    int width = m_settings.m_width;
+    int height = m_settings.m_height;
+    size_t p = size_t(y) * width + x;
+    m_hasReservoir[p] = false;
+
+    // Rows are counted from the bottom of the image by the camera
+    int j = height - 1 - y;
+    Ray r = m_camera.generate_ray((x + random_float()) / (width - 1), (j + random_float()) / (height - 1));
+    HitResult hit = m_world.hit(r, 0.001, std::numeric_limits<float>::infinity());
+    m_hits[p] = hit;
+
+    if (!hit.m_isHit || !hit.m_hitMaterial->is_diffuse() || m_lights.empty()) {
+        m_color[p] = trace_path(r, m_settings.m_maxLightBounceNum, false);
+        return;
+    }
+
+    // Indirect light now, the direct light once the reservoirs are shared
+    Vector3D dir = uniform_hemisphere_direction(hit.m_hitNormal);
+    Ray next(hit.m_hitPos, dir);
+    m_color[p] = hit.m_hitMaterial->albedo(hit) * trace_path(next, m_settings.m_maxLightBounceNum - 1, true);
+
+    Reservoir reservoir = sample_lights(m_lights, hit.m_hitPos, hit.m_hitNormal, m_restir.m_candidates);
+    // Lights that are hidden from here would only spread shadowed samples to the neighbours
+    if (reservoir.m_weight > 0 && light_contribution(m_lights.m_lights[reservoir.m_light], hit.m_hitPos, hit.m_hitNormal, m_world).length_squared() == 0)
+        reservoir.m_weight = 0;
+
+    if (m_restir.m_temporal && m_previousHasReservoir[p] && similar(hit, m_previousHits[p])) {
+        Reservoir previous = m_reservoirs[p];
+        previous.m_count = fmin(previous.m_count, float(m_restir.m_temporalLimit * m_restir.m_candidates));
+        Reservoir merged;
+        merged.update(reservoir.m_light, light_target(m_lights.m_lights[reservoir.m_light], hit.m_hitPos, hit.m_hitNormal) * reservoir.m_weight * reservoir.m_count, reservoir.m_count);
+        merged.update(previous.m_light, light_target(m_lights.m_lights[previous.m_light], hit.m_hitPos, hit.m_hitNormal) * previous.m_weight * previous.m_count, previous.m_count);
+        merged.finalize(light_target(m_lights.m_lights[merged.m_light], hit.m_hitPos, hit.m_hitNormal));
+        reservoir = merged;
+    }
+    m_reservoirs[p] = reservoir;
+    m_hasReservoir[p] = true;
+}
+
+void RestirRenderer::reuse_neighbours(int x, int y) {
+    int width = m_settings.m_width;
+    int height = m_settings.m_height;
+    size_t p = size_t(y) * width + x;
+    if (!m_hasReservoir[p])
+        return;
+    const HitResult& hit = m_hits[p];
+    auto target = [&](uint32_t light) { return light_target(m_lights.m_lights[light], hit.m_hitPos, hit.m_hitNormal); };
+
+    // Reservoirs are read from m_reservoirs and written to m_spatial, so pixels do not see each other's result
+    Reservoir merged;
+    const Reservoir& own = m_reservoirs[p];
+    merged.update(own.m_light, target(own.m_light) * own.m_weight * own.m_count, own.m_count);
+    for (int k = 0; k < m_restir.m_spatialNeighbours; ++k) {
+        float radius = m_restir.m_spatialRadius * sqrt(random_float());
+        float angle = 2 * M_PI * random_float();
+        int nx = x + int(round(radius * cos(angle)));
+        int ny = y + int(round(radius * sin(angle)));
+        if (nx < 0 || ny < 0 || nx >= width || ny >= height || (nx == x && ny == y))
+            continue;
+        size_t q = size_t(ny) * width + nx;
+        if (!m_hasReservoir[q] || !similar(hit, m_hits[q]))
+            continue;
+        const Reservoir& neighbour = m_reservoirs[q];
+        merged.update(neighbour.m_light, target(neighbour.m_light) * neighbour.m_weight * neighbour.m_count, neighbour.m_count);
+    }
+    merged.finalize(target(merged.m_light));
+    m_spatial[p] = merged;
+}
+
+void RestirRenderer::shade(int x, int y) {
+    size_t p = size_t(y) * m_settings.m_width + x;
+    Vector3D color = m_color[p];
+    if (m_hasReservoir[p]) {
+        const Reservoir& reservoir = m_restir.m_spatialNeighbours > 0 ? m_spatial[p] : m_reservoirs[p];
+        const HitResult& hit = m_hits[p];
+        if (reservoir.m_weight > 0)
+            color += reservoir.m_weight * hit.m_hitMaterial->albedo(hit) *
+                     light_contribution(m_lights.m_lights[reservoir.m_light], hit.m_hitPos, hit.m_hitNormal, m_world);
+    }
+    // Dropping NaNs keeps one bad path from spoiling the pixel for every later pass
+    if (color.x() != color.x() || color.y() != color.y() || color.z() != color.z())
+        color = Vector3D(0, 0, 0);
+    m_color[p] = color;
+    m_sum[p] += color;
+}
+
+// Light of a single light resampled from new candidates, for hits after the first
+Vector3D RestirRenderer::direct_light(const HitResult& hit) {
+    Reservoir reservoir = sample_lights(m_lights, hit.m_hitPos, hit.m_hitNormal, m_restir.m_candidates);
+    if (reservoir.m_weight <= 0)
+        return Vector3D(0, 0, 0);
+    return reservoir.m_weight * light_contribution(m_lights.m_lights[reservoir.m_light], hit.m_hitPos, hit.m_hitNormal, m_world);
+}
+
+// Like ray_hit_color, with the lights of m_lights sampled at every diffuse hit
+// lights_sampled tells that r leaves a diffuse hit that sampled them already,
+// so the lights it reaches add nothing
+Vector3D RestirRenderer::trace_path(Ray& r, int bounces, bool lights_sampled) {
+    if (bounces <= 0)
+        return Vector3D(0, 0, 0);
+    HitResult hit = m_world.hit(r, 0.001, std::numeric_limits<float>::infinity());
+    if (!hit.m_isHit)
+        return background(r, m_world);
+
+    Material* material = hit.m_hitMaterial.get();
+    if (material->is_emissive())
+        return lights_sampled && m_lights.is_light(material) ? Vector3D(0, 0, 0) : material->m_color;
+    if (material->is_diffuse() && !m_lights.empty()) {
+        Vector3D dir = uniform_hemisphere_direction(hit.m_hitNormal);
+        Ray next(hit.m_hitPos, dir);
+        return material->albedo(hit) * (direct_light(hit) + trace_path(next, bounces - 1, true));
+    }
+    ReflectResult res = material->reflect(r, hit);
+    return res.m_color * trace_path(res.m_ray, bounces - 1, false);
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef SHAPES_H
+#define SHAPES_H
+
+#include <memory>
+#include <limits>
+
+#include "Sphere.h"
+#include "AABB.h"
+
+using namespace std;
+
+class Material;
+
+// Analytic surface other than a sphere
+class Shape {
+public:
+    shared_ptr<Material> m_pMaterial;
+
+    virtual ~Shape() {}
+    virtual HitResult hit(Ray& ray, float min_t, float max_t) = 0;
+    // Box around the shape, infinite for shapes without bounds such as planes
+    virtual AABB bounds() const = 0;
+
+    bool is_bounded() const {
+        AABB box = bounds();
+        return std::isfinite(box.m_min.x()) && std::isfinite(box.m_min.y()) && std::isfinite(box.m_min.z()) &&
+               std::isfinite(box.m_max.x()) && std::isfinite(box.m_max.y()) && std::isfinite(box.m_max.z());
+    }
+};
+
+
+// Infinite plane through m_point, seen from both sides
+class Plane : public Shape {
+public:
+    Vector3D m_point;
+    Vector3D m_normal;
+
+    Plane(Vector3D point, Vector3D normal, shared_ptr<Material> m) {
+        m_point = point;
+        m_normal = normalize(normal);
+        m_pMaterial = m;
+    }
+
+    virtual HitResult hit(Ray& ray, float min_t, float max_t) override;
+    virtual AABB bounds() const override;
+};
+
+
+// Flat disk of m_radius around m_center, seen from both sides
+class Disk : public Shape {
+public:
+    Vector3D m_center;
+    Vector3D m_normal;
+    float m_radius;
+
+    Disk(Vector3D center, Vector3D normal, float r, shared_ptr<Material> m) {
+        m_center = center;
+        m_normal = normalize(normal);
+        m_radius = r;
+        m_pMaterial = m;
+    }
+
+    virtual HitResult hit(Ray& ray, float min_t, float max_t) override;
+    virtual AABB bounds() const override;
+};
+
+
+// Axis aligned box between m_min and m_max
+class Box : public Shape {
+public:
+    Vector3D m_min;
+    Vector3D m_max;
+
+    Box(Vector3D min, Vector3D max, shared_ptr<Material> m) {
+        m_min = min;
+        m_max = max;
+        m_pMaterial = m;
+    }
+
+    virtual HitResult hit(Ray& ray, float min_t, float max_t) override;
+    virtual AABB bounds() const override { return AABB(m_min, m_max); }
+};
+
+
+// Test if ray hits the plane through point with normal within range min_t and max_t
+bool hit_plane(Ray& ray, const Vector3D& point, const Vector3D& normal, float min_t, float max_t, float& t) {
+    float denominator = dot(ray.direction(), normal);
+    // Parallel rays never hit, even when they lie in the plane
+    if (denominator == 0)
+        return false;
+    t = dot(point - ray.origin(), normal) / denominator;
+    return min_t <= t && t <= max_t;
+}
+
+// The normal of a flat surface, turned towards the ray
+Vector3D facing_normal(Ray& ray, const Vector3D& normal) {
+    return dot(ray.direction(), normal) > 0 ? -normal : normal;
+}
+
+HitResult Plane::hit(Ray& ray, float min_t, float max_t) {
+    HitResult hit_result;
+    hit_result.m_isHit = hit_plane(ray, m_point, m_normal, min_t, max_t, hit_result.m_t);
+    if (hit_result.m_isHit) {
+        hit_result.m_hitPos = ray.at(hit_result.m_t);
+        hit_result.m_hitNormal = facing_normal(ray, m_normal);
+        hit_result.m_hitMaterial = m_pMaterial;
+    }
+    return hit_result;
+}
+
+AABB Plane::bounds() const {
+    // Planes along an axis stay thin along it, which does not make them bounded
+    float inf = std::numeric_limits<float>::infinity();
+    return AABB(Vector3D(-inf, -inf, -inf), Vector3D(inf, inf, inf));
+}
+
+HitResult Disk::hit(Ray& ray, float min_t, float max_t) {
+    HitResult hit_result;
+    float t;
+    if (hit_plane(ray, m_center, m_normal, min_t, max_t, t) && (ray.at(t) - m_center).length_squared() <= m_radius * m_radius) {
+        hit_result.m_isHit = true;
+        hit_result.m_t = t;
+        hit_result.m_hitPos = ray.at(t);
+        hit_result.m_hitNormal = facing_normal(ray, m_normal);
+        hit_result.m_hitMaterial = m_pMaterial;
+    }
+    return hit_result;
+}
+
+AABB Disk::bounds() const {
+    // Extent of the rim along each axis
+    float ex = m_radius * sqrt(fmax(0, 1 - m_normal.x() * m_normal.x()));
+    float ey = m_radius * sqrt(fmax(0, 1 - m_normal.y() * m_normal.y()));
+    float ez = m_radius * sqrt(fmax(0, 1 - m_normal.z() * m_normal.z()));
+    Vector3D e(ex, ey, ez);
+    return AABB(m_center - e, m_center + e);
+}
+
+HitResult Box::hit(Ray& ray, float min_t, float max_t) {
+    HitResult hit_result;
+    Vector3D origin = ray.origin();
+    Vector3D inv_dir = inverse_direction(ray);
+
+    // Slab test that keeps the axis of the entry and exit faces
+    float t_near = -std::numeric_limits<float>::infinity(), t_far = std::numeric_limits<float>::infinity();
+    int near_axis = 0, far_axis = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        float t0 = (component(m_min, axis) - component(origin, axis)) * component(inv_dir, axis);
+        float t1 = (component(m_max, axis) - component(origin, axis)) * component(inv_dir, axis);
+        if (t0 > t1)
+            swap(t0, t1);
+        if (t0 > t_near) {
+            t_near = t0;
+            near_axis = axis;
+        }
+        if (t1 < t_far) {
+            t_far = t1;
+            far_axis = axis;
+        }
+    }
+    if (t_near > t_far)
+        return hit_result;
+
+    // The entry face, or the exit face for rays starting inside
+    bool inside = t_near < min_t;
+    float t = inside ? t_far : t_near;
+    int axis = inside ? far_axis : near_axis;
+    if (t < min_t || t > max_t)
+        return hit_result;
+
+    // Outwards, like a sphere's normal: against the ray where it enters, along it where it leaves
+    float n[3] = {0, 0, 0};
+    bool positive = component(ray.direction(), axis) > 0;
+    n[axis] = positive == inside ? 1 : -1;
+
+    hit_result.m_isHit = true;
+    hit_result.m_t = t;
+    hit_result.m_hitPos = ray.at(t);
+    hit_result.m_hitNormal = Vector3D(n[0], n[1], n[2]);
+    hit_result.m_hitMaterial = m_pMaterial;
+    return hit_result;
+}
+
+#endif
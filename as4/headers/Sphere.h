@@ -14,6 +14,10 @@ public:
     Vector3D m_hitNormal;
     shared_ptr<Material> m_hitMaterial;
     float m_t;
+    // Texture coordinates, and the width of the ray's cone at the hit in texture
+    // coordinates, for surfaces that have them
+    float m_u = 0, m_v = 0;
+    float m_footprint = 0;
 };
 
 
@@ -36,38 +40,41 @@ public:
 };
 
 
-// Test if ray hits this sphere within range min_t and max_t
-HitResult Sphere::hit(Ray& ray, float min_t, float max_t) {
-    HitResult hit_result;
-    
+// Test if ray hits a sphere within range min_t and max_t, t receives the nearest hit
+bool hit_sphere(Ray& ray, const Vector3D& center, float radius, float min_t, float max_t, float& t) {
     // o - c
-    Vector3D oc = ray.origin() - m_center;
+    Vector3D oc = ray.origin() - center;
     // d . (o - c)
     float half_b = dot(ray.direction(), oc);
     // d . d (a) = 1 since d is normalized
     // (o - c) . (o - c) - r^2
-    float c = oc.length_squared() - m_radius * m_radius;
+    float c = oc.length_squared() - radius * radius;
     // (b / 2)^2 - ac
     float discriminant = half_b * half_b - c;
 
     // Check if an intersection exists
-    if (discriminant >= 0) {
+    if (discriminant < 0)
+        return false;
 
-        // If t1 is within range
-        float t1 = (-half_b - sqrt(discriminant));
-        if (min_t <= t1 && t1 <= max_t) {
-            hit_result.m_isHit = true;
-            hit_result.m_t = t1;
-        }
-        // If t1 is out of range but t2 is within range
-        else {
-            float t2 = (-half_b + sqrt(discriminant));
-            if (min_t <= t2 && t2 <= max_t) {
-                hit_result.m_isHit = true;
-                hit_result.m_t = t2;
-            }
-        }
+    // If t1 is within range
+    float t1 = (-half_b - sqrt(discriminant));
+    if (min_t <= t1 && t1 <= max_t) {
+        t = t1;
+        return true;
+    }
+    // If t1 is out of range but t2 is within range
+    float t2 = (-half_b + sqrt(discriminant));
+    if (min_t <= t2 && t2 <= max_t) {
+        t = t2;
+        return true;
     }
+    return false;
+}
+
+// Test if ray hits this sphere within range min_t and max_t
+HitResult Sphere::hit(Ray& ray, float min_t, float max_t) {
+    HitResult hit_result;
+    hit_result.m_isHit = hit_sphere(ray, m_center, m_radius, min_t, max_t, hit_result.m_t);
 
     // When a hit exists, compute other attributes
     if (hit_result.m_isHit) {
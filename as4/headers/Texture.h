@@ -0,0 +1,261 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "Vector3D.h"
+#include "Sphere.h"
+#include "Material.h"
+
+// JPEG and PNG textures need stb_image, which as3 also reads from the root of the repository
+#if __has_include("../../stb_image.h")
+#define STB_IMAGE_IMPLEMENTATION
+#include "../../stb_image.h"
+#define TEXTURE_HAS_STB_IMAGE 1
+#endif
+
+using namespace std;
+
+// Colour texture read by the tracer, with its mip levels stored tile by tile
+// Each level is cut into 8x8 texel tiles of 256 bytes, and the texels of a tile
+// are laid out along a Morton curve, so the 2x2 texels of a bilinear lookup are
+// nearly always in the same tile and usually in the same cache line. Rays after
+// a bounce are wide and read coarse levels, small enough to stay in cache however
+// scattered the rays are
+// Texels are kept as 8 bit sRGB, as decoded, and turned into linear colour when read
+class Texture {
+public:
+    // Decode an image file and build its levels, returns false if it cannot be read
+    // Binary ppm is always read, JPEG and PNG only when stb_image is available
+    bool load(const string& path);
+    // Build from 8 bit sRGB, 3 bytes per texel, rows from the top
+    void build(int width, int height, const unsigned char* rgb);
+
+    bool empty() const { return m_levels.empty(); }
+    int width() const { return m_levels[0].m_width; }
+    int height() const { return m_levels[0].m_height; }
+    int level_count() const { return static_cast<int>(m_levels.size()); }
+    size_t memory_bytes() const;
+
+    // Linear colour at (u, v) for a lookup footprint wide in texture coordinates,
+    // filtered between the two levels closest to that width, repeating outside [0, 1]
+    // v runs up from the bottom of the image, as in OBJ files
+    Vector3D sample(float u, float v, float footprint) const;
+    // Bilinear lookup in one level
+    Vector3D bilinear(int level, float u, float v) const;
+    // Linear colour of one texel, coordinates wrap around
+    Vector3D texel(int level, int x, int y) const;
+
+private:
+    static const int tile_bits = 3;
+    static const int tile_size = 1 << tile_bits;
+
+    struct Level {
+        int m_width, m_height;
+        int m_tilesX;
+        vector<uint32_t> m_texels;
+    };
+    vector<Level> m_levels;
+
+    static uint32_t tile_offset(int x, int y);
+    // Index of texel (x, y) is the sum of a part from x and a part from y
+    static uint32_t column_offset(int x) { return ((x >> tile_bits) << (2 * tile_bits)) | tile_offset(x & (tile_size - 1), 0); }
+    static size_t row_offset(const Level& level, int y) { return ((size_t(y >> tile_bits) * level.m_tilesX) << (2 * tile_bits)) | tile_offset(0, y & (tile_size - 1)); }
+    uint32_t fetch(const Level& level, int x, int y) const;
+    static void store(Level& level, int x, int y, uint32_t rgb);
+    static Level make_level(int width, int height);
+};
+
+
+// Linear value of every 8 bit sRGB value
+vector<float> make_srgb_table() {
+    vector<float> table(256);
+    for (int i = 0; i < 256; ++i) {
+        float c = i / 255.0f;
+        table[i] = c <= 0.04045f ? c / 12.92f : pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return table;
+}
+
+const vector<float> srgb_table = make_srgb_table();
+
+unsigned char linear_to_srgb(float c) {
+    c = c <= 0.0031308f ? 12.92f * c : 1.055f * pow(c, 1 / 2.4f) - 0.055f;
+    return static_cast<unsigned char>(clamp(c * 255 + 0.5f, 0, 255));
+}
+
+// Texel (x, y) of its tile, x and y interleaved bit by bit
+uint32_t Texture::tile_offset(int x, int y) {
+    // The bits of 0 to 7 spread out to every other bit
+    static const uint8_t spread[tile_size] = {0, 1, 4, 5, 16, 17, 20, 21};
+    return spread[x] | (spread[y] << 1);
+}
+
+Texture::Level Texture::make_level(int width, int height) {
+    Level level;
+    level.m_width = width;
+    level.m_height = height;
+    level.m_tilesX = (width + tile_size - 1) / tile_size;
+    int tiles_y = (height + tile_size - 1) / tile_size;
+    level.m_texels.assign(size_t(level.m_tilesX) * tiles_y * tile_size * tile_size, 0);
+    return level;
+}
+
+void Texture::store(Level& level, int x, int y, uint32_t rgb) {
+    size_t tile = size_t(y >> tile_bits) * level.m_tilesX + (x >> tile_bits);
+    level.m_texels[(tile << (2 * tile_bits)) + tile_offset(x & (tile_size - 1), y & (tile_size - 1))] = rgb;
+}
+
+uint32_t Texture::fetch(const Level& level, int x, int y) const {
+    size_t tile = size_t(y >> tile_bits) * level.m_tilesX + (x >> tile_bits);
+    return level.m_texels[(tile << (2 * tile_bits)) + tile_offset(x & (tile_size - 1), y & (tile_size - 1))];
+}
+
+void Texture::build(int width, int height, const unsigned char* rgb) {
+    m_levels.clear();
+    Level base = make_level(width, height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const unsigned char* c = rgb + 3 * (size_t(y) * width + x);
+            store(base, x, y, c[0] | (c[1] << 8) | (c[2] << 16));
+        }
+    }
+    m_levels.push_back(std::move(base));
+
+    // Each level averages 2x2 texels of the one above in linear colour, odd sizes round down
+    const float* linear = srgb_table.data();
+    while (m_levels.back().m_width > 1 || m_levels.back().m_height > 1) {
+        const Level& above = m_levels.back();
+        Level level = make_level(max(1, above.m_width / 2), max(1, above.m_height / 2));
+        for (int y = 0; y < level.m_height; ++y) {
+            for (int x = 0; x < level.m_width; ++x) {
+                float sum[3] = {0, 0, 0};
+                for (int k = 0; k < 4; ++k) {
+                    int sx = min(2 * x + (k & 1), above.m_width - 1);
+                    int sy = min(2 * y + (k >> 1), above.m_height - 1);
+                    uint32_t c = fetch(above, sx, sy);
+                    for (int i = 0; i < 3; ++i)
+                        sum[i] += linear[(c >> (8 * i)) & 255];
+                }
+                store(level, x, y, linear_to_srgb(sum[0] / 4) | (linear_to_srgb(sum[1] / 4) << 8) | (linear_to_srgb(sum[2] / 4) << 16));
+            }
+        }
+        m_levels.push_back(std::move(level));
+    }
+}
+
+// Binary ppm with 255 as its largest value
+bool read_ppm(const string& path, int& width, int& height, vector<unsigned char>& rgb) {
+    ifstream fin(path, ios::binary);
+    string magic;
+    int max_value;
+    if (!(fin >> magic >> width >> height >> max_value) || magic != "P6" || max_value != 255 || width <= 0 || height <= 0)
+        return false;
+    fin.get();
+    rgb.resize(size_t(width) * height * 3);
+    fin.read(reinterpret_cast<char*>(rgb.data()), rgb.size());
+    return bool(fin);
+}
+
+bool Texture::load(const string& path) {
+    int width, height;
+    vector<unsigned char> rgb;
+    if (read_ppm(path, width, height, rgb)) {
+        build(width, height, rgb.data());
+        return true;
+    }
+#ifdef TEXTURE_HAS_STB_IMAGE
+    int channels;
+    stbi_set_flip_vertically_on_load(false);
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 3);
+    if (data) {
+        build(width, height, data);
+        stbi_image_free(data);
+        return true;
+    }
+#endif
+    return false;
+}
+
+size_t Texture::memory_bytes() const {
+    size_t bytes = 0;
+    for (auto &level : m_levels)
+        bytes += level.m_texels.size() * sizeof(uint32_t);
+    return bytes;
+}
+
+Vector3D Texture::texel(int level, int x, int y) const {
+    const Level& l = m_levels[level];
+    // Repeat, also for negative coordinates
+    x %= l.m_width;
+    y %= l.m_height;
+    if (x < 0) x += l.m_width;
+    if (y < 0) y += l.m_height;
+    uint32_t c = fetch(l, x, y);
+    const float* linear = srgb_table.data();
+    return Vector3D(linear[c & 255], linear[(c >> 8) & 255], linear[(c >> 16) & 255]);
+}
+
+Vector3D Texture::bilinear(int level, float u, float v) const {
+    const Level& l = m_levels[level];
+    u -= floor(u);
+    v -= floor(v);
+    // Texel centres sit at half integers, rows start from the top
+    float x = u * l.m_width - 0.5f;
+    float y = (1 - v) * l.m_height - 0.5f;
+    // x and y are in [-0.5, size - 0.5], so truncating one more is a floor and
+    // wrapping only takes a comparison
+    int x0 = int(x + 1) - 1, y0 = int(y + 1) - 1;
+    float ax = x - x0, ay = y - y0;
+    if (x0 < 0) x0 += l.m_width;
+    if (y0 < 0) y0 += l.m_height;
+    x0 = min(x0, l.m_width - 1);
+    y0 = min(y0, l.m_height - 1);
+    int x1 = x0 + 1 < l.m_width ? x0 + 1 : 0;
+    int y1 = y0 + 1 < l.m_height ? y0 + 1 : 0;
+
+    const float* linear = srgb_table.data();
+    const uint32_t* texels = l.m_texels.data();
+    size_t row0 = row_offset(l, y0), row1 = row_offset(l, y1);
+    uint32_t column0 = column_offset(x0), column1 = column_offset(x1);
+    uint32_t c[4] = {texels[row0 + column0], texels[row0 + column1], texels[row1 + column0], texels[row1 + column1]};
+    float w[4] = {(1 - ax) * (1 - ay), ax * (1 - ay), (1 - ax) * ay, ax * ay};
+    float rgb[3] = {0, 0, 0};
+    for (int k = 0; k < 4; ++k)
+        for (int i = 0; i < 3; ++i)
+            rgb[i] += w[k] * linear[(c[k] >> (8 * i)) & 255];
+    return Vector3D(rgb[0], rgb[1], rgb[2]);
+}
+
+Vector3D Texture::sample(float u, float v, float footprint) const {
+    float lod = footprint > 0 ? log2(footprint * sqrt(float(width()) * height())) : 0;
+    if (lod <= 0)
+        return bilinear(0, u, v);
+    int top = level_count() - 1;
+    if (lod >= top)
+        return bilinear(top, u, v);
+    int level = int(lod);
+    float a = lod - level;
+    return (1 - a) * bilinear(level, u, v) + a * bilinear(level + 1, u, v);
+}
+
+
+// Diffuse surface whose colour is m_color times a texture
+class TexturedDiffuse : public Diffuse {
+public:
+    shared_ptr<Texture> m_texture;
+
+    TexturedDiffuse(shared_ptr<Texture> texture, const Vector3D& color = Vector3D(1, 1, 1)) : Diffuse(color), m_texture(texture) {}
+
+    virtual Vector3D albedo(const HitResult& hit) override {
+        return m_color * m_texture->sample(hit.m_u, hit.m_v, hit.m_footprint);
+    }
+};
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef TRIANGLEMESH_H
+#define TRIANGLEMESH_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <cstdlib>
+
+#include "Sphere.h"
+#include "BVH.h"
+#include "LBVH.h"
+#include "../../mesh_store.h"
+
+using namespace std;
+
+class Material;
+
+// Indexed triangle mesh with one smooth normal per position
+// The positions keep the order of the "v" lines of the OBJ they were read from,
+// so anything computed per position can be matched back to that file
+// A mesh can also trace a MeshStore shared with the as2 and as3 viewers, see share()
+class TriangleMesh {
+public:
+    vector<Vector3D> m_positions;
+    vector<Vector3D> m_normals;
+    // Three position indices per triangle
+    vector<uint32_t> m_indices;
+    // Texture coordinates of every corner, u and v, in the order of m_indices
+    // OBJ files give them per corner rather than per position, so seams keep both sides
+    // Empty when the file has none
+    vector<float> m_uvs;
+    // Store the mesh reads in place of the vectors above, null for meshes read by load_obj
+    // Its vertices are split where texture coordinates or normals differ, as a viewer draws them
+    shared_ptr<const MeshStore> m_store;
+    shared_ptr<Material> m_pMaterial;
+    // Hierarchy over the triangles, rebuilt by load_obj and build_bvh
+    // Meshes that deform every frame can rebuild it with an LBVHBuilder or just refit it
+    BVH m_bvh;
+
+    TriangleMesh() {}
+    TriangleMesh(shared_ptr<Material> m) { m_pMaterial = m; }
+
+    size_t triangle_count() const { return indices().size() / 3; }
+    // Positions, normals and indices, from the store or the vectors
+    Span<const Vector3D> positions() const;
+    Span<const Vector3D> normals() const;
+    Span<const uint32_t> indices() const;
+
+    // Read the positions, texture coordinates and faces of an OBJ file, polygons are split into fans
+    // Normals are averaged from the faces rather than read, returns false if the file cannot be read
+    // or a face has an index that is not a number or out of range
+    bool load_obj(const string& path);
+    // Trace store without copying it, the vectors above are cleared, apart from m_normals
+    // when the store has no normals. Returns false if its indices are out of range
+    bool share(shared_ptr<const MeshStore> store);
+    void compute_normals();
+    vector<AABB> triangle_bounds() const;
+    void build_bvh();
+    void build_bvh(LBVHBuilder& builder);
+    // Keep the tree and update its boxes, for positions that moved but kept their triangles
+    void refit_bvh();
+
+    HitResult hit(Ray& ray, float min_t, float max_t);
+};
+
+
+// Moller-Trumbore ray triangle test, t receives the distance and (u, v) the
+// barycentric coordinates of the hit relative to p1 and p2
+bool hit_triangle(Ray& ray, const Vector3D& p0, const Vector3D& p1, const Vector3D& p2,
+                  float min_t, float max_t, float& t, float& u, float& v) {
+    Vector3D e1 = p1 - p0;
+    Vector3D e2 = p2 - p0;
+    Vector3D p = cross(ray.direction(), e2);
+    float det = dot(e1, p);
+    if (fabs(det) < 1e-12)
+        return false;
+
+    float inv_det = 1 / det;
+    Vector3D s = ray.origin() - p0;
+    u = dot(s, p) * inv_det;
+    if (u < 0 || u > 1)
+        return false;
+    Vector3D q = cross(s, e1);
+    v = dot(ray.direction(), q) * inv_det;
+    if (v < 0 || u + v > 1)
+        return false;
+
+    t = dot(e2, q) * inv_det;
+    return min_t <= t && t <= max_t;
+}
+
+// The float triples of a store are read as Vector3D
+static_assert(sizeof(Vector3D) == 3 * sizeof(float), "Vector3D must be three packed floats");
+
+Span<const Vector3D> TriangleMesh::positions() const {
+    if (m_store)
+        return Span<const Vector3D>(reinterpret_cast<const Vector3D*>(m_store->positions.data()), m_store->vertexCount());
+    return m_positions;
+}
+
+Span<const Vector3D> TriangleMesh::normals() const {
+    if (m_store && !m_store->normals.empty())
+        return Span<const Vector3D>(reinterpret_cast<const Vector3D*>(m_store->normals.data()), m_store->vertexCount());
+    return m_normals;
+}
+
+Span<const uint32_t> TriangleMesh::indices() const {
+    if (m_store)
+        return m_store->indices;
+    return m_indices;
+}
+
+bool TriangleMesh::share(shared_ptr<const MeshStore> store) {
+    for (uint32_t index : store->indices)
+        if (index >= store->vertexCount())
+            return false;
+    m_store = store;
+    m_positions.clear();
+    m_indices.clear();
+    m_uvs.clear();
+    m_normals.clear();
+    if (store->normals.empty())
+        compute_normals();
+    build_bvh();
+    return true;
+}
+
+bool TriangleMesh::load_obj(const string& path) {
+    ifstream fin(path);
+    if (!fin)
+        return false;
+
+    m_store.reset();
+    m_positions.clear();
+    m_indices.clear();
+    m_uvs.clear();
+    string line;
+    vector<uint32_t> face;
+    vector<float> texcoords;
+    // Index into texcoords of every corner of the face, -1 for none
+    vector<long> face_uvs;
+    bool all_uvs = true;
+    // A number ending the corner or followed by '/', false for "f a/b", a bare "/" and the like
+    auto parse_index = [](const char* text, long& index) {
+        char* end;
+        index = strtol(text, &end, 10);
+        return end != text && (*end == '\0' || *end == '/');
+    };
+    while (getline(fin, line)) {
+        istringstream in(line);
+        string type;
+        in >> type;
+        if (type == "v") {
+            float x, y, z;
+            in >> x >> y >> z;
+            m_positions.push_back(Vector3D(x, y, z));
+        }
+        else if (type == "vt") {
+            float u = 0, v = 0;
+            in >> u >> v;
+            texcoords.push_back(u);
+            texcoords.push_back(v);
+        }
+        else if (type == "f") {
+            // Corners are "v", "v/vt", "v//vn" or "v/vt/vn", vn is not needed
+            face.clear();
+            face_uvs.clear();
+            string corner;
+            while (in >> corner) {
+                size_t slash = corner.find('/');
+                long index;
+                if (!parse_index(corner.c_str(), index))
+                    return false;
+                // Negative indices count back from the last position or texture coordinate read
+                face.push_back(static_cast<uint32_t>(index > 0 ? index - 1 : long(m_positions.size()) + index));
+                long uv = -1;
+                if (slash != string::npos && slash + 1 < corner.size() && corner[slash + 1] != '/') {
+                    long vt;
+                    if (!parse_index(corner.c_str() + slash + 1, vt))
+                        return false;
+                    uv = vt > 0 ? vt - 1 : long(texcoords.size() / 2) + vt;
+                }
+                face_uvs.push_back(uv);
+                all_uvs = all_uvs && uv >= 0 && size_t(uv) < texcoords.size() / 2;
+            }
+            for (size_t k = 2; k < face.size(); ++k) {
+                for (size_t c : {size_t(0), k - 1, k}) {
+                    m_indices.push_back(face[c]);
+                    if (all_uvs) {
+                        m_uvs.push_back(texcoords[2 * face_uvs[c]]);
+                        m_uvs.push_back(texcoords[2 * face_uvs[c] + 1]);
+                    }
+                }
+            }
+        }
+    }
+
+    for (uint32_t index : m_indices)
+        if (index >= m_positions.size())
+            return false;
+    // Texture coordinates are all or nothing
+    if (!all_uvs)
+        m_uvs.clear();
+
+    compute_normals();
+    build_bvh();
+    return true;
+}
+
+void TriangleMesh::compute_normals() {
+    // The cross product is twice the triangle's area, so larger faces weigh more
+    Span<const Vector3D> p = positions();
+    Span<const uint32_t> idx = indices();
+    m_normals.assign(p.size(), Vector3D(0, 0, 0));
+    for (size_t i = 0; i < idx.size(); i += 3) {
+        const Vector3D& p0 = p[idx[i]];
+        Vector3D n = cross(p[idx[i + 1]] - p0, p[idx[i + 2]] - p0);
+        for (int k = 0; k < 3; ++k)
+            m_normals[idx[i + k]] += n;
+    }
+    for (auto &n : m_normals)
+        if (n.length_squared() > 0)
+            n = normalize(n);
+}
+
+vector<AABB> TriangleMesh::triangle_bounds() const {
+    Span<const Vector3D> p = positions();
+    Span<const uint32_t> idx = indices();
+    vector<AABB> bounds(triangle_count());
+    for (size_t i = 0; i < bounds.size(); ++i)
+        for (int k = 0; k < 3; ++k)
+            bounds[i].grow(p[idx[3 * i + k]]);
+    return bounds;
+}
+
+void TriangleMesh::build_bvh() {
+    m_bvh.build(triangle_bounds());
+}
+
+void TriangleMesh::build_bvh(LBVHBuilder& builder) {
+    builder.build(triangle_bounds(), m_bvh);
+}
+
+void TriangleMesh::refit_bvh() {
+    m_bvh.refit(triangle_bounds());
+}
+
+HitResult TriangleMesh::hit(Ray& ray, float min_t, float max_t) {
+    HitResult hit_result;
+    uint32_t hit_triangle_index = 0;
+    float hit_u = 0, hit_v = 0;
+    Span<const Vector3D> positions = this->positions();
+    Span<const uint32_t> indices = this->indices();
+    m_bvh.traverse(ray, min_t, max_t, [&](uint32_t index, float& closest_t) {
+        float t, u, v;
+        const uint32_t* tri = &indices[3 * index];
+        if (hit_triangle(ray, positions[tri[0]], positions[tri[1]], positions[tri[2]], min_t, closest_t, t, u, v)) {
+            closest_t = t;
+            hit_result.m_isHit = true;
+            hit_result.m_t = t;
+            hit_triangle_index = index;
+            hit_u = u;
+            hit_v = v;
+        }
+    });
+
+    // When a hit exists, interpolate the normal and turn it towards the ray
+    if (hit_result.m_isHit) {
+        const uint32_t* tri = &indices[3 * hit_triangle_index];
+        Span<const Vector3D> normals = this->normals();
+        Vector3D normal = (1 - hit_u - hit_v) * normals[tri[0]] + hit_u * normals[tri[1]] + hit_v * normals[tri[2]];
+        if (normal.length_squared() == 0)
+            normal = cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+        normal = normalize(normal);
+        if (dot(normal, ray.direction()) > 0)
+            normal = -normal;
+
+        hit_result.m_hitPos = ray.at(hit_result.m_t);
+        hit_result.m_hitNormal = normal;
+        hit_result.m_hitMaterial = m_pMaterial;
+
+        // A store keeps u and v per vertex, the mesh per corner
+        float corner_uvs[6];
+        const float* uv = nullptr;
+        if (m_store && !m_store->texcoords.empty()) {
+            for (int k = 0; k < 3; ++k) {
+                corner_uvs[2 * k] = m_store->texcoords[2 * tri[k]];
+                corner_uvs[2 * k + 1] = m_store->texcoords[2 * tri[k] + 1];
+            }
+            uv = corner_uvs;
+        }
+        else if (!m_uvs.empty()) {
+            uv = &m_uvs[6 * hit_triangle_index];
+        }
+        if (uv) {
+            float w = 1 - hit_u - hit_v;
+            hit_result.m_u = w * uv[0] + hit_u * uv[2] + hit_v * uv[4];
+            hit_result.m_v = w * uv[1] + hit_u * uv[3] + hit_v * uv[5];
+
+            // The cone's width across the surface, scaled by how much texture the triangle
+            // holds per unit of area, as in Akenine-Moller et al., "Texture level of detail
+            // strategies for real-time ray tracing", 2019
+            Vector3D e1 = positions[tri[1]] - positions[tri[0]];
+            Vector3D e2 = positions[tri[2]] - positions[tri[0]];
+            Vector3D face_normal = cross(e1, e2);
+            float area = face_normal.length();
+            float uv_area = fabs((uv[2] - uv[0]) * (uv[5] - uv[1]) - (uv[4] - uv[0]) * (uv[3] - uv[1]));
+            float width = ray.m_coneWidth + ray.m_coneSpread * hit_result.m_t;
+            float cos_theta = area > 0 ? fabs(dot(ray.direction(), face_normal)) / area : 1;
+            hit_result.m_footprint = area > 0 ? width * sqrt(uv_area / area) / fmax(cos_theta, 0.05f) : 0;
+        }
+    }
+
+    return hit_result;
+}
+
+#endif
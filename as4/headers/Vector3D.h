@@ -2,6 +2,7 @@
 #define VECTOR3D_H
 
 #include <cmath>
+#include <random>
 
 float clamp(float x, float min, float max) {
     if (x < min) return min;
@@ -9,8 +10,19 @@ float clamp(float x, float min, float max) {
     return x;
 }
 
+// Every thread draws from its own generator, rand() would serialize the render threads
+std::mt19937& random_engine() {
+    thread_local std::mt19937 engine;
+    return engine;
+}
+
+void seed_random(unsigned int seed) {
+    random_engine().seed(seed);
+}
+
 float random_float(/*[0,1)*/) {
-    return rand() / (RAND_MAX + 1.0);
+    // Keep 24 bits so the result is exactly representable and never rounds up to 1
+    return (random_engine()() >> 8) * (1.0f / 16777216.0f);
 }
 
 float random_float(float min, float max) {
@@ -125,6 +137,11 @@ Vector3D cross(const Vector3D &u, const Vector3D &v) {
                 u.m_x * v.m_y - u.m_y * v.m_x);
 }
 
+// Component c of v, 0 for x, 1 for y and 2 for z
+float component(const Vector3D& v, int c) {
+    return c == 0 ? v.x() : (c == 1 ? v.y() : v.z());
+}
+
 Vector3D normalize(Vector3D v) {
     return v / v.length();
 }
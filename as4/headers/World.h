@@ -5,65 +5,214 @@
 
 #include "Sphere.h"
 #include "Material.h"
+#include "Shapes.h"
+#include "CompactScene.h"
+#include "TriangleMesh.h"
+#include "BVH.h"
+#include "Environment.h"
 
 using namespace std;
 
+// Told about every ray World::hit traces on its thread, e.g. to learn what the
+// paths of one tile went near (see Incremental.h)
+class HitObserver {
+public:
+    virtual ~HitObserver() {}
+    // ray was traced over [min_t, max_t], hit is the nearest hit, which ends that range
+    virtual void observe(const Ray& ray, float min_t, float max_t, const HitResult& hit) = 0;
+};
+
+// Observer of the calling thread, none unless set
+HitObserver*& hit_observer() {
+    thread_local HitObserver* observer = nullptr;
+    return observer;
+}
+
+
 class World {
 public:
     std::vector<shared_ptr<Sphere>> m_spheres;
+    // Planes, disks and boxes with finite bounds, kept in their own hierarchy m_shapeBvh
+    std::vector<shared_ptr<Shape>> m_shapes;
+    // Shapes without bounds, e.g. the floor plane, tested for every ray outside any hierarchy
+    std::vector<shared_ptr<Shape>> m_unbounded;
+    // Quantized spheres for scenes too large to keep as Sphere objects
+    CompactScene m_compact;
+    // Triangle meshes, e.g. read from OBJ files
+    std::vector<shared_ptr<TriangleMesh>> m_meshes;
+    // Hierarchy over m_spheres, rebuild it after adding or removing spheres
+    // and refit it after moving them
+    BVH m_bvh;
+    BVH m_shapeBvh;
+    // Light arriving from outside the scene, m_background in every direction when not set
+    shared_ptr<Environment> m_environment;
+    Vector3D m_background = Vector3D(1, 1, 1);
     
     World() {}
     HitResult hit(Ray& ray, float min_t, float max_t);
+    // Add to m_shapes or m_unbounded depending on its bounds, call build_bvh() afterwards
+    void add_shape(shared_ptr<Shape> shape);
+    void build_bvh();
+    void refit_bvh();
     
     void generate_scene_one_diffuse();
     void generate_scene_one_specular();
     void generate_scene_multi_diffuse();
     void generate_scene_multi_specular();
     void generate_scene_all();
+    void generate_scene_particles(uint64_t count);
+    void generate_scene_party(int light_count);
 };
 
 
 HitResult World::hit(Ray& ray, float min_t, float max_t) {
     // Record the nearest hit
     HitResult hit_result;
+    float ray_max_t = max_t;
+
+    if (m_bvh.m_indices.size() == m_spheres.size()) {
+        // Only test the spheres in the boxes the ray goes through
+        m_bvh.traverse(ray, min_t, max_t, [&](uint32_t index, float& closest_t) {
+            HitResult new_hit = m_spheres[index]->hit(ray, min_t, closest_t);
+            if (new_hit.m_isHit) {
+                closest_t = new_hit.m_t;
+                hit_result = new_hit;
+            }
+        });
+        if (hit_result.m_isHit)
+            max_t = hit_result.m_t;
+    }
+    else {
+        // Loop over each sphere in m_spheres
+        for (auto &sphere : m_spheres) {
+            HitResult new_hit = sphere->hit(ray, min_t, max_t);
+            // Update max_t to find the closest hit
+            if (new_hit.m_isHit) {
+                max_t = new_hit.m_t;
+                hit_result = new_hit;
+            }
+        }
+    }
+
+    if (m_shapeBvh.m_indices.size() == m_shapes.size()) {
+        m_shapeBvh.traverse(ray, min_t, max_t, [&](uint32_t index, float& closest_t) {
+            HitResult new_hit = m_shapes[index]->hit(ray, min_t, closest_t);
+            if (new_hit.m_isHit) {
+                closest_t = new_hit.m_t;
+                hit_result = new_hit;
+            }
+        });
+        if (hit_result.m_isHit)
+            max_t = hit_result.m_t;
+    }
+    else {
+        for (auto &shape : m_shapes) {
+            HitResult new_hit = shape->hit(ray, min_t, max_t);
+            if (new_hit.m_isHit) {
+                max_t = new_hit.m_t;
+                hit_result = new_hit;
+            }
+        }
+    }
+
+    for (auto &shape : m_unbounded) {
+        HitResult new_hit = shape->hit(ray, min_t, max_t);
+        if (new_hit.m_isHit) {
+            max_t = new_hit.m_t;
+            hit_result = new_hit;
+        }
+    }
 
-    // Loop over each sphere in m_spheres
-    for (auto &sphere : m_spheres) {
-        HitResult new_hit = sphere->hit(ray, min_t, max_t);
-        // Update max_t to find the closest hit
+    for (auto &mesh : m_meshes) {
+        HitResult new_hit = mesh->hit(ray, min_t, max_t);
         if (new_hit.m_isHit) {
             max_t = new_hit.m_t;
             hit_result = new_hit;
         }
     }
 
+    if (!m_compact.empty()) {
+        HitResult new_hit = m_compact.hit(ray, min_t, max_t);
+        if (new_hit.m_isHit)
+            hit_result = new_hit;
+    }
+
+    if (HitObserver* observer = hit_observer())
+        observer->observe(ray, min_t, hit_result.m_isHit ? hit_result.m_t : ray_max_t, hit_result);
     return hit_result;
 }
 
+vector<AABB> sphere_bounds(const vector<shared_ptr<Sphere>>& spheres) {
+    vector<AABB> bounds(spheres.size());
+    for (size_t i = 0; i < spheres.size(); ++i) {
+        Vector3D r(spheres[i]->m_radius, spheres[i]->m_radius, spheres[i]->m_radius);
+        bounds[i] = AABB(spheres[i]->m_center - r, spheres[i]->m_center + r);
+    }
+    return bounds;
+}
+
+void World::add_shape(shared_ptr<Shape> shape) {
+    if (shape->is_bounded())
+        m_shapes.push_back(shape);
+    else
+        m_unbounded.push_back(shape);
+}
+
+void World::build_bvh() {
+    m_bvh.build(sphere_bounds(m_spheres));
+    vector<AABB> shape_bounds(m_shapes.size());
+    for (size_t i = 0; i < m_shapes.size(); ++i)
+        shape_bounds[i] = m_shapes[i]->bounds();
+    m_shapeBvh.build(shape_bounds);
+}
+
+void World::refit_bvh() {
+    m_bvh.refit(sphere_bounds(m_spheres));
+}
+
 void World::generate_scene_one_diffuse() {
     m_spheres.clear();
+    m_compact.clear();
+    m_meshes.clear();
+    m_shapes.clear();
+    m_unbounded.clear();
+    m_background = Vector3D(1, 1, 1);
     
     auto material_diffuse = make_shared<Diffuse>(Vector3D(0.3, 0.4, 0.5));
     m_spheres.push_back(make_shared<Sphere>(Vector3D(4, 1, 0), 1.0, material_diffuse));
     
     // floor
     auto material_floor = make_shared<Diffuse>(Vector3D(0.5, 0.5, 0.5));
-    m_spheres.push_back(make_shared<Sphere>(Vector3D(0, -2000,0), 2000, material_floor));
+    add_shape(make_shared<Plane>(Vector3D(0, 0, 0), Vector3D(0, 1, 0), material_floor));
+
+    build_bvh();
 }
 
 void World::generate_scene_one_specular() {
     m_spheres.clear();
+    m_compact.clear();
+    m_meshes.clear();
+    m_shapes.clear();
+    m_unbounded.clear();
+    m_background = Vector3D(1, 1, 1);
     
     auto material_diffuse = make_shared<Specular>(Vector3D(1, 1, 1));
     m_spheres.push_back(make_shared<Sphere>(Vector3D(4, 1, 0), 1.0, material_diffuse));
     
     // floor
     auto material_floor = make_shared<Diffuse>(Vector3D(0.5, 0.5, 0.5));
-    m_spheres.push_back(make_shared<Sphere>(Vector3D(0, -2000,0), 2000, material_floor));
+    add_shape(make_shared<Plane>(Vector3D(0, 0, 0), Vector3D(0, 1, 0), material_floor));
+
+    build_bvh();
 }
 
 void World::generate_scene_multi_diffuse() {
     m_spheres.clear();
+    m_compact.clear();
+    m_meshes.clear();
+    m_shapes.clear();
+    m_unbounded.clear();
+    m_background = Vector3D(1, 1, 1);
     
     for (int row = -3; row < 3; ++row) {
         for (int col = -3; col < 3; ++col) {
@@ -79,11 +228,18 @@ void World::generate_scene_multi_diffuse() {
     
     // floor
     auto material_floor = make_shared<Diffuse>(Vector3D(0.5, 0.5, 0.5));
-    m_spheres.push_back(make_shared<Sphere>(Vector3D(0, -2000,0), 2000, material_floor));
+    add_shape(make_shared<Plane>(Vector3D(0, 0, 0), Vector3D(0, 1, 0), material_floor));
+
+    build_bvh();
 }
 
 void World::generate_scene_multi_specular() {
     m_spheres.clear();
+    m_compact.clear();
+    m_meshes.clear();
+    m_shapes.clear();
+    m_unbounded.clear();
+    m_background = Vector3D(1, 1, 1);
     
     for (int row = -3; row < 3; ++row) {
         for (int col = -3; col < 3; ++col) {
@@ -99,12 +255,19 @@ void World::generate_scene_multi_specular() {
     
     // floor
     auto material_floor = make_shared<Diffuse>(Vector3D(0.5, 0.5, 0.5));
-    m_spheres.push_back(make_shared<Sphere>(Vector3D(0, -2000,0), 2000, material_floor));
+    add_shape(make_shared<Plane>(Vector3D(0, 0, 0), Vector3D(0, 1, 0), material_floor));
+
+    build_bvh();
     
 }
 
 void World::generate_scene_all() {
     m_spheres.clear();
+    m_compact.clear();
+    m_meshes.clear();
+    m_shapes.clear();
+    m_unbounded.clear();
+    m_background = Vector3D(1, 1, 1);
     for (int row = -5; row < 10; ++row) {
         for (int col = -5; col < 5; ++col) {
             float radius = random_float(0.2, 0.5);
@@ -124,8 +287,61 @@ void World::generate_scene_all() {
     
     // floor
     auto material_floor = make_shared<Diffuse>(Vector3D(0.5, 0.5, 0.5));
-    m_spheres.push_back(make_shared<Sphere>(Vector3D(0, -2000,0), 2000, material_floor));
+    add_shape(make_shared<Plane>(Vector3D(0, 0, 0), Vector3D(0, 1, 0), material_floor));
+
+    build_bvh();
 }
 
+// A particle cloud of count small spheres above the floor, stored compactly
+void World::generate_scene_particles(uint64_t count) {
+    m_spheres.clear();
+    m_meshes.clear();
+    m_shapes.clear();
+    m_unbounded.clear();
+    m_background = Vector3D(1, 1, 1);
+    m_compact.generate_particles(count, Vector3D(-10, 0, -10), Vector3D(10, 2, 10));
+
+    // floor
+    auto material_floor = make_shared<Diffuse>(Vector3D(0.5, 0.5, 0.5));
+    add_shape(make_shared<Plane>(Vector3D(0, 0, 0), Vector3D(0, 1, 0), material_floor));
+
+    build_bvh();
+}
+
+// A dark room lit only by light_count small coloured emissive spheres
+// floating above a few props
+void World::generate_scene_party(int light_count) {
+    m_spheres.clear();
+    m_compact.clear();
+    m_meshes.clear();
+    m_shapes.clear();
+    m_unbounded.clear();
+    m_background = Vector3D(0.02, 0.02, 0.03);
+
+    for (int row = -2; row < 3; ++row) {
+        for (int col = -2; col < 3; ++col) {
+            float radius = random_float(0.4, 0.9);
+            Vector3D center(3 * row + 0.5 * random_float(), radius, 3 * col + 0.5 * random_float());
+            shared_ptr<Material> material;
+            if (random_float() <= 0.7)
+                material = make_shared<Diffuse>(Vector3D::random(0.4, 0.9));
+            else
+                material = make_shared<Specular>(Vector3D::random(0.6, 1));
+            m_spheres.push_back(make_shared<Sphere>(center, radius, material));
+        }
+    }
+
+    for (int i = 0; i < light_count; ++i) {
+        Vector3D center(random_float(-10, 10), random_float(3.5, 6), random_float(-10, 10));
+        Vector3D color = Vector3D::random(0.2, 1);
+        m_spheres.push_back(make_shared<Sphere>(center, random_float(0.02, 0.05), make_shared<Emissive>(16 * color)));
+    }
+
+    // floor
+    auto material_floor = make_shared<Diffuse>(Vector3D(0.5, 0.5, 0.5));
+    add_shape(make_shared<Plane>(Vector3D(0, 0, 0), Vector3D(0, 1, 0), material_floor));
+
+    build_bvh();
+}
 
 #endif
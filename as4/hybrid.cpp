@@ -0,0 +1,104 @@
+#include "Camera.h"
+#include "World.h"
+#include "Renderer.h"
+#include "ImageBuffer.h"
+#include "ImageMetrics.h"
+#include "Rasterizer.h"
+
+#include <iostream>
+#include <chrono>
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Render a scene twice, once with the first hits rasterized into a G-buffer and
+// once fully ray traced, and compare the two
+// Runs headless, e.g. on Mesa's software rasterizer with no GPU or display
+int main()
+{
+    RenderSettings settings;
+    settings.m_width =  768;
+    settings.m_height = 540;
+    float aspect_ratio = settings.m_width / float(settings.m_height);
+    settings.m_raysPerPixel = 16;
+    settings.m_maxLightBounceNum = 5;
+    // Trace every bounce so both images are plain path tracing
+    settings.m_useIrradianceCache = false;
+    // 2 x 2 rasterized sub-pixels per pixel, for anti-aliasing
+    const int samples = 2;
+
+    Vector3D eye(20, 3, 3);
+    Vector3D target(0, 0, 0);
+    Vector3D up(0, 1, 0);
+    float fov = 20; // degree
+    Camera camera(eye, target, up, fov, aspect_ratio);
+
+    World world;
+    world.generate_scene_all();
+
+    HeadlessContext context;
+    if (!context.is_open()) {
+        std::cout << "Failed to create an OpenGL 3.3 context" << std::endl;
+        return -1;
+    }
+    std::cout << "rasterizing on " << context.renderer() << std::endl;
+    GBufferRasterizer rasterizer;
+
+    // Primary visibility, rasterized then traced for the same sub-pixels
+    auto start = std::chrono::steady_clock::now();
+    GBuffer gbuffer;
+    if (!rasterizer.rasterize(world, camera, settings.m_width, settings.m_height, samples, gbuffer)) {
+        std::cout << "Failed to rasterize the G-buffer" << std::endl;
+        return -1;
+    }
+    double raster_time = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    long mismatches = 0, hits = 0;
+    float max_error = 0;
+    for (int y = 0; y < gbuffer.m_height; ++y) {
+        for (int x = 0; x < gbuffer.m_width; ++x) {
+            Ray r = camera.generate_ray((x + 0.5) / (samples * (settings.m_width - 1)), (y + 0.5) / (samples * (settings.m_height - 1)));
+            HitResult traced = world.hit(r, 0.001, std::numeric_limits<float>::infinity());
+            HitResult rasterized;
+            bool raster_hit = gbuffer.hit(x, y, rasterized);
+            if (traced.m_isHit != raster_hit || (raster_hit && traced.m_hitMaterial != rasterized.m_hitMaterial)) {
+                mismatches++;
+                continue;
+            }
+            if (raster_hit) {
+                hits++;
+                max_error = fmax(max_error, (traced.m_hitPos - rasterized.m_hitPos).length());
+            }
+        }
+    }
+    double trace_time = seconds_since(start);
+    std::cout << "primary hits: rasterized in " << raster_time << " s, traced in " << trace_time << " s" << std::endl;
+    std::cout << "  " << mismatches << " of " << gbuffer.m_width * gbuffer.m_height << " sub-pixels see a different surface, "
+              << "largest position error " << max_error << " over " << hits << " hits" << std::endl;
+
+    // Full frames
+    RadianceBuffer hybrid(settings.m_width, settings.m_height);
+    start = std::chrono::steady_clock::now();
+    Renderer hybrid_renderer(world, camera, settings);
+    hybrid_renderer.set_primary_visibility(&gbuffer);
+    hybrid_renderer.render(hybrid);
+    double hybrid_time = seconds_since(start) + raster_time;
+
+    RadianceBuffer traced(settings.m_width, settings.m_height);
+    start = std::chrono::steady_clock::now();
+    Renderer renderer(world, camera, settings);
+    renderer.render(traced);
+    double traced_time = seconds_since(start);
+
+    ImageError error = image_error(hybrid.m_pixels, traced.m_pixels, settings.m_width, settings.m_height);
+    std::cout << "frame: hybrid " << hybrid_time << " s, ray traced " << traced_time << " s" << std::endl;
+    std::cout << "  RMSE " << error.m_rmse << ", PSNR " << error.m_psnr << " dB, FLIP " << error.m_flip << std::endl;
+
+    if (!hybrid.save_ppm("../results/hybrid.ppm") || !traced.save_ppm("../results/traced.ppm")) {
+        std::cout << "Failed to save the images" << std::endl;
+        return -1;
+    }
+    std::cout << "ppm saved at ../results/hybrid.ppm and ../results/traced.ppm" << std::endl;
+}
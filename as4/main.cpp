@@ -1,43 +1,22 @@
 #include "Camera.h"
 #include "World.h"
+#include "Renderer.h"
+#include "MappedImage.h"
 
 #include <iostream>
-#include <fstream>
-
-void write_color_to_file(std::ostream &out, Vector3D pixel_color, int samples_per_pixel) {
-    auto r = pixel_color.x();
-    auto g = pixel_color.y();
-    auto b = pixel_color.z();
-    if (r != r) r = 0.0;
-    if (g != g) g = 0.0;
-    if (b != b) b = 0.0;
-    auto scale = 1.0 / samples_per_pixel;
-    r = clamp(256 * sqrt(scale * r), 0, 255);
-    g = clamp(256 * sqrt(scale * g), 0, 255);
-    b = clamp(256 * sqrt(scale * b), 0, 255);
-    out << int(r) << ' ' << int(g) << ' ' << int(b) << '\n';
-}
-
-Vector3D ray_hit_color(Ray& r, World& world, int max_light_bounce_num) {
-    if (max_light_bounce_num <= 0)
-        return Vector3D(0, 0, 0);
-    
-    HitResult hit = world.hit(r, 0.001, std::numeric_limits<float>::infinity());
-    if (hit.m_isHit) {
-        ReflectResult res = hit.m_hitMaterial->reflect(r, hit);
-        return res.m_color * ray_hit_color(res.m_ray, world, max_light_bounce_num - 1);
-    }
-
-    return Vector3D(1, 1, 1);
-}
 
 int main()
 {
-    int width =  768;
-    int height = 540;
-    float aspect_ratio = width / float(height);
-    int rays_per_pixel = 100;
-    const int max_light_bounce_num = 5;
+    RenderSettings settings;
+    settings.m_width =  768;
+    settings.m_height = 540;
+    float aspect_ratio = settings.m_width / float(settings.m_height);
+    settings.m_raysPerPixel = 100;
+    settings.m_maxLightBounceNum = 5;
+    // Interpolate indirect diffuse light from sparse samples instead of tracing every bounce
+    settings.m_useIrradianceCache = true;
+    // Tiles are traced in parallel and streamed to the output as they finish
+    settings.m_tileSize = 64;
     
     Vector3D eye(20, 3, 3);
     Vector3D target(0, 0, 0);
@@ -53,26 +32,31 @@ int main()
     // world.generate_scene_multi_diffuse();
     // world.generate_scene_multi_specular();
     world.generate_scene_all();
+    // world.generate_scene_particles(1000000);
+
+    // Light the scene with an HDR environment map instead of the white background
+    // world.m_environment = make_shared<Environment>();
+    // world.m_environment->load_hdr("../hdr/sky.hdr");
+    // or with a sky and a small, very bright sun
+    // world.m_environment = make_shared<Environment>(Environment::sky(Vector3D(1, 1, 0.5), Vector3D(20000, 19000, 17000)));
    
     // Set path for the output image
     std::string result_ppm_path = "../results/all.ppm";
     
-    std::ofstream fout (result_ppm_path);
-    fout << "P3\n" << width << ' ' << height << "\n255\n";
-    for (int j = height - 1; j >= 0; --j) {
-        std::cout << "casting row " << j << std::endl;
-        for (int i = 0; i < width; ++i) {
-            Vector3D pixel_color(0, 0, 0);
-            for (int s = 0; s < rays_per_pixel; ++s) {
-                float col = (i + random_float()) / (width - 1);
-                float row = (j + random_float()) / (height - 1);
-                Ray r = camera.generate_ray(col, row);
-                pixel_color += ray_hit_color(r, world, max_light_bounce_num);
-            }
-            write_color_to_file(fout, pixel_color, rays_per_pixel);
-        }
+    MappedImage image(result_ppm_path, settings.m_width, settings.m_height);
+    if (!image.is_open()) {
+        std::cout << "Failed to create " << result_ppm_path << std::endl;
+        return -1;
     }
 
+    Renderer renderer(world, camera, settings);
+    renderer.render(image, [](int done, int total) {
+        std::cout << "cast tile " << done << " of " << total << std::endl;
+    });
+
+    IrradianceCache* cache = renderer.cache();
+    if (cache)
+        std::cout << "irradiance cache: " << cache->record_count() << " records, "
+                  << cache->hit_count() << " of " << cache->lookup_count() << " lookups interpolated" << std::endl;
     std::cout << "Rraytracing done!" << std::endl << "ppm saved at " << result_ppm_path << std::endl;
 }
-
@@ -0,0 +1,162 @@
+#include "RenderJob.h"
+#include "ImageBuffer.h"
+#include "ImageMetrics.h"
+#include "Restir.h"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+// Direct light from many small emitters, three ways for the same time each:
+//   path    the path tracer of Renderer.h, which only finds the lights by chance
+//   ris     one light per diffuse hit resampled out of candidates drawn by power
+//   restir  the same, with the reservoirs shared over time and between neighbours
+// Each is compared with a reference rendered by ris with many passes, kept in ../results
+// bounces=1 leaves the direct light alone, which path tracing cannot find at all
+// Usage: ray_restir [-t seconds] [-r reference_passes] [-c candidates] [-m temporal_limit] [-n neighbours] [key=value ...]
+// with the keys of RenderJob.h, e.g.
+//        ray_restir -t 10 lights=5000 width=320 height=180
+// The images are written to ../results/restir_<method>.ppm, their last passes to
+// ../results/restir_<method>_pass.ppm
+int main(int argc, char** argv)
+{
+    double budget = 10;
+    int reference_passes = 512;
+    RestirSettings restir;
+
+    JobSpec spec;
+    spec.m_scene = "party";
+    spec.m_eye = Vector3D(0, 0.6, 14);
+    spec.m_target = Vector3D(0, -0.6, -1);
+    spec.m_fov = 20;
+    spec.m_settings.m_width = 192;
+    spec.m_settings.m_height = 108;
+    spec.m_settings.m_raysPerPixel = 1;
+    spec.m_settings.m_maxLightBounceNum = 3;
+    spec.m_settings.m_useIrradianceCache = false;
+    std::string line;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc)
+            budget = std::stod(argv[++i]);
+        else if (arg == "-r" && i + 1 < argc)
+            reference_passes = std::stoi(argv[++i]);
+        else if (arg == "-c" && i + 1 < argc)
+            restir.m_candidates = std::stoi(argv[++i]);
+        else if (arg == "-m" && i + 1 < argc)
+            restir.m_temporalLimit = std::stoi(argv[++i]);
+        else if (arg == "-n" && i + 1 < argc)
+            restir.m_spatialNeighbours = std::stoi(argv[++i]);
+        else
+            line += arg + " ";
+    }
+    std::string error;
+    if (!spec.parse(line, error)) {
+        std::cout << error << std::endl
+                  << "Usage: ray_restir [-t seconds] [-r reference_passes] [-c candidates] [-m temporal_limit] [-n neighbours] [key=value ...]" << std::endl;
+        return -1;
+    }
+
+    World world;
+    if (!spec.build_world(world)) {
+        std::cout << "Unknown scene " << spec.m_scene << std::endl;
+        return -1;
+    }
+    Camera camera = spec.camera();
+    int width = spec.m_settings.m_width, height = spec.m_settings.m_height;
+
+    RestirSettings no_reuse = restir;
+    no_reuse.m_temporal = false;
+    no_reuse.m_spatialNeighbours = 0;
+
+    JobSpec reference_spec = spec;
+    reference_spec.m_settings.m_raysPerPixel = reference_passes;
+    reference_spec.m_settings.m_tileSize = 64;
+    std::ostringstream reference_path;
+    reference_path << "../results/reference_restir_" << std::hex << reference_spec.hash() << "_" << std::dec << restir.m_candidates << ".pfm";
+
+    RadianceBuffer reference(width, height);
+    if (reference.load_pfm(reference_path.str()) && reference.m_width == width && reference.m_height == height) {
+        std::cout << "reference read from " << reference_path.str() << std::endl;
+    }
+    else {
+        RenderSettings settings = spec.m_settings;
+        settings.m_seed = 0x7fffffff;
+        RestirRenderer renderer(world, camera, settings, no_reuse);
+        for (int pass = 0; pass < reference_passes; ++pass) {
+            renderer.render_pass();
+            if ((pass + 1) % 16 == 0)
+                std::cout << "\rreference: pass " << pass + 1 << " of " << reference_passes << std::flush;
+        }
+        std::cout << std::endl;
+        reference = RadianceBuffer(width, height);
+        renderer.write(reference);
+        if (!reference.save_pfm(reference_path.str()))
+            std::cout << "Failed to save " << reference_path.str() << ", it will be rendered again next time" << std::endl;
+        else
+            std::cout << "reference saved at " << reference_path.str() << std::endl;
+    }
+
+    LightList lights;
+    lights.build(world);
+    std::cout << world.m_spheres.size() - lights.m_lights.size() << " spheres, " << lights.m_lights.size() << " lights" << std::endl;
+    std::cout << std::setw(8) << "method" << std::setw(8) << "passes" << std::setw(10) << "seconds"
+              << std::setw(10) << "rmse" << std::setw(10) << "psnr" << std::setw(10) << "flip"
+              << std::setw(12) << "pass rmse" << std::setw(12) << "pass psnr" << std::setw(12) << "pass flip" << std::endl;
+
+    // Run pass() until the time is up, then compare the mean of the passes and the last pass alone
+    // with the reference. Reuse makes every pass better, but also makes the passes alike, so
+    // the first pays off more in a single frame than in the mean
+    auto run = [&](const std::string& name, std::function<void()> pass,
+                   std::function<void(RadianceBuffer&)> mean, std::function<void(RadianceBuffer&)> last) {
+        int passes = 0;
+        double seconds = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (seconds < budget) {
+            pass();
+            passes++;
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        RadianceBuffer image(width, height), frame(width, height);
+        mean(image);
+        last(frame);
+        ImageError e = image_error(image.m_pixels, reference.m_pixels, width, height);
+        ImageError f = image_error(frame.m_pixels, reference.m_pixels, width, height);
+        std::cout << std::setw(8) << name << std::setw(8) << passes << std::fixed << std::setprecision(3) << std::setw(10) << seconds
+                  << std::setprecision(5) << std::setw(10) << e.m_rmse << std::setprecision(2) << std::setw(10) << e.m_psnr
+                  << std::setprecision(5) << std::setw(10) << e.m_flip
+                  << std::setprecision(5) << std::setw(12) << f.m_rmse << std::setprecision(2) << std::setw(12) << f.m_psnr
+                  << std::setprecision(5) << std::setw(12) << f.m_flip << std::defaultfloat << std::endl;
+        std::string path = "../results/restir_" + name + ".ppm";
+        if (!image.save_ppm(path) || !frame.save_ppm("../results/restir_" + name + "_pass.ppm"))
+            std::cout << "Failed to save " << path << std::endl;
+    };
+
+    // Path tracing, one sample per pixel per pass
+    std::vector<Vector3D> sum(size_t(width) * height);
+    RadianceBuffer frame(width, height);
+    int path_passes = 0;
+    RenderSettings settings = spec.m_settings;
+    run("path", [&]() {
+        settings.m_seed = ++path_passes;
+        Renderer renderer(world, camera, settings);
+        renderer.render(frame);
+        for (size_t p = 0; p < sum.size(); ++p)
+            sum[p] += frame.m_pixels[p];
+    }, [&](RadianceBuffer& image) {
+        for (size_t p = 0; p < sum.size(); ++p)
+            image.m_pixels[p] = sum[p] / float(path_passes);
+    }, [&](RadianceBuffer& image) {
+        image = frame;
+    });
+
+    RestirRenderer ris(world, camera, spec.m_settings, no_reuse);
+    run("ris", [&]() { ris.render_pass(); }, [&](RadianceBuffer& image) { ris.write(image); },
+        [&](RadianceBuffer& image) { ris.write_last_pass(image); });
+
+    RestirRenderer full(world, camera, spec.m_settings, restir);
+    run("restir", [&]() { full.render_pass(); }, [&](RadianceBuffer& image) { full.write(image); },
+        [&](RadianceBuffer& image) { full.write_last_pass(image); });
+
+    std::cout << "images saved at ../results/restir_<method>.ppm" << std::endl;
+}
@@ -0,0 +1,86 @@
+#include "Camera.h"
+#include "World.h"
+#include "Renderer.h"
+#include "MappedImage.h"
+#include "Animation.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+
+// Render a keyframed animation in one run
+// The scene is generated once; between frames the animated spheres are moved
+// and the hierarchy refit rather than rebuilt, the irradiance cache is kept
+// while only the camera moves, and each pixel can start from the radiance
+// the previous frame accumulated at the same point
+int main()
+{
+    RenderSettings settings;
+    settings.m_width =  768;
+    settings.m_height = 540;
+    float aspect_ratio = settings.m_width / float(settings.m_height);
+    // Fewer rays per frame, the previous frames make up for it
+    settings.m_raysPerPixel = 16;
+    settings.m_maxLightBounceNum = 5;
+    settings.m_useIrradianceCache = true;
+    // Start each pixel from its reprojection in the previous frame
+    const bool temporal_reuse = true;
+
+    const int frame_count = 48;
+    const float duration = 2.0; // seconds
+
+    World world;
+    world.generate_scene_all();
+
+    // Turntable around the scene
+    Animation animation = Animation::turntable(Vector3D(20, 3, 3), Vector3D(0, 0, 0), duration);
+    // Keyframed object motion, e.g. the first sphere hopping once
+    // SphereTrack hop;
+    // hop.m_sphere = 0;
+    // Vector3D start = world.m_spheres[0]->m_center;
+    // hop.m_center.add(0, start);
+    // hop.m_center.add(duration / 2, start + Vector3D(0, 2, 0));
+    // hop.m_center.add(duration, start);
+    // animation.m_spheres.push_back(hop);
+
+    // Cached indirect light stays valid as long as nothing but the camera moves
+    IrradianceCache shared_cache;
+    IrradianceCache* cache = animation.has_object_motion() ? nullptr : &shared_cache;
+    // History is only rejected where the point moved, not where its lighting changed, so
+    // with moving objects shadows and reflections would trail behind them. Keep no more
+    // history than one frame's samples then, so stale light halves every frame
+    if (animation.has_object_motion())
+        settings.m_historyLimit = settings.m_raysPerPixel;
+
+    std::unique_ptr<FrameHistory> previous;
+    for (int frame = 0; frame < frame_count; ++frame) {
+        auto start = std::chrono::steady_clock::now();
+        float time = duration * frame / frame_count;
+
+        animation.apply(world, time);
+        Camera camera = animation.camera(time, aspect_ratio);
+
+        settings.m_seed = frame;
+        Renderer renderer(world, camera, settings, cache);
+        std::unique_ptr<FrameHistory> current;
+        if (temporal_reuse) {
+            current = make_unique<FrameHistory>(settings.m_width, settings.m_height, camera);
+            renderer.set_history(previous.get(), current.get());
+        }
+
+        char path[64];
+        snprintf(path, sizeof(path), "../results/frame_%04d.ppm", frame);
+        MappedImage image(path, settings.m_width, settings.m_height);
+        if (!image.is_open()) {
+            std::cout << "Failed to create " << path << std::endl;
+            return -1;
+        }
+        renderer.render(image);
+        previous = std::move(current);
+
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        std::cout << "frame " << frame << " saved at " << path << " in " << seconds.count() << " s" << std::endl;
+    }
+
+    std::cout << "Sequence done!" << std::endl;
+}
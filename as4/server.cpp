@@ -0,0 +1,250 @@
+#include "RenderJob.h"
+#include "ImageBuffer.h"
+#include "Socket.h"
+
+#include <iostream>
+#include <list>
+#include <map>
+#include <condition_variable>
+#include <csignal>
+
+// Long running render server
+// Clients send one job line (see RenderJob.h) and receive
+//   queued <id> | cached
+//   progress <done tiles> <total tiles>   (repeated)
+//   result <bytes>, followed by the binary ppm
+// or a single "error <message>" line
+// All jobs share one pool of worker threads, which always trace tiles of the
+// highest priority job first; finished images are kept by job hash, so an
+// identical job is answered straight from memory
+
+
+class Job {
+public:
+    uint64_t m_id;
+    uint64_t m_hash;
+    JobSpec m_spec;
+    World m_world;
+    Camera m_camera;
+    unique_ptr<Renderer> m_renderer;
+    unique_ptr<ImageBuffer> m_image;
+
+    // Next tile to hand out, guarded by the scheduler
+    int m_nextTile = 0;
+
+    // Progress, guarded by m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    int m_doneTiles = 0;
+    bool m_finished = false;
+
+    Job(uint64_t id, const JobSpec& spec)
+        : m_id(id), m_hash(spec.hash()), m_spec(spec), m_camera(spec.camera()) {}
+};
+
+
+// Finished images, least recently used dropped first
+class ResultCache {
+public:
+    ResultCache(size_t capacity) : m_capacity(capacity) {}
+
+    shared_ptr<const std::vector<unsigned char>> find(uint64_t hash) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto found = m_entries.find(hash);
+        if (found == m_entries.end())
+            return nullptr;
+        m_order.splice(m_order.begin(), m_order, found->second.second);
+        return found->second.first;
+    }
+
+    void store(uint64_t hash, shared_ptr<const std::vector<unsigned char>> image) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_entries.count(hash))
+            return;
+        m_order.push_front(hash);
+        m_entries[hash] = make_pair(image, m_order.begin());
+        if (m_entries.size() > m_capacity) {
+            m_entries.erase(m_order.back());
+            m_order.pop_back();
+        }
+    }
+
+private:
+    size_t m_capacity;
+    std::mutex m_mutex;
+    std::list<uint64_t> m_order;
+    std::map<uint64_t, pair<shared_ptr<const std::vector<unsigned char>>, std::list<uint64_t>::iterator>> m_entries;
+};
+
+
+class Scheduler {
+public:
+    Scheduler(ResultCache& cache) : m_cache(cache) {}
+
+    // The job already rendering or queued with the same hash, if any
+    shared_ptr<Job> find(uint64_t hash) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto found = m_inFlight.find(hash);
+        return found == m_inFlight.end() ? nullptr : found->second;
+    }
+
+    // Queue a job, or return the identical one already in flight
+    shared_ptr<Job> submit(shared_ptr<Job> job) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto found = m_inFlight.find(job->m_hash);
+            if (found != m_inFlight.end())
+                return found->second;
+            m_inFlight[job->m_hash] = job;
+            m_queue.push_back(job);
+        }
+        m_work.notify_all();
+        return job;
+    }
+
+    // Worker loop, runs forever
+    void work() {
+        while (true) {
+            shared_ptr<Job> job;
+            int tile;
+            take(job, tile);
+
+            job->m_renderer->render_tile(tile, *job->m_image);
+
+            bool last;
+            {
+                std::lock_guard<std::mutex> lock(job->m_mutex);
+                last = ++job->m_doneTiles == job->m_renderer->tile_count();
+            }
+            if (last)
+                finish(job);
+            job->m_changed.notify_all();
+        }
+    }
+
+private:
+    ResultCache& m_cache;
+    std::mutex m_mutex;
+    std::condition_variable m_work;
+    // Jobs with tiles left to hand out
+    std::vector<shared_ptr<Job>> m_queue;
+    std::map<uint64_t, shared_ptr<Job>> m_inFlight;
+
+    // Next tile of the highest priority job, oldest job first among equals
+    void take(shared_ptr<Job>& job, int& tile) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_work.wait(lock, [this] { return !m_queue.empty(); });
+
+        auto best = m_queue.begin();
+        for (auto it = m_queue.begin(); it != m_queue.end(); ++it)
+            if ((*it)->m_spec.m_priority > (*best)->m_spec.m_priority)
+                best = it;
+
+        job = *best;
+        tile = job->m_nextTile++;
+        if (job->m_nextTile == job->m_renderer->tile_count())
+            m_queue.erase(best);
+    }
+
+    void finish(shared_ptr<Job> job) {
+        m_cache.store(job->m_hash, make_shared<const std::vector<unsigned char>>(job->m_image->ppm()));
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_inFlight.erase(job->m_hash);
+        }
+        std::lock_guard<std::mutex> lock(job->m_mutex);
+        job->m_finished = true;
+    }
+};
+
+
+bool send_result(int fd, const std::vector<unsigned char>& image) {
+    return write_line(fd, "result " + std::to_string(image.size())) && write_all(fd, image.data(), image.size());
+}
+
+void serve_client(int fd, Scheduler& scheduler, ResultCache& cache, std::atomic<uint64_t>& next_id) {
+    std::string line, error;
+    JobSpec spec;
+    if (!read_line(fd, line) || !spec.parse(line, error)) {
+        write_line(fd, "error " + (error.empty() ? std::string("no job") : error));
+        close(fd);
+        return;
+    }
+
+    uint64_t hash = spec.hash();
+    if (auto image = cache.find(hash)) {
+        std::cout << "cached " << spec.canonical() << std::endl;
+        write_line(fd, "cached");
+        send_result(fd, *image);
+        close(fd);
+        return;
+    }
+
+    // Join an identical job in flight, or set up a new one
+    shared_ptr<Job> job = scheduler.find(hash);
+    if (!job) {
+        job = make_shared<Job>(next_id++, spec);
+        if (!spec.build_world(job->m_world)) {
+            write_line(fd, "error unknown scene " + spec.m_scene);
+            close(fd);
+            return;
+        }
+        job->m_renderer = make_unique<Renderer>(job->m_world, job->m_camera, spec.m_settings);
+        job->m_image = make_unique<ImageBuffer>(spec.m_settings.m_width, spec.m_settings.m_height);
+        job = scheduler.submit(job);
+    }
+    std::cout << "job " << job->m_id << ": " << spec.canonical() << " priority " << spec.m_priority << std::endl;
+    write_line(fd, "queued " + std::to_string(job->m_id));
+
+    // Stream progress until the job is done
+    int total = job->m_renderer->tile_count();
+    int reported = -1;
+    while (true) {
+        std::unique_lock<std::mutex> lock(job->m_mutex);
+        job->m_changed.wait(lock, [&] { return job->m_doneTiles != reported || job->m_finished; });
+        reported = job->m_doneTiles;
+        bool finished = job->m_finished;
+        lock.unlock();
+
+        if (!write_line(fd, "progress " + std::to_string(reported) + ' ' + std::to_string(total)))
+            break;
+        if (finished) {
+            send_result(fd, job->m_image->ppm());
+            break;
+        }
+    }
+    close(fd);
+}
+
+int main(int argc, char** argv)
+{
+    std::string socket_path = argc > 1 ? argv[1] : default_socket_path;
+    int num_threads = argc > 2 ? std::stoi(argv[2]) : max(1u, thread::hardware_concurrency());
+    // Images kept for resubmitted jobs
+    const size_t cached_images = 32;
+
+    // A client hanging up must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = listen_local(socket_path);
+    if (listen_fd < 0) {
+        std::cout << "Failed to listen on " << socket_path << std::endl;
+        return -1;
+    }
+
+    ResultCache cache(cached_images);
+    Scheduler scheduler(cache);
+    std::atomic<uint64_t> next_id(1);
+
+    // One worker pool for every job
+    for (int i = 0; i < num_threads; ++i)
+        std::thread(&Scheduler::work, &scheduler).detach();
+
+    std::cout << "ray_server listening on " << socket_path << " with " << num_threads << " threads" << std::endl;
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        std::thread(serve_client, fd, std::ref(scheduler), std::ref(cache), std::ref(next_id)).detach();
+    }
+}
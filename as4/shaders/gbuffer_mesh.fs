@@ -0,0 +1,26 @@
+#version 330 core
+in vec3 WorldPos;
+in vec3 VertexNormal;
+
+layout (location = 0) out vec4 Position;
+layout (location = 1) out vec4 Normal;
+layout (location = 2) out int Material;
+
+uniform vec3 eye;
+uniform vec3 w;
+uniform float far;
+uniform int materialId;
+
+void main() {
+    // Turn the normal towards the viewer, as TriangleMesh::hit does
+    vec3 n = normalize(VertexNormal);
+    if (dot(n, WorldPos - eye) > 0.0)
+        n = -n;
+
+    Position = vec4(WorldPos, length(WorldPos - eye));
+    Normal = vec4(n, 0.0);
+    Material = materialId;
+    // Depth along the view direction mapped below 1, the same for every kind of surface
+    float depth = -dot(WorldPos - eye, w);
+    gl_FragDepth = depth / (depth + far);
+}
@@ -0,0 +1,30 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+
+out vec3 WorldPos;
+out vec3 VertexNormal;
+
+// Camera frame, see Camera::basis
+uniform vec3 eye;
+uniform vec3 u;
+uniform vec3 v;
+uniform vec3 w;
+uniform vec2 ndcSize;
+// Range of (col, row) covered by the image
+uniform vec2 span;
+
+// Same mapping as Camera::project, with the depth left in w for clipping
+vec4 project(vec3 p) {
+    vec3 d = p - eye;
+    float depth = -dot(d, w);
+    float col = dot(d, u) / ndcSize.x + 0.5 * depth;
+    float row = dot(d, v) / ndcSize.y + 0.5 * depth;
+    return vec4(2.0 * col / span.x - depth, 2.0 * row / span.y - depth, 0.0, depth);
+}
+
+void main() {
+    WorldPos = aPos;
+    VertexNormal = aNormal;
+    gl_Position = project(aPos);
+}
@@ -0,0 +1,70 @@
+#version 330 core
+layout (location = 0) out vec4 Position;
+layout (location = 1) out vec4 Normal;
+layout (location = 2) out int Material;
+
+// Camera frame, see Camera::basis
+uniform vec3 eye;
+uniform vec3 u;
+uniform vec3 v;
+uniform vec3 w;
+uniform vec2 ndcSize;
+// Range of (col, row) covered by the image, and its size in sub-pixels
+uniform vec2 span;
+uniform vec2 viewport;
+uniform float far;
+
+// 0 plane through shapeA with normal shapeB, 1 disk of shapeRadius around shapeA with normal shapeB,
+// 2 box from shapeA to shapeB
+uniform int shapeType;
+uniform vec3 shapeA;
+uniform vec3 shapeB;
+uniform float shapeRadius;
+uniform int materialId;
+
+void main() {
+    // The ray of this sub-pixel, as Camera::generate_ray makes it
+    vec2 cr = gl_FragCoord.xy / viewport * span;
+    vec3 d = normalize((cr.x - 0.5) * ndcSize.x * u + (cr.y - 0.5) * ndcSize.y * v - w);
+
+    float t;
+    vec3 n;
+    if (shapeType == 2) {
+        // Slab test, as Box::hit does
+        vec3 t0 = (shapeA - eye) / d;
+        vec3 t1 = (shapeB - eye) / d;
+        vec3 t_min = min(t0, t1);
+        vec3 t_max = max(t0, t1);
+        float t_near = max(max(t_min.x, t_min.y), t_min.z);
+        float t_far = min(min(t_max.x, t_max.y), t_max.z);
+        if (t_near > t_far)
+            discard;
+        bool inside = t_near < 0.001;
+        t = inside ? t_far : t_near;
+        if (t < 0.001)
+            discard;
+        vec3 face = inside ? t_max : t_min;
+        vec3 axis = face.x == t ? vec3(1, 0, 0) : (face.y == t ? vec3(0, 1, 0) : vec3(0, 0, 1));
+        n = (inside ? 1.0 : -1.0) * sign(d) * axis;
+    }
+    else {
+        // As hit_plane does, with the normal turned towards the ray
+        float denominator = dot(d, shapeB);
+        if (denominator == 0.0)
+            discard;
+        t = dot(shapeA - eye, shapeB) / denominator;
+        if (t < 0.001)
+            discard;
+        if (shapeType == 1 && length(eye + t * d - shapeA) > shapeRadius)
+            discard;
+        n = denominator > 0.0 ? -shapeB : shapeB;
+    }
+
+    vec3 p = eye + t * d;
+    Position = vec4(p, t);
+    Normal = vec4(n, 0.0);
+    Material = materialId;
+    // The same depth as spheres and meshes, still below 1 far beyond the bounded scene
+    float depth = -dot(p - eye, w);
+    gl_FragDepth = depth / (depth + far);
+}
@@ -0,0 +1,36 @@
+#version 330 core
+in vec3 WorldPos;
+flat in vec4 Sphere;
+flat in int MaterialId;
+
+layout (location = 0) out vec4 Position;
+layout (location = 1) out vec4 Normal;
+layout (location = 2) out int Material;
+
+uniform vec3 eye;
+uniform vec3 w;
+uniform float far;
+
+void main() {
+    // Intersect the ray through this fragment with the sphere, as hit_sphere does
+    vec3 d = normalize(WorldPos - eye);
+    vec3 oc = eye - Sphere.xyz;
+    float half_b = dot(d, oc);
+    float c = dot(oc, oc) - Sphere.w * Sphere.w;
+    float discriminant = half_b * half_b - c;
+    if (discriminant < 0.0)
+        discard;
+    float t = -half_b - sqrt(discriminant);
+    if (t < 0.001)
+        t = -half_b + sqrt(discriminant);
+    if (t < 0.001)
+        discard;
+
+    vec3 p = eye + t * d;
+    Position = vec4(p, t);
+    Normal = vec4((p - Sphere.xyz) / Sphere.w, 0.0);
+    Material = MaterialId;
+    // Depth along the view direction mapped below 1, the same for every kind of surface
+    float depth = -dot(p - eye, w);
+    gl_FragDepth = depth / (depth + far);
+}
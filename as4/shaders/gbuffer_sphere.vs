@@ -0,0 +1,34 @@
+#version 330 core
+// Corner of a cube around each sphere, the sphere itself is found per fragment
+layout (location = 0) in vec3 aCorner;
+layout (location = 1) in vec4 aSphere;
+layout (location = 2) in int aMaterial;
+
+out vec3 WorldPos;
+flat out vec4 Sphere;
+flat out int MaterialId;
+
+// Camera frame, see Camera::basis
+uniform vec3 eye;
+uniform vec3 u;
+uniform vec3 v;
+uniform vec3 w;
+uniform vec2 ndcSize;
+// Range of (col, row) covered by the image
+uniform vec2 span;
+
+// Same mapping as Camera::project, with the depth left in w for clipping
+vec4 project(vec3 p) {
+    vec3 d = p - eye;
+    float depth = -dot(d, w);
+    float col = dot(d, u) / ndcSize.x + 0.5 * depth;
+    float row = dot(d, v) / ndcSize.y + 0.5 * depth;
+    return vec4(2.0 * col / span.x - depth, 2.0 * row / span.y - depth, 0.0, depth);
+}
+
+void main() {
+    WorldPos = aSphere.xyz + aSphere.w * aCorner;
+    Sphere = aSphere;
+    MaterialId = aMaterial;
+    gl_Position = project(WorldPos);
+}
@@ -0,0 +1,158 @@
+#include "Camera.h"
+#include "World.h"
+#include "Renderer.h"
+#include "Texture.h"
+#include "ImageBuffer.h"
+
+#include <iostream>
+#include <chrono>
+
+// Textured OBJ assets of as3 in the tracer, and the cost of reading their textures
+// Lookups are timed at random texture coordinates, the way rays after a bounce read
+// them, against a plain row by row texture of linear colours. The floor and the
+// bucket of as3 are then rendered to ../results/texture.ppm
+// JPEG textures need stb_image at the root of the repository, as for as3,
+// without it a generated texture of the same size is used instead
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Checks with some noise, 8 bit sRGB
+std::vector<unsigned char> generated_texture(int size, unsigned int seed) {
+    seed_random(seed);
+    std::vector<unsigned char> rgb(size_t(size) * size * 3);
+    Vector3D a = Vector3D::random(0.2, 0.9), b = Vector3D::random(0.2, 0.9);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            Vector3D c = ((x / 64 + y / 64) % 2 ? a : b) * random_float(0.8, 1);
+            unsigned char* p = &rgb[3 * (size_t(y) * size + x)];
+            p[0] = static_cast<unsigned char>(255 * c.x());
+            p[1] = static_cast<unsigned char>(255 * c.y());
+            p[2] = static_cast<unsigned char>(255 * c.z());
+        }
+    }
+    return rgb;
+}
+
+// Row by row linear colours at the full resolution only, what the texture would be without levels and tiles
+class PlainTexture {
+public:
+    int m_width, m_height;
+    std::vector<Vector3D> m_texels;
+
+    PlainTexture(const Texture& texture) : m_width(texture.width()), m_height(texture.height()), m_texels(size_t(m_width) * m_height) {
+        for (int y = 0; y < m_height; ++y)
+            for (int x = 0; x < m_width; ++x)
+                m_texels[size_t(y) * m_width + x] = texture.texel(0, x, y);
+    }
+
+    Vector3D bilinear(float u, float v) const {
+        u -= floor(u);
+        v -= floor(v);
+        float x = u * m_width - 0.5f, y = (1 - v) * m_height - 0.5f;
+        float fx = floor(x), fy = floor(y);
+        float ax = x - fx, ay = y - fy;
+        int x0 = (int(fx) + m_width) % m_width, y0 = (int(fy) + m_height) % m_height;
+        int x1 = (x0 + 1) % m_width, y1 = (y0 + 1) % m_height;
+        auto at = [&](int x, int y) { return m_texels[size_t(y) * m_width + x]; };
+        return (1 - ay) * ((1 - ax) * at(x0, y0) + ax * at(x1, y0)) + ay * ((1 - ax) * at(x0, y1) + ax * at(x1, y1));
+    }
+};
+
+// Nanoseconds per lookup of f(u, v) over the given coordinates
+template<class F>
+double time_lookups(const std::vector<float>& uv, F f) {
+    Vector3D sum(0, 0, 0);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < uv.size(); i += 2)
+        sum += f(uv[i], uv[i + 1]);
+    double ns = 1e9 * seconds_since(start) / (uv.size() / 2);
+    // Keep the lookups from being optimized away
+    if (sum.x() < 0)
+        std::cout << sum.x();
+    return ns;
+}
+
+int main()
+{
+    const std::string data = "../../as3/data/";
+    struct Asset {
+        std::string m_obj, m_texture;
+    };
+    std::vector<Asset> assets = {{"floor.obj", "floor.jpeg"}, {"bucket.obj", "bucket.jpg"}};
+
+    World world;
+    world.m_background = Vector3D(0.8, 0.85, 1);
+    std::vector<shared_ptr<Texture>> textures;
+    for (size_t i = 0; i < assets.size(); ++i) {
+        // Decoded and tiled once here, the renderer only reads them
+        auto texture = make_shared<Texture>();
+        auto start = std::chrono::steady_clock::now();
+        if (!texture->load(data + assets[i].m_texture)) {
+            std::cout << "Cannot decode " << data << assets[i].m_texture << ", using a generated texture" << std::endl;
+            std::vector<unsigned char> rgb = generated_texture(1024, static_cast<unsigned int>(i + 1));
+            texture->build(1024, 1024, rgb.data());
+        }
+        std::cout << assets[i].m_texture << ": " << texture->width() << "x" << texture->height() << ", " << texture->level_count()
+                  << " levels, " << texture->memory_bytes() / 1024 << " KB, built in " << 1000 * seconds_since(start) << " ms" << std::endl;
+        textures.push_back(texture);
+
+        auto mesh = make_shared<TriangleMesh>(make_shared<TexturedDiffuse>(texture));
+        if (!mesh->load_obj(data + assets[i].m_obj)) {
+            std::cout << "Failed to read " << data << assets[i].m_obj << std::endl;
+            return -1;
+        }
+        if (mesh->m_uvs.empty())
+            std::cout << assets[i].m_obj << " has no texture coordinates" << std::endl;
+        world.m_meshes.push_back(mesh);
+    }
+    world.build_bvh();
+
+    // Random coordinates, as scattered as the hits of rays after a diffuse bounce
+    const int lookups = 4000000;
+    std::vector<float> uv(2 * lookups);
+    seed_random(7);
+    for (auto &c : uv)
+        c = random_float();
+    const Texture& texture = *textures[0];
+    PlainTexture plain(texture);
+    // A footprint a bounce ray could have, some texels wide
+    float bounce_footprint = 16.0f / texture.width();
+    std::cout << "random lookups in " << assets[0].m_texture << ":" << std::endl;
+    std::cout << "  plain, bilinear:            " << time_lookups(uv, [&](float u, float v) { return plain.bilinear(u, v); }) << " ns" << std::endl;
+    std::cout << "  tiled, bilinear:            " << time_lookups(uv, [&](float u, float v) { return texture.bilinear(0, u, v); }) << " ns" << std::endl;
+    std::cout << "  tiled, trilinear at bounce: " << time_lookups(uv, [&](float u, float v) { return texture.sample(u, v, bounce_footprint); }) << " ns" << std::endl;
+    // The same lookups in order along rows, as coherent as primary rays get
+    std::vector<float> rows(uv.size());
+    int side = 2000;
+    for (int i = 0; i < lookups; ++i) {
+        rows[2 * i] = (i % side + 0.5f) / side;
+        rows[2 * i + 1] = 1 - (i / side + 0.5f) / side;
+    }
+    std::cout << "  tiled, bilinear, in order:  " << time_lookups(rows, [&](float u, float v) { return texture.bilinear(0, u, v); }) << " ns" << std::endl;
+
+    RenderSettings settings;
+    settings.m_width = 320;
+    settings.m_height = 240;
+    settings.m_raysPerPixel = 16;
+    settings.m_maxLightBounceNum = 3;
+    settings.m_useIrradianceCache = false;
+    Vector3D eye(60, 70, 120);
+    Vector3D target(0, 15, 0);
+    Vector3D up(0, 1, 0);
+    Camera camera(eye, target, up, 40, settings.m_width / float(settings.m_height));
+
+    RadianceBuffer image(settings.m_width, settings.m_height);
+    auto start = std::chrono::steady_clock::now();
+    Renderer renderer(world, camera, settings);
+    renderer.render(image);
+    std::cout << "rendered in " << seconds_since(start) << " s" << std::endl;
+
+    std::string path = "../results/texture.ppm";
+    if (!image.save_ppm(path)) {
+        std::cout << "Failed to save " << path << std::endl;
+        return -1;
+    }
+    std::cout << "ppm saved at " << path << std::endl;
+}
@@ -0,0 +1,241 @@
+#ifndef MESH_STORE_H
+#define MESH_STORE_H
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+
+
+// View of count elements of an array owned by someone else
+template<class T>
+class Span {
+    public:
+        Span() : ptr(nullptr), count(0) {}
+        Span(T *ptr, size_t count) : ptr(ptr), count(count) {}
+        template<class U>
+        Span(std::vector<U> &v) : ptr(v.data()), count(v.size()) {}
+        template<class U>
+        Span(const std::vector<U> &v) : ptr(v.data()), count(v.size()) {}
+
+        T *data() const { return ptr; }
+        size_t size() const { return count; }
+        size_t bytes() const { return count * sizeof(T); }
+        bool empty() const { return count == 0; }
+        T &operator[](size_t i) const { return ptr[i]; }
+        T *begin() const { return ptr; }
+        T *end() const { return ptr + count; }
+
+    private:
+        T *ptr;
+        size_t count;
+};
+
+
+// One corner of a face, as indices into the positions, normals and texcoords of an obj file
+// -1 where the corner has none, the same fields as tinyobj::index_t
+struct ObjCorner {
+    int position;
+    int normal;
+    int texcoord;
+};
+
+
+// Indexed triangle mesh with one array per attribute
+// The as2 and as3 viewers upload the streams as they are, and as4's TriangleMesh can
+// trace the same store, so a mesh is held once in memory however many use it
+class MeshStore {
+    public:
+        // x y z per vertex
+        std::vector<float> positions;
+        // x y z per vertex, or empty
+        std::vector<float> normals;
+        // u v per vertex, or empty
+        std::vector<float> texcoords;
+        // r g b a per vertex, or empty. as3 keeps baked lighting here
+        std::vector<float> colors;
+        // Three per triangle
+        std::vector<uint32_t> indices;
+        // Obj position every vertex was made from, for data stored per "v" line
+        std::vector<uint32_t> sources;
+
+        size_t vertexCount() const { return positions.size() / 3; }
+        size_t triangleCount() const { return indices.size() / 3; }
+        size_t memoryBytes() const {
+            return (positions.size() + normals.size() + texcoords.size() + colors.size()) * sizeof(float)
+                   + (indices.size() + sources.size()) * sizeof(uint32_t);
+        }
+
+        // Set the positions from x y z per obj position, through sources
+        // For a new shape of the same obj, e.g. a blend, the rest of the store stays as it is
+        void scatterPositions(const float *objPositions) {
+            for (size_t v = 0; v < sources.size(); v++) {
+                const float *p = objPositions + 3 * size_t(sources[v]);
+                positions[3 * v] = p[0];
+                positions[3 * v + 1] = p[1];
+                positions[3 * v + 2] = p[2];
+            }
+        }
+
+        // Build from the arrays of an obj file and the corners of its triangles, three per triangle
+        // Corners with the same indices become one vertex. normals, texcoords and colors may be
+        // null, colors has r g b a per position
+        static MeshStore fromCorners(const float *objPositions, const float *objNormals, const float *objTexcoords,
+                                     const float *objColors, const ObjCorner *corners, size_t cornerCount) {
+            MeshStore store;
+            bool hasNormals = objNormals != nullptr, hasTexcoords = objTexcoords != nullptr, hasColors = objColors != nullptr;
+            for (size_t i = 0; i < cornerCount; i++) {
+                hasNormals = hasNormals && corners[i].normal >= 0;
+                hasTexcoords = hasTexcoords && corners[i].texcoord >= 0;
+            }
+
+            // Vertex of every corner, the first corner with the same (position, normal, texcoord)
+            // makes it. The indices are compared rather than the values they point to, which is
+            // cheaper and gives the same vertices for obj files
+            bool sorted = cornerCount >= parallelWeldCorners && std::thread::hardware_concurrency() >= parallelWeldThreads;
+            for (size_t i = 0; sorted && i < cornerCount; i++)
+                sorted = corners[i].position < sortKeyLimit && corners[i].normal < sortKeyLimit && corners[i].texcoord < sortKeyLimit;
+            std::vector<uint32_t> vertexOf = sorted ? weldSorted(corners, cornerCount, hasNormals, hasTexcoords)
+                                                    : weldHashed(corners, cornerCount, hasNormals, hasTexcoords);
+
+            store.indices = std::move(vertexOf);
+            size_t vertexCount = 0;
+            for (uint32_t v : store.indices)
+                vertexCount = std::max<size_t>(vertexCount, v + 1);
+            store.sources.resize(vertexCount);
+            store.positions.resize(3 * vertexCount);
+            if (hasNormals)
+                store.normals.resize(3 * vertexCount);
+            if (hasTexcoords)
+                store.texcoords.resize(2 * vertexCount);
+            if (hasColors)
+                store.colors.resize(4 * vertexCount);
+            // Vertices are numbered in the order of their first corner, so each is filled at that corner
+            uint32_t next = 0;
+            for (size_t i = 0; i < cornerCount; i++) {
+                uint32_t v = store.indices[i];
+                if (v != next)
+                    continue;
+                next++;
+                const ObjCorner &c = corners[i];
+                store.sources[v] = static_cast<uint32_t>(c.position);
+                std::copy(objPositions + 3 * size_t(c.position), objPositions + 3 * size_t(c.position) + 3, &store.positions[3 * v]);
+                if (hasNormals)
+                    std::copy(objNormals + 3 * size_t(c.normal), objNormals + 3 * size_t(c.normal) + 3, &store.normals[3 * v]);
+                if (hasTexcoords)
+                    std::copy(objTexcoords + 2 * size_t(c.texcoord), objTexcoords + 2 * size_t(c.texcoord) + 2, &store.texcoords[2 * v]);
+                if (hasColors)
+                    std::copy(objColors + 4 * size_t(c.position), objColors + 4 * size_t(c.position) + 4, &store.colors[4 * v]);
+            }
+            return store;
+        }
+
+    private:
+        // Welding is sorted in parallel rather than hashed from this many corners, when there
+        // are enough threads to beat one thread hashing, and obj indices fit the sort key
+        static const size_t parallelWeldCorners = 1 << 20;
+        static const unsigned parallelWeldThreads = 8;
+        static const int sortKeyLimit = (1 << 21) - 1;
+
+        // The corner as one 64 bit key, the indices that are not used count as 0
+        static uint64_t cornerKey(const ObjCorner &c, bool hasNormals, bool hasTexcoords) {
+            return uint64_t(uint32_t(c.position)) << 32 ^ uint64_t(uint32_t(hasNormals ? c.normal : 0)) << 21
+                   ^ uint64_t(uint32_t(hasTexcoords ? c.texcoord : 0)) * 0x9e3779b97f4a7c15ull;
+        }
+
+        // Mixes every bit of the key into the low bits, which pick the slot
+        static uint64_t mix(uint64_t h) {
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+            return h ^ (h >> 31);
+        }
+
+        static bool sameCorner(const ObjCorner &a, const ObjCorner &b, bool hasNormals, bool hasTexcoords) {
+            return a.position == b.position && (!hasNormals || a.normal == b.normal) && (!hasTexcoords || a.texcoord == b.texcoord);
+        }
+
+        // Vertex of every corner through a flat table with open addressing, one probe sequence
+        // per corner. A slot holds the first corner of its vertex, and the table is at most half full
+        static std::vector<uint32_t> weldHashed(const ObjCorner *corners, size_t cornerCount, bool hasNormals, bool hasTexcoords) {
+            size_t capacity = 16;
+            while (capacity < 2 * cornerCount)
+                capacity *= 2;
+            const uint32_t empty = UINT32_MAX;
+            std::vector<uint32_t> slots(capacity, empty);
+            std::vector<uint32_t> vertexOf(cornerCount);
+            uint32_t next = 0;
+            for (size_t i = 0; i < cornerCount; i++) {
+                const ObjCorner &c = corners[i];
+                size_t slot = mix(cornerKey(c, hasNormals, hasTexcoords)) & (capacity - 1);
+                while (slots[slot] != empty && !sameCorner(corners[slots[slot]], c, hasNormals, hasTexcoords))
+                    slot = (slot + 1) & (capacity - 1);
+                if (slots[slot] == empty) {
+                    slots[slot] = static_cast<uint32_t>(i);
+                    vertexOf[i] = next++;
+                }
+                else {
+                    vertexOf[i] = vertexOf[slots[slot]];
+                }
+            }
+            return vertexOf;
+        }
+
+        // The same numbering by sorting (corner, index) pairs, in parallel for large meshes
+        // Equal corners end up next to each other, the first by index leading its run
+        static std::vector<uint32_t> weldSorted(const ObjCorner *corners, size_t cornerCount, bool hasNormals, bool hasTexcoords) {
+            // position, normal + 1 and texcoord + 1 in 21 bits each, then the corner
+            struct Entry {
+                uint64_t key;
+                uint32_t index;
+                bool operator<(const Entry &o) const { return key != o.key ? key < o.key : index < o.index; }
+            };
+            std::vector<Entry> entries(cornerCount);
+            for (size_t i = 0; i < cornerCount; i++) {
+                const ObjCorner &c = corners[i];
+                uint64_t normal = hasNormals ? uint64_t(c.normal + 1) : 0, texcoord = hasTexcoords ? uint64_t(c.texcoord + 1) : 0;
+                entries[i] = {uint64_t(c.position) << 42 | normal << 21 | texcoord, static_cast<uint32_t>(i)};
+            }
+
+            // Sort one chunk per thread, then merge neighbouring chunks in parallel until one is left
+            size_t threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+            std::vector<size_t> bounds;
+            for (size_t k = 0; k <= threadCount; k++)
+                bounds.push_back(cornerCount * k / threadCount);
+            std::vector<std::thread> threads;
+            for (size_t k = 0; k < threadCount; k++)
+                threads.emplace_back([&, k]() { std::sort(entries.begin() + bounds[k], entries.begin() + bounds[k + 1]); });
+            for (auto &thread : threads)
+                thread.join();
+            while (bounds.size() > 2) {
+                std::vector<size_t> merged;
+                threads.clear();
+                for (size_t k = 0; k + 1 < bounds.size(); k += 2) {
+                    merged.push_back(bounds[k]);
+                    if (k + 2 < bounds.size()) {
+                        size_t first = bounds[k], middle = bounds[k + 1], last = bounds[k + 2];
+                        threads.emplace_back([&entries, first, middle, last]() {
+                            std::inplace_merge(entries.begin() + first, entries.begin() + middle, entries.begin() + last);
+                        });
+                    }
+                }
+                merged.push_back(bounds.back());
+                for (auto &thread : threads)
+                    thread.join();
+                bounds = merged;
+            }
+
+            // The first corner of every run, then vertices numbered in the order of their first corner
+            std::vector<uint32_t> first(cornerCount);
+            for (size_t i = 0; i < cornerCount; i++) {
+                bool lead = i == 0 || entries[i].key != entries[i - 1].key;
+                first[entries[i].index] = lead ? entries[i].index : first[entries[i - 1].index];
+            }
+            std::vector<uint32_t> vertexOf(cornerCount);
+            uint32_t next = 0;
+            for (size_t i = 0; i < cornerCount; i++)
+                vertexOf[i] = first[i] == i ? next++ : vertexOf[first[i]];
+            return vertexOf;
+        }
+};
+#endif
@@ -0,0 +1,406 @@
+#ifndef OBJ_READER_H
+#define OBJ_READER_H
+
+#include "mesh_store.h"
+#include "tiny_obj_loader.h"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// Arrays of an obj file, with its triangles as corners into them
+struct ObjData {
+    // x y z per "v" line
+    std::vector<float> positions;
+    // x y z per "vn" line
+    std::vector<float> normals;
+    // u v per "vt" line
+    std::vector<float> texcoords;
+    // Three per triangle, faces with more corners are split into fans around their first
+    std::vector<ObjCorner> corners;
+};
+
+
+// Reads obj files straight into the arrays MeshStore::fromCorners takes
+// The file is mapped rather than streamed, cut into chunks at line ends, and the chunks
+// are parsed on their own threads, then joined in file order
+// Only v, vn, vt and f lines are read, groups, smoothing and materials are skipped as the
+// viewers do not use them. A file with any other line, e.g. curves, or a number this reader
+// does not take is read by tinyobj instead, so it reads whatever tinyobj reads
+class ObjReader {
+    public:
+        // Read the obj file at path into obj, returns false with a message in error if it cannot be read
+        static bool read(const std::string &path, ObjData &obj, std::string &error) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                error = "cannot open";
+                return false;
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                error = "cannot read";
+                return false;
+            }
+            size_t size = static_cast<size_t>(st.st_size);
+            if (size == 0) {
+                close(fd);
+                obj = ObjData();
+                return true;
+            }
+            void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (data == MAP_FAILED)
+                return readTinyobj(path, obj, error);
+            // Every page is read once, by whichever thread has its chunk
+            madvise(data, size, MADV_WILLNEED);
+
+            bool parsed = parse(static_cast<const char*>(data), size, obj);
+            munmap(data, size);
+            if (!parsed)
+                return readTinyobj(path, obj, error);
+            return checkCorners(obj, error);
+        }
+
+    private:
+        // Files are parsed in chunks of at least this many bytes, one chunk per thread
+        static const size_t minChunkBytes = 1 << 18;
+
+        // Part of the file parsed by one thread, its indices are absolute unless listed in relative
+        struct Chunk {
+            ObjData data;
+            // Fields of corners given by a negative index, counted from the end of this chunk's
+            // earlier lines, until the counts of the chunks before are known
+            struct Relative {
+                size_t corner;
+                int ObjCorner::*field;
+            };
+            std::vector<Relative> relative;
+            bool supported = true;
+        };
+
+        static bool parse(const char *text, size_t size, ObjData &obj) {
+            const char *end = text + size;
+            size_t chunkCount = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), size / minChunkBytes));
+
+            // Each chunk starts after the line end at or past its share of the bytes
+            std::vector<const char*> bounds(1, text);
+            for (size_t k = 1; k < chunkCount; k++) {
+                const char *p = findNewline(std::max(bounds.back(), text + size * k / chunkCount), end);
+                bounds.push_back(p == end ? end : p + 1);
+            }
+            bounds.push_back(end);
+
+            std::vector<Chunk> chunks(chunkCount);
+            std::vector<std::thread> threads;
+            for (size_t k = 1; k < chunkCount; k++)
+                threads.emplace_back([&, k]() { parseChunk(bounds[k], bounds[k + 1], chunks[k]); });
+            parseChunk(bounds[0], bounds[1], chunks[0]);
+            for (auto &thread : threads)
+                thread.join();
+
+            for (const Chunk &chunk : chunks) {
+                if (!chunk.supported)
+                    return false;
+            }
+            join(chunks, obj);
+            return true;
+        }
+
+        // Append the chunks in order, making their relative indices absolute
+        static void join(std::vector<Chunk> &chunks, ObjData &obj) {
+            if (chunks.size() == 1 && chunks[0].relative.empty()) {
+                obj = std::move(chunks[0].data);
+                return;
+            }
+            size_t positions = 0, normals = 0, texcoords = 0, corners = 0;
+            for (const Chunk &chunk : chunks) {
+                positions += chunk.data.positions.size();
+                normals += chunk.data.normals.size();
+                texcoords += chunk.data.texcoords.size();
+                corners += chunk.data.corners.size();
+            }
+            obj = ObjData();
+            obj.positions.reserve(positions);
+            obj.normals.reserve(normals);
+            obj.texcoords.reserve(texcoords);
+            obj.corners.reserve(corners);
+            for (Chunk &chunk : chunks) {
+                int base[3] = {int(obj.positions.size() / 3), int(obj.normals.size() / 3), int(obj.texcoords.size() / 2)};
+                size_t first = obj.corners.size();
+                obj.positions.insert(obj.positions.end(), chunk.data.positions.begin(), chunk.data.positions.end());
+                obj.normals.insert(obj.normals.end(), chunk.data.normals.begin(), chunk.data.normals.end());
+                obj.texcoords.insert(obj.texcoords.end(), chunk.data.texcoords.begin(), chunk.data.texcoords.end());
+                obj.corners.insert(obj.corners.end(), chunk.data.corners.begin(), chunk.data.corners.end());
+                for (const Chunk::Relative &r : chunk.relative) {
+                    int &index = obj.corners[first + r.corner].*r.field;
+                    index += r.field == &ObjCorner::position ? base[0] : r.field == &ObjCorner::normal ? base[1] : base[2];
+                }
+                chunk.data = ObjData();
+            }
+        }
+
+        // Every corner has a position and points inside the arrays
+        static bool checkCorners(const ObjData &obj, std::string &error) {
+            int positions = int(obj.positions.size() / 3), normals = int(obj.normals.size() / 3), texcoords = int(obj.texcoords.size() / 2);
+            for (const ObjCorner &c : obj.corners) {
+                if (c.position < 0 || c.position >= positions || c.normal < -1 || c.normal >= normals
+                    || c.texcoord < -1 || c.texcoord >= texcoords) {
+                    error = "face index out of range";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // First line end in [p, end), or end, 16 bytes at a time where SSE2 is available
+        static const char *findNewline(const char *p, const char *end) {
+#if defined(__SSE2__)
+            const __m128i newline = _mm_set1_epi8('\n');
+            while (end - p >= 16) {
+                int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), newline));
+                if (mask)
+                    return p + __builtin_ctz(mask);
+                p += 16;
+            }
+#endif
+            while (p < end && *p != '\n')
+                p++;
+            return p;
+        }
+
+        static bool isSpace(char c) {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        static void skipSpaces(const char *&p, const char *end) {
+            while (p < end && isSpace(*p))
+                p++;
+        }
+
+        static void parseChunk(const char *p, const char *end, Chunk &chunk) {
+            std::vector<ObjCorner> face;
+            std::vector<int> faceRelative;
+            while (p < end) {
+                const char *eol = findNewline(p, end);
+                if (!parseLine(p, eol, chunk, face, faceRelative)) {
+                    chunk.supported = false;
+                    return;
+                }
+                p = eol == end ? end : eol + 1;
+            }
+        }
+
+        // Parse the line [p, end), returns false if it is not one this reader takes
+        static bool parseLine(const char *p, const char *end, Chunk &chunk, std::vector<ObjCorner> &face, std::vector<int> &faceRelative) {
+            skipSpaces(p, end);
+            if (p == end || *p == '#')
+                return true;
+            const char *keyword = p;
+            while (p < end && !isSpace(*p))
+                p++;
+            size_t length = p - keyword;
+
+            if (length == 1 && keyword[0] == 'v')
+                return parseFloats(p, end, 3, 3, chunk.data.positions);
+            if (length == 2 && keyword[0] == 'v' && keyword[1] == 'n')
+                return parseFloats(p, end, 3, 3, chunk.data.normals);
+            if (length == 2 && keyword[0] == 'v' && keyword[1] == 't')
+                return parseFloats(p, end, 1, 2, chunk.data.texcoords);
+            if (length == 1 && keyword[0] == 'f')
+                return parseFace(p, end, chunk, face, faceRelative);
+            // Names, groups, smoothing and materials
+            static const char *const skipped[] = {"o", "g", "s", "usemtl", "mtllib"};
+            for (const char *s : skipped) {
+                if (length == strlen(s) && memcmp(keyword, s, length) == 0)
+                    return true;
+            }
+            return false;
+        }
+
+        // At least required and at most kept numbers, the ones left out are 0
+        // Numbers after the kept ones are skipped, such as the w of a position
+        static bool parseFloats(const char *p, const char *end, int required, int kept, std::vector<float> &out) {
+            for (int i = 0; i < kept; i++) {
+                skipSpaces(p, end);
+                float value = 0;
+                if (p == end || *p == '#') {
+                    if (i < required)
+                        return false;
+                }
+                else if (!parseFloat(p, end, value)) {
+                    return false;
+                }
+                out.push_back(value);
+            }
+            return true;
+        }
+
+        // Corners "v", "v/vt", "v//vn" or "v/vt/vn", the face is added as a fan of triangles
+        static bool parseFace(const char *p, const char *end, Chunk &chunk, std::vector<ObjCorner> &face, std::vector<int> &faceRelative) {
+            face.clear();
+            faceRelative.clear();
+            int counts[3] = {int(chunk.data.positions.size() / 3), int(chunk.data.texcoords.size() / 2), int(chunk.data.normals.size() / 3)};
+            skipSpaces(p, end);
+            while (p < end && *p != '#') {
+                // position, texcoord and normal, 0 for none
+                int index[3] = {0, 0, 0};
+                if (!parseIndex(p, end, index[0]))
+                    return false;
+                if (p < end && *p == '/') {
+                    p++;
+                    if (p < end && *p != '/' && !parseIndex(p, end, index[1]))
+                        return false;
+                    if (p < end && *p == '/') {
+                        p++;
+                        if (!parseIndex(p, end, index[2]))
+                            return false;
+                    }
+                }
+                if (p < end && !isSpace(*p))
+                    return false;
+
+                // Negative indices count back from the line, and are made absolute when the chunks are joined
+                int relative = 0;
+                for (int i = 0; i < 3; i++) {
+                    if (index[i] < 0) {
+                        index[i] += counts[i];
+                        relative |= 1 << i;
+                    }
+                    else {
+                        index[i] -= 1;
+                    }
+                }
+                face.push_back({index[0], index[2], index[1]});
+                faceRelative.push_back(relative);
+                skipSpaces(p, end);
+            }
+
+            for (size_t k = 2; k < face.size(); k++) {
+                for (size_t c : {size_t(0), k - 1, k}) {
+                    if (faceRelative[c] & 1)
+                        chunk.relative.push_back({chunk.data.corners.size(), &ObjCorner::position});
+                    if (faceRelative[c] & 2)
+                        chunk.relative.push_back({chunk.data.corners.size(), &ObjCorner::texcoord});
+                    if (faceRelative[c] & 4)
+                        chunk.relative.push_back({chunk.data.corners.size(), &ObjCorner::normal});
+                    chunk.data.corners.push_back(face[c]);
+                }
+            }
+            return true;
+        }
+
+        // Signed decimal index, 0 is not an index
+        static bool parseIndex(const char *&p, const char *end, int &value) {
+            bool negative = p < end && *p == '-';
+            if (negative)
+                p++;
+            const char *digits = p;
+            int64_t v = 0;
+            while (p < end && *p >= '0' && *p <= '9' && p - digits < 10)
+                v = v * 10 + (*p++ - '0');
+            if (p == digits || v == 0 || v > INT32_MAX || (p < end && *p >= '0' && *p <= '9'))
+                return false;
+            value = negative ? -int(v) : int(v);
+            return true;
+        }
+
+        // Decimal number followed by white space or the end of the line
+        // Up to 15 significant digits and exponents within 22 are converted exactly in
+        // double, which covers what exporters write, the rest go through strtod
+        static bool parseFloat(const char *&p, const char *end, float &value) {
+            static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+            const char *start = p;
+            bool negative = p < end && *p == '-';
+            if (p < end && (*p == '-' || *p == '+'))
+                p++;
+            uint64_t mantissa = 0;
+            int digits = 0, exponent = 0;
+            bool any = false;
+            while (p < end && *p >= '0' && *p <= '9') {
+                mantissa = mantissa * 10 + (*p++ - '0');
+                digits += mantissa != 0;
+                any = true;
+            }
+            if (p < end && *p == '.') {
+                p++;
+                while (p < end && *p >= '0' && *p <= '9') {
+                    mantissa = mantissa * 10 + (*p++ - '0');
+                    digits += mantissa != 0;
+                    exponent--;
+                    any = true;
+                }
+            }
+            if (any && p < end && (*p == 'e' || *p == 'E')) {
+                p++;
+                bool negativeExponent = p < end && *p == '-';
+                if (p < end && (*p == '-' || *p == '+'))
+                    p++;
+                int e = 0;
+                const char *exponentDigits = p;
+                while (p < end && *p >= '0' && *p <= '9' && e < 10000)
+                    e = e * 10 + (*p++ - '0');
+                if (p == exponentDigits)
+                    return false;
+                exponent += negativeExponent ? -e : e;
+            }
+
+            if (any && digits <= 15 && exponent >= -22 && exponent <= 22 && (p == end || isSpace(*p))) {
+                double d = double(mantissa);
+                d = exponent < 0 ? d / powers[-exponent] : d * powers[exponent];
+                value = float(negative ? -d : d);
+                return true;
+            }
+
+            // Long numbers, nan and inf
+            const char *token = start;
+            while (p < end && !isSpace(*p))
+                p++;
+            char buffer[64];
+            size_t length = p - token;
+            if (length == 0 || length >= sizeof(buffer))
+                return false;
+            memcpy(buffer, token, length);
+            buffer[length] = '\0';
+            char *last;
+            value = strtof(buffer, &last);
+            return last == buffer + length;
+        }
+
+        // The whole file through tinyobj, for files with lines this reader does not take
+        static bool readTinyobj(const std::string &path, ObjData &obj, std::string &error) {
+            tinyobj::attrib_t attrib;
+            std::vector<tinyobj::shape_t> shapes;
+            std::vector<tinyobj::material_t> materials;
+            std::string warn, err;
+            if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str(), nullptr, true)) {
+                error = err.empty() ? "tinyobj error" : err;
+                return false;
+            }
+            obj = ObjData();
+            obj.positions = std::move(attrib.vertices);
+            obj.normals = std::move(attrib.normals);
+            obj.texcoords = std::move(attrib.texcoords);
+            for (const auto &shape : shapes) {
+                for (const auto &index : shape.mesh.indices)
+                    obj.corners.push_back({index.vertex_index, index.normal_index, index.texcoord_index});
+            }
+            return checkCorners(obj, error);
+        }
+};
+#endif